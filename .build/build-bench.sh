@@ -0,0 +1,8 @@
+gcc --std=c99 \
+    -Wall \
+    bench/harness.c deeprose.c parsing.c mpc.c lval.c eval.c builtin.c lenv.c lseq.c lfile.c lbig.c lsort.c lchan.c lproc.c macro.c fold.c jit.c \
+    -lm \
+    -lpthread \
+    -o deeprose-bench
+
+echo "done"
@@ -0,0 +1,20 @@
+# libdeeprose.a and libdeeprose.so, for embedding. see deeprose.h
+for src in deeprose.c parsing.c mpc.c lval.c eval.c builtin.c lenv.c lseq.c lfile.c lbig.c lsort.c lchan.c lproc.c macro.c fold.c jit.c; do
+    gcc --std=c99 \
+        -Wall \
+        -fPIC \
+        -c $src \
+        -o ${src%.c}.o
+done
+
+ar rcs libdeeprose.a deeprose.o parsing.o mpc.o lval.o eval.o builtin.o lenv.o lseq.o lfile.o lbig.o lsort.o lchan.o lproc.o macro.o fold.o jit.o
+
+gcc -shared \
+    deeprose.o parsing.o mpc.o lval.o eval.o builtin.o lenv.o lseq.o lfile.o lbig.o lsort.o lchan.o lproc.o macro.o fold.o jit.o \
+    -lm \
+    -lpthread \
+    -o libdeeprose.so
+
+rm deeprose.o parsing.o mpc.o lval.o eval.o builtin.o lenv.o lseq.o lfile.o lbig.o lsort.o lchan.o lproc.o macro.o fold.o jit.o
+
+echo "done"
@@ -1,8 +1,9 @@
 gcc --std=c99 \
     -Wall \
+    main.c server.c deeprose.c parsing.c mpc.c lval.c eval.c builtin.c lenv.c lseq.c lfile.c lbig.c lsort.c lchan.c lproc.c macro.c fold.c jit.c compile.c \
     -leditline \
     -lm \
-    parsing.c mpc.c lval.c builtin.c lenv.c \
+    -lpthread \
     -o deeprose
 
-echo "done"
\ No newline at end of file
+echo "done"
@@ -0,0 +1,32 @@
+# runs every tests/*.deeprose with --script and compares what it prints with
+# the .out next to it. when libdeeprose.a has been built, each one is also
+# compiled with --compile and checked the same way, unless its first line says
+# it's interpreted only. run from the repository root after
+# .build/build-release.sh
+export DRLIBPATH="${DRLIBPATH:-.}"
+failed=0
+tmp=$(mktemp -d)
+for t in tests/*.deeprose; do
+    name=$(basename "$t" .deeprose)
+    ./deeprose --script "$t" </dev/null > "$tmp/$name.out" 2>&1
+    if ! cmp -s "$tmp/$name.out" "tests/$name.out"; then
+        echo "FAIL $name"
+        diff "tests/$name.out" "$tmp/$name.out"
+        failed=1
+    fi
+
+    if [ -f libdeeprose.a ] && ! head -n 1 "$t" | grep -q "interpreted only"; then
+        ./deeprose --compile "$t" -o "$tmp/$name.c" &&
+            gcc --std=c99 "$tmp/$name.c" -I. libdeeprose.a -lm -lpthread -o "$tmp/$name" &&
+            "$tmp/$name" </dev/null > "$tmp/$name.cout" 2>&1
+        if ! cmp -s "$tmp/$name.cout" "tests/$name.out"; then
+            echo "FAIL $name (compiled)"
+            diff "tests/$name.out" "$tmp/$name.cout"
+            failed=1
+        fi
+    fi
+done
+rm -rf "$tmp"
+
+[ $failed = 0 ] && echo "done"
+exit $failed
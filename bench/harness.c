@@ -0,0 +1,333 @@
+// benchmark harness: runs every workload in bench/, each in a process of its
+// own, and reports ns/op, allocations/op and peak rss, optionally checking
+// against a baseline
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../mpc.h"
+#include "../lval.h"
+#include "../lenv.h"
+#include "../builtin.h"
+#include "../parsing.h"
+#include "../deeprose.h"
+
+// count every allocation by sitting in front of glibc's allocator
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static unsigned long allocations = 0;
+
+void* malloc(size_t size) { allocations++; return __libc_malloc(size); }
+void* calloc(size_t n, size_t size) { allocations++; return __libc_calloc(n, size); }
+void* realloc(void* ptr, size_t size) { allocations++; return __libc_realloc(ptr, size); }
+void free(void* ptr) { __libc_free(ptr); }
+
+typedef struct {
+    char* name;
+    // loaded once before timing starts (relative to bench/), NULL for none
+    char* file;
+    // evaluated once per op, NULL means "load the prelude into a fresh env"
+    char* expr;
+} workload;
+
+static workload workloads[] = {
+    { "fib",              "fib.deeprose",             "(fib-rec 15)" },
+    { "map-filter-fold",  "map-filter-fold.deeprose", "(pipeline 200)" },
+    { "strings",          "strings.deeprose",         "(build-str 200 \"\")" },
+    { "closures-nested",  "closures.deeprose",        "(nest 100 0)" },
+    { "closures-partial", "closures.deeprose",        "(call-partials 100 0)" },
+    { "stdlib-load",      NULL,                       NULL },
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+typedef struct {
+    unsigned long iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    long peak_rss_kb;
+    int failed;
+} result;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static void load_prelude_or_die(lenv* e) {
+    lval* x = load_prelude(e);
+    if (x->type == LVAL_ERR) { lval_println(x); exit(EXIT_FAILURE); }
+    lval_del(x);
+}
+
+// one iteration of a workload. returns 0 if the workload errored
+static int run_op(workload* w, lenv* e, lval* expr) {
+    if (!w->expr) {
+        // a fresh global env sharing the interpreter's parser, so this
+        // measures the builtins and prelude rather than building the grammar
+        lenv* fresh = lenv_new();
+        fresh->interp = lenv_interp(e);
+        lenv_add_builtins(fresh);
+        load_prelude_or_die(fresh);
+        lenv_del(fresh);
+        return 1;
+    }
+
+    lval* x = lval_eval(e, lval_copy(expr));
+    int ok = x->type != LVAL_ERR;
+    if (!ok) { lval_println(x); }
+    lval_del(x);
+    return ok;
+}
+
+static result run_workload(workload* w, char* dir, double min_seconds) {
+    result r = { 0, 0, 0, 0, 0 };
+    deeprose* d = deeprose_new();
+    lenv* e = d->env;
+    load_prelude_or_die(e);
+    lval* expr = NULL;
+
+    if (w->file) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, w->file);
+        lval* x = builtin_load(e, lval_add(lval_sexpr(), lval_str(path)));
+        if (x->type == LVAL_ERR) { lval_println(x); r.failed = 1; }
+        lval_del(x);
+    }
+
+    if (w->expr && !r.failed) {
+        expr = read_program(d, "<bench>", w->expr);
+        if (expr->type == LVAL_ERR) {
+            lval_println(expr);
+            lval_del(expr);
+            expr = NULL;
+            r.failed = 1;
+        }
+    }
+
+    // warm up once so first-touch costs don't land in the numbers
+    if (!r.failed && !run_op(w, e, expr)) { r.failed = 1; }
+
+    if (!r.failed) {
+        long budget = (long)(min_seconds * 1e9);
+        unsigned long allocs_before = allocations;
+        long start = now_ns();
+        long elapsed = 0;
+
+        while (elapsed < budget) {
+            if (!run_op(w, e, expr)) { r.failed = 1; break; }
+            r.iterations++;
+            elapsed = now_ns() - start;
+        }
+
+        if (r.iterations) {
+            r.ns_per_op = (double)elapsed / r.iterations;
+            r.allocs_per_op = (double)(allocations - allocs_before) / r.iterations;
+        }
+    }
+
+    r.peak_rss_kb = peak_rss_kb();
+    if (expr) { lval_del(expr); }
+    deeprose_del(d);
+    return r;
+}
+
+// runs w in a forked child and reads back what it measured, so the peak rss
+// is only w's and not the highest of every workload run before it
+static result run_isolated(workload* w, char* dir, double min_seconds) {
+    result r = { 0, 0, 0, 0, 1 };
+    int fds[2];
+    if (pipe(fds) != 0) { return r; }
+
+    // anything still buffered would get printed again by the child
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return r;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        result child = run_workload(w, dir, min_seconds);
+        int ok = write(fds[1], &child, sizeof(child)) == (ssize_t)sizeof(child);
+        fflush(stdout);
+        _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    result child;
+    int got = read(fds[0], &child, sizeof(child)) == (ssize_t)sizeof(child);
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (got && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) { r = child; }
+    return r;
+}
+
+static void write_json(FILE* f, result* results, int* selected) {
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    int first = 1;
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if (!selected[i]) { continue; }
+        if (!first) { fprintf(f, ",\n"); }
+        first = 0;
+        fprintf(f,
+            "    { \"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.1f, "
+            "\"allocs_per_op\": %.1f, \"peak_rss_kb\": %ld, \"failed\": %s }",
+            workloads[i].name, results[i].iterations, results[i].ns_per_op,
+            results[i].allocs_per_op, results[i].peak_rss_kb,
+            results[i].failed ? "true" : "false");
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+static char* read_file(char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) { return NULL; }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(size + 1);
+    size = fread(buf, 1, size, f);
+    buf[size] = '\0';
+    fclose(f);
+    return buf;
+}
+
+// finds `"key": <number>` inside the baseline entry for name. returns -1 if missing
+static double baseline_value(char* json, char* name, char* key) {
+    char needle[256];
+    snprintf(needle, sizeof(needle), "\"name\": \"%s\"", name);
+    char* entry = strstr(json, needle);
+    if (!entry) { return -1; }
+
+    // don't wander into the next entry
+    char* end = strchr(entry, '}');
+    snprintf(needle, sizeof(needle), "\"%s\":", key);
+    char* field = strstr(entry, needle);
+    if (!field || (end && field > end)) { return -1; }
+
+    return strtod(field + strlen(needle), NULL);
+}
+
+// returns the number of regressions found
+static int compare_baseline(char* path, result* results, int* selected, double tolerance) {
+    char* json = read_file(path);
+    if (!json) {
+        printf("could not read baseline %s\n", path);
+        return 1;
+    }
+
+    int regressions = 0;
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if (!selected[i] || results[i].failed) { continue; }
+
+        double ns = baseline_value(json, workloads[i].name, "ns_per_op");
+        double allocs = baseline_value(json, workloads[i].name, "allocs_per_op");
+        if (ns < 0) {
+            printf("%-18s no baseline entry\n", workloads[i].name);
+            continue;
+        }
+
+        double ns_change = (results[i].ns_per_op - ns) / ns * 100.0;
+        printf("%-18s %+7.1f%% time", workloads[i].name, ns_change);
+        if (allocs > 0) {
+            printf("  %+7.1f%% allocs", (results[i].allocs_per_op - allocs) / allocs * 100.0);
+        }
+
+        // allocation counts are deterministic so any increase is a regression
+        if (ns_change > tolerance || (allocs >= 0 && results[i].allocs_per_op > allocs + 0.5)) {
+            printf("  REGRESSION");
+            regressions++;
+        }
+        putchar('\n');
+    }
+
+    free(json);
+    return regressions;
+}
+
+static void usage(char* prog) {
+    printf("usage: %s [-o out.json] [-b baseline.json] [-t seconds] [-r tolerance%%] [-d benchdir] [workload...]\n", prog);
+}
+
+int main(int argc, char** argv) {
+    char* out_path = "bench_output.json";
+    char* baseline_path = NULL;
+    char* dir = "bench";
+    double min_seconds = 0.5;
+    double tolerance = 10.0;
+    int selected[WORKLOAD_COUNT];
+    int any_selected = 0;
+
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) { selected[i] = 0; }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) { out_path = argv[++i]; }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) { baseline_path = argv[++i]; }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) { min_seconds = atof(argv[++i]); }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) { tolerance = atof(argv[++i]); }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) { dir = argv[++i]; }
+        else if (argv[i][0] == '-') { usage(argv[0]); return EXIT_FAILURE; }
+        else {
+            int found = 0;
+            for (size_t j = 0; j < WORKLOAD_COUNT; j++) {
+                if (strcmp(argv[i], workloads[j].name) == 0) { selected[j] = found = 1; }
+            }
+            if (!found) { printf("unknown workload %s\n", argv[i]); return EXIT_FAILURE; }
+            any_selected = 1;
+        }
+    }
+
+    if (!any_selected) {
+        for (size_t i = 0; i < WORKLOAD_COUNT; i++) { selected[i] = 1; }
+    }
+
+    result results[WORKLOAD_COUNT];
+    int failures = 0;
+    printf("%-18s %10s %14s %14s %12s\n", "workload", "iters", "ns/op", "allocs/op", "peak rss kb");
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if (!selected[i]) { continue; }
+        results[i] = run_isolated(&workloads[i], dir, min_seconds);
+        if (results[i].failed) {
+            printf("%-18s FAILED\n", workloads[i].name);
+            failures++;
+            continue;
+        }
+        printf("%-18s %10lu %14.1f %14.1f %12ld\n", workloads[i].name, results[i].iterations,
+            results[i].ns_per_op, results[i].allocs_per_op, results[i].peak_rss_kb);
+    }
+
+    FILE* out = fopen(out_path, "w");
+    if (out) {
+        write_json(out, results, selected);
+        fclose(out);
+    } else {
+        printf("could not write %s\n", out_path);
+    }
+
+    int regressions = 0;
+    if (baseline_path) {
+        putchar('\n');
+        regressions = compare_baseline(baseline_path, results, selected, tolerance);
+    }
+
+    return (failures || regressions) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,6 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/wait.h>
 #include "builtin.h"
+#include "deeprose.h"
+#include "lseq.h"
+#include "fold.h"
+#include "lbig.h"
 
 // create lisp function, add it to the environment e, and free up the lisp values
 void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
@@ -11,54 +20,141 @@ void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
     lval_del(v);
 }
 
-// all the functions we are adding by default
-void lenv_add_builtins(lenv* e) {
+// every builtin, with its signature
+static const lsig builtins[] = {
     // list functions 
-    lenv_add_builtin(e, "list", builtin_list);
-    lenv_add_builtin(e, "first", builtin_first);
-    lenv_add_builtin(e, "rest", builtin_rest);
-    lenv_add_builtin(e, "eval", builtin_eval);
-    lenv_add_builtin(e, "join", builtin_join);
-    lenv_add_builtin(e, "load", builtin_load);
-    lenv_add_builtin(e, "count", builtin_count);
+    { "list", builtin_list, LSIG_ANY, .flags = LSIG_PURE },
+    { "first", builtin_first, LSIG_ANY, .flags = LSIG_TAKES_SEQ | LSIG_INLINABLE },
+    { "rest", builtin_rest, LSIG_ANY, .flags = LSIG_PURE },
+    { "head", builtin_head, 1, { LT_QEXPR }, .flags = LSIG_PURE },
+    { "reverse", builtin_reverse, 1, { LT_QEXPR }, .flags = LSIG_PURE },
+    { "eval", builtin_eval, LSIG_ANY },
+    { "join", builtin_join, LSIG_ANY, .all = LT_QEXPR, .flags = LSIG_PURE },
+    { "load", builtin_load, 1, { LT_STR } },
+    { "count", builtin_count, LSIG_ANY, .flags = LSIG_TAKES_SEQ | LSIG_PURE },
+
+    // lazy sequences
+    { "range", builtin_range, 2, { LT_NUM, LT_NUM } },
+    { "map", builtin_map, 2, { LT_FUN, LT_COLL }, .flags = LSIG_TAKES_SEQ },
+    { "filter", builtin_filter, 2, { LT_FUN, LT_COLL }, .flags = LSIG_TAKES_SEQ },
+    { "take", builtin_take, 2, { LT_NUM, LT_COLL }, .flags = LSIG_TAKES_SEQ },
+    { "drop", builtin_drop, 2, { LT_NUM, LT_COLL }, .flags = LSIG_TAKES_SEQ },
+    { "foldl", builtin_foldl, 3, { LT_FUN, 0, LT_COLL }, .flags = LSIG_TAKES_SEQ },
+    { "collect", builtin_collect, 1, { LT_COLL }, .flags = LSIG_TAKES_SEQ },
+    { "sort", builtin_sort, LSIG_ANY },
+    { "stable-sort", builtin_stable_sort, LSIG_ANY },
+    { "sort-by", builtin_sort_by, 2, { LT_FUN, LT_QEXPR } },
+    { "generator", builtin_generator, 1, { LT_FUN } },
+    { "yield", builtin_yield, 1 },
+
+    // isolates
+    { "spawn", builtin_spawn, LSIG_ANY, .flags = LSIG_TAKES_SEQ },
+    { "chan", builtin_chan, 1, { LT_NUM } },
+    { "send", builtin_send, 2, { LT_CHAN, 0 }, .flags = LSIG_TAKES_SEQ },
+    { "recv", builtin_recv, 1, { LT_CHAN } },
+    { "select", builtin_select, LSIG_ANY, .all = LT_CHAN },
+
+    // child processes
+    { "spawn-process", builtin_spawn_process, LSIG_ANY, .all = LT_STR },
+    { "process-wait", builtin_process_wait, LSIG_ANY },
+    { "process-output", builtin_process_output, LSIG_ANY },
+    { "process-select", builtin_process_select, LSIG_ANY },
 
     // math functions 
-    lenv_add_builtin(e, "+", builtin_add);
-    lenv_add_builtin(e, "-", builtin_sub);
-    lenv_add_builtin(e, "*", builtin_mul);
-    lenv_add_builtin(e, "/", builtin_div);
-    lenv_add_builtin(e, "^", builtin_pow);
-    lenv_add_builtin(e, "\%", builtin_mod);
+    { "+", builtin_add, LSIG_ANY, .flags = LSIG_PURE },
+    { "-", builtin_sub, LSIG_ANY, .flags = LSIG_PURE },
+    { "*", builtin_mul, LSIG_ANY, .flags = LSIG_PURE },
+    { "/", builtin_div, LSIG_ANY, .flags = LSIG_PURE },
+    { "^", builtin_pow, LSIG_ANY, .flags = LSIG_PURE },
+    { "%", builtin_mod, LSIG_ANY, .flags = LSIG_PURE },
 
     // ordering / conditionals
-    lenv_add_builtin(e, "<", builtin_lt);
-    lenv_add_builtin(e, ">", builtin_gt);
-    lenv_add_builtin(e, "=", builtin_eq);
-    lenv_add_builtin(e, "and", builtin_and);
-    lenv_add_builtin(e, "or", builtin_or);
-    lenv_add_builtin(e, "not", builtin_not);
-    lenv_add_builtin(e, "if", builtin_if);
-    
+    { "<", builtin_lt, 2, { LT_NUM | LT_BIG, LT_NUM | LT_BIG }, .flags = LSIG_PURE },
+    { ">", builtin_gt, 2, { LT_NUM | LT_BIG, LT_NUM | LT_BIG }, .flags = LSIG_PURE },
+    { "=", builtin_eq, 2, .flags = LSIG_PURE },
+    { "and", builtin_and, 2, { LT_NUM, LT_NUM }, .flags = LSIG_PURE },
+    { "or", builtin_or, 2, { LT_NUM, LT_NUM }, .flags = LSIG_PURE },
+    { "not", builtin_not, 1, { LT_NUM }, .flags = LSIG_PURE },
+    { "if", builtin_if, 3, { LT_NUM, LT_QEXPR, LT_QEXPR } },
+
     // defining things
-    lenv_add_builtin(e, "def", builtin_def);
-    lenv_add_builtin(e, "let", builtin_let);
-    lenv_add_builtin(e, "\\", builtin_lambda);
+    { "def", builtin_def, LSIG_ANY, .flags = LSIG_TAKES_SEQ },
+    { "let", builtin_let, LSIG_ANY, .flags = LSIG_TAKES_SEQ },
+    { "\\", builtin_lambda, 2, { LT_QEXPR, LT_QEXPR } },
+    { "partial", builtin_partial, LSIG_ANY },
+    { "defmacro", builtin_defmacro, 3, { LT_QEXPR, LT_QEXPR, LT_QEXPR } },
+    { "sexpr", builtin_sexpr, 1, { LT_QEXPR } },
 
     // side effects
-    lenv_add_builtin(e, "print", builtin_print);
-    lenv_add_builtin(e, "exit", builtin_exit);
-    lenv_add_builtin(e, "error", builtin_error);
-    lenv_add_builtin(e, "do", builtin_do);
-    lenv_add_builtin(e, "input-num", builtin_input_num);
-    lenv_add_builtin(e, "random-number", builtin_random_number);
+    { "print", builtin_print, 1, { LT_STR } },
+    { "exit", builtin_exit, 1, { LT_NUM } },
+    { "error", builtin_error, 1, { LT_STR } },
+    { "do", builtin_do, LSIG_ANY, .all = LT_QEXPR },
+    { "input-num", builtin_input_num, 1, { LT_STR } },
+    { "random-number", builtin_random_number, 1, { LT_NUM } },
+
+    // timing
+    { "now-ns", builtin_now_ns, 0, .flags = LSIG_NULLARY },
+    { "time", builtin_time, 1, { LT_QEXPR } },
+    { "bench", builtin_bench, 2, { LT_QEXPR, LT_NUM } },
+    { "with-limits", builtin_with_limits, 2, { LT_QEXPR, LT_QEXPR } },
 
     // other 
-    lenv_add_builtin(e, "atoi", builtin_atoi);
-    lenv_add_builtin(e, "itoa", builtin_itoa);
-    lenv_add_builtin(e, "strtoascii", builtin_strtoascii);
-    lenv_add_builtin(e, "asciitostr", builtin_asciitostr);
-    lenv_add_builtin(e, "concat-str", builtin_concat_str);
-    lenv_add_builtin(e, "run", builtin_run);
+    { "atoi", builtin_atoi, 1, { LT_STR }, .flags = LSIG_PURE },
+    { "itoa", builtin_itoa, 1, { LT_NUM | LT_BIG }, .flags = LSIG_PURE },
+    { "strtoascii", builtin_strtoascii, 1, { LT_STR }, .flags = LSIG_PURE },
+    { "asciitostr", builtin_asciitostr, 1, { LT_NUM }, .flags = LSIG_PURE },
+    { "concat-str", builtin_concat_str, LSIG_ANY, .all = LT_STR, .flags = LSIG_PURE },
+    { "run", builtin_run, 1, { LT_STR } },
+
+    // files
+    { "read-file", builtin_read_file, 1, { LT_STR } },
+    { "lines", builtin_lines, 1, { LT_STR } },
+    { "read-csv", builtin_read_csv, LSIG_ANY },
+    { "read-i64", builtin_read_i64, 1, { LT_STR } },
+    { "write-file", builtin_write_file, 2, { LT_STR, LT_STR | LT_COLL }, .flags = LSIG_TAKES_SEQ },
+    { "append-file", builtin_append_file, 2, { LT_STR, LT_STR | LT_COLL }, .flags = LSIG_TAKES_SEQ },
+};
+
+// all the functions we are adding by default
+void lenv_add_builtins(lenv* e) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        lval* k = lval_sym(builtins[i].name);
+        lval* v = lval_fun(builtins[i].func);
+        v->sig = &builtins[i];
+        lenv_put(e, k, v);
+        lval_del(k);
+        lval_del(v);
+    }
+}
+
+// the error a call with the arguments a should fail with, going by the
+// signature s, or NULL if they're fine. doesn't touch a
+lval* builtin_check(const lsig* s, lval* a) {
+    if (s->args != LSIG_ANY && a->count != s->args) {
+        return lval_error(LERR_ARGS, "Function '%s' passed incorrect number of args | got %d, expected %d",
+            s->name, a->count, s->args);
+    }
+
+    for (int i = 0; i < a->count; i++) {
+        int mask = s->args == LSIG_ANY ? s->all : s->types[i];
+        if (!mask || (mask & LTYPE(a->cell[i]->type))) { continue; }
+
+        // "X", "X or Y", "X, Y or Z"... a bignum is just a number to anyone
+        // calling, so that goes without saying
+        if (mask & LT_NUM) { mask &= ~LT_BIG; }
+        char expected[128] = "";
+        int left = __builtin_popcount(mask);
+        for (int t = 0; left; t++) {
+            if (!(mask & LTYPE(t))) { continue; }
+            left--;
+            strcat(expected, ltype_name(t));
+            if (left) { strcat(expected, left == 1 ? " or " : ", "); }
+        }
+        return lval_error(LERR_TYPE, "Function '%s' passed incorrect type | got %s, expected %s",
+            s->name, ltype_name(a->cell[i]->type), expected);
+    }
+    return NULL;
 }
 
 // interface for lenv_add_builtin
@@ -86,71 +182,135 @@ lval* builtin_mod(lenv* e, lval* a) {
     return builtin_operator(e, a, "\%");
 }
 
-int lval_eq(lval* x, lval* y) {
+// whether x and y are equal, leaving what's inside them on w to compare
+// next. lists go on a worklist instead of recursing, so nesting can't
+// overflow the c stack
+static int lval_eq_one(lval* x, lval* y, lwork* w) {
     if (x->type != y->type) return 0;
 
     switch (x->type){
         case LVAL_NUM:  return (x->num == y->num);  
         // comparing strings 
-        case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
+        case LVAL_ERR: return (strcmp(lval_err_msg(x), lval_err_msg(y)) == 0);
         case LVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
         case LVAL_STR: return (strcmp(x->str, y->str) == 0);
+        case LVAL_SEQ: return x->seq == y->seq;
+        case LVAL_BIG: return lbig_cmp(x, y) == 0;
+        case LVAL_CHAN: return x->chan == y->chan;
+        case LVAL_PROC: return x->proc == y->proc;
 
         // functions are kinda funky to compare but whatever
         case LVAL_FUN:
             if (x->builtin || y->builtin) {
                 return x->builtin == y->builtin;
-            } else {
-                return lval_eq(x->formals, y->formals) && lval_eq(x->body, y->body);
             }
+            if (x->part || y->part) {
+                if (!x->part || !y->part) { return 0; }
+                lwork_push(w, x->part->fn); lwork_push(w, y->part->fn);
+                lwork_push(w, x->part->args); lwork_push(w, y->part->args);
+                return 1;
+            }
+            lwork_push(w, x->formals); lwork_push(w, y->formals);
+            lwork_push(w, x->body); lwork_push(w, y->body);
+            return 1;
         
         case LVAL_QEXPR:
         case LVAL_SEXPR:
             if (x->count != y->count) return 0;
             for (int i = 0; i < x->count; i++) {
-                if (!lval_eq(x->cell[i], y->cell[i])) return 0;
+                lwork_push(w, x->cell[i]); lwork_push(w, y->cell[i]);
             }
-
-            // otherwise 
             return 1;
-        
-        break;
     }
     // if our switch statement isn't exshaustive
     return 0;
 }
 
+int lval_eq(lval* x, lval* y) {
+    lwork w;
+    lwork_init(&w);
+    int eq = lval_eq_one(x, y, &w);
+    while (eq && w.count) {
+        y = w.items[--w.count];
+        x = w.items[--w.count];
+        eq = lval_eq_one(x, y, &w);
+    }
+    lwork_free(&w);
+    return eq;
+}
+
+// which of x and y goes first, like lval_eq: numbers by value, strings and
+// symbols like strcmp, lists by length and then by what's in them. values of
+// different types go by type, and anything else of the same type is equal.
+// sort calls this from several threads, so it must only ever read
+static int lval_cmp_one(lval* x, lval* y, lwork* w) {
+    int xt = x->type == LVAL_BIG ? LVAL_NUM : x->type;
+    int yt = y->type == LVAL_BIG ? LVAL_NUM : y->type;
+    if (xt != yt) return xt < yt ? -1 : 1;
+
+    switch (xt) {
+        case LVAL_NUM: return lbig_cmp(x, y);
+        case LVAL_SYM: return strcmp(x->sym, y->sym);
+        case LVAL_STR: return strcmp(x->str, y->str);
+
+        case LVAL_QEXPR:
+        case LVAL_SEXPR:
+            if (x->count != y->count) return x->count < y->count ? -1 : 1;
+            // backwards, so the first pair comes off first
+            for (int i = x->count - 1; i >= 0; i--) {
+                lwork_push(w, x->cell[i]); lwork_push(w, y->cell[i]);
+            }
+            return 0;
+    }
+    return 0;
+}
+
+int lval_cmp(lval* x, lval* y) {
+    if (x->type == LVAL_NUM && y->type == LVAL_NUM) {
+        return (x->num > y->num) - (x->num < y->num);
+    }
+    lwork w;
+    lwork_init(&w);
+    int c = lval_cmp_one(x, y, &w);
+    while (!c && w.count) {
+        y = w.items[--w.count];
+        x = w.items[--w.count];
+        c = lval_cmp_one(x, y, &w);
+    }
+    lwork_free(&w);
+    return c;
+}
+
 lval* builtin_eq(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("=", a, 2);
     int r = lval_eq(a->cell[0], a->cell[1]);
     lval_del(a);
     return lval_num(r);
 }
 
 lval* builtin_ord(lenv* e, lval* a, char* op) {
-    LASSERT_ARGS_NUM(op, a, 2);
-    LASSERT_ARGS_TYPE(op, a, 0, LVAL_NUM);
-    LASSERT_ARGS_TYPE(op, a, 1, LVAL_NUM);
+    if (strcmp(op, "=") == 0) {
+        int r = lval_eq(a->cell[0], a->cell[1]);
+        lval_del(a);
+        return lval_num(r);
+    }
 
+    int c = lbig_cmp(a->cell[0], a->cell[1]);
     int r;
 
     if (strcmp(op, ">") == 0) {
-        r = (a->cell[0]->num > a->cell[1]->num);
+        r = c > 0;
     }
 
     if (strcmp(op, "<") == 0) {
-        r = (a->cell[0]->num < a->cell[1]->num);
+        r = c < 0;
     }
 
     if (strcmp(op, ">=") == 0) {
-        r = (a->cell[0]->num >= a->cell[1]->num);
+        r = c >= 0;
     }
 
     if (strcmp(op, "<=") == 0) {
-        r = (a->cell[0]->num <= a->cell[1]->num);
-    }
-    if (strcmp(op, "=") == 0) {
-        r =  lval_eq(a->cell[0], a->cell[1]);
+        r = c <= 0;
     }
 
     lval_del(a);
@@ -174,10 +334,6 @@ lval* builtin_le(lenv* e, lval* a) {
 }
 
 lval* builtin_and(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("and", a, 2);
-    LASSERT_ARGS_TYPE("and", a, 0, LVAL_NUM);
-    LASSERT_ARGS_TYPE("and", a, 1, LVAL_NUM);
-
     lval* x = lval_pop(a, 0);
     lval* y = lval_pop(a, 0);
 
@@ -188,10 +344,6 @@ lval* builtin_and(lenv* e, lval* a) {
 }
 
 lval* builtin_or(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("or", a, 2);
-    LASSERT_ARGS_TYPE("or", a, 0, LVAL_NUM);
-    LASSERT_ARGS_TYPE("or", a, 1, LVAL_NUM);
-
     lval* x = lval_pop(a, 0);
     lval* y = lval_pop(a, 0);
 
@@ -202,9 +354,6 @@ lval* builtin_or(lenv* e, lval* a) {
 }
 
 lval* builtin_not(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("not", a, 1);
-    LASSERT_ARGS_TYPE("or", a, 0, LVAL_NUM);
-
     lval* x = lval_pop(a, 0);
 
     int result = !(x->num);
@@ -214,32 +363,49 @@ lval* builtin_not(lenv* e, lval* a) {
 }
 
 lval* builtin_if(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("if", a, 3);
-    LASSERT_ARGS_TYPE("if", a, 0, LVAL_NUM);
-    LASSERT_ARGS_TYPE("if", a, 1, LVAL_QEXPR);
-    LASSERT_ARGS_TYPE("if", a, 2, LVAL_QEXPR);
-
-    lval* x;
-    // evaluate the two expressions
-    a->cell[1]->type = LVAL_SEXPR;
-    a->cell[2]->type = LVAL_SEXPR;
+    // evaluate the branch we're taking
+    lval* x = lval_pop(a, a->cell[0]->num ? 1 : 2);
+    lval_del(a);
+    return lval_eval_qexpr(e, x);
+}
 
-    if (a->cell[0]->num) {
-        x = lval_eval(e, lval_pop(a, 1));
-    } else {
-        x = lval_eval(e, lval_pop(a, 2));
+// x op y on longs, if the answer fits in one. 0 for lbig.c to work it out
+// instead, dividing by zero included
+static inline int fixnum_op(char op, long x, long y, long* r) {
+    switch (op) {
+        case '+': return !__builtin_add_overflow(x, y, r);
+        case '-': return !__builtin_sub_overflow(x, y, r);
+        case '*': return !__builtin_mul_overflow(x, y, r);
+        case '/':
+            if (y == 0 || (x == LONG_MIN && y == -1)) { return 0; }
+            *r = x / y;
+            return 1;
+        case '%':
+            if (y == 0) { return 0; }
+            *r = y == -1 ? 0 : x % y;
+            return 1;
+        case '^': {
+            if (y < 0) { return 0; }
+            long n = 1;
+            while (y) {
+                if ((y & 1) && __builtin_mul_overflow(n, x, &n)) { return 0; }
+                y >>= 1;
+                if (y && __builtin_mul_overflow(x, x, &x)) { return 0; }
+            }
+            *r = n;
+            return 1;
+        }
     }
-
-    lval_del(a);
-    return x;
+    return 0;
 }
 
-// all the math functions
+// all the math functions. they work on longs until something overflows,
+// then carry on with bignums (see lbig.h)
 lval* builtin_operator(lenv* e, lval* v, char* op) {
     for (int i = 0; i < v->count; i++) {
-        if (v->cell[i]->type != LVAL_NUM) {
+        if (v->cell[i]->type != LVAL_NUM && v->cell[i]->type != LVAL_BIG) {
             lval_del(v);
-            return lval_err("Cannot operate on a non-number");
+            return lval_error(LERR_BAD_OP, "Cannot operate on a non-number");
         }
     }
 
@@ -247,28 +413,38 @@ lval* builtin_operator(lenv* e, lval* v, char* op) {
     lval* x = lval_pop(v, 0);
 
     //checks for negative numbers (ex: (- 5))
-    if ((strcmp(op, "-") == 0) && v->count == 0) {
-        x->num = -x->num;
+    if (op[0] == '-' && v->count == 0) {
+        if (x->type == LVAL_NUM && x->num != LONG_MIN) {
+            x->num = -x->num;
+        } else {
+            lval* n = lbig_neg(x);
+            lval_del(x);
+            x = n;
+        }
     }
 
     while (v->count > 0) {
         lval* y = lval_pop(v, 0);
 
-        if (strcmp(op, "+") == 0) { x->num += y->num; }
-        if (strcmp(op, "-") == 0) { x->num -= y->num; }
-        if (strcmp(op, "*") == 0) { x->num *= y->num; }
-        if (strcmp(op, "\%") == 0){ x->num %= y->num; }
-        if (strcmp(op, "^") == 0) { x->num = powl(x->num, y->num); }
-        if (strcmp(op, "/") == 0) { 
-            if (y->num == 0) {
-                lval_del(x); lval_del(y);
-                x = lval_err("can't divide by zero");
-                break;
-            } 
-            x->num /= y->num; 
+        long n;
+        if (x->type == LVAL_NUM && y->type == LVAL_NUM && fixnum_op(op[0], x->num, y->num, &n)) {
+            x->num = n;
+            lval_del(y);
+            continue;
         }
 
-        lval_del(y);
+        lval* r = NULL;
+        switch (op[0]) {
+            case '+': r = lbig_add(x, y); break;
+            case '-': r = lbig_sub(x, y); break;
+            case '*': r = lbig_mul(x, y); break;
+            case '/': r = lbig_div(x, y); break;
+            case '%': r = lbig_mod(x, y); break;
+            case '^': r = lbig_pow(x, y); break;
+        }
+        lval_del(x); lval_del(y);
+        x = r;
+        if (x->type == LVAL_ERR) { break; }
     }
 
     lval_del(v);
@@ -280,9 +456,19 @@ lval* builtin_first(lenv* e, lval* l) {
     // check for potential errors
     LASSERT(l, l->count == 1, 
         "Function 'first' passed too many arguments | Got %i, expected 1", l->count);
-    LASSERT(l, l->cell[0]->type == LVAL_QEXPR, 
+    LASSERT(l, l->cell[0]->type == LVAL_QEXPR || l->cell[0]->type == LVAL_SEQ,
         "Function 'first' passed wrong type | got %s, expected %s",
         ltype_name(l->cell[0]->type), ltype_name(LVAL_QEXPR));
+
+    // only run a sequence as far as its first element
+    if (l->cell[0]->type == LVAL_SEQ) {
+        lseq_iter* it = lseq_iter_new(l->cell[0]->seq);
+        lval* x = lseq_next(e, it);
+        lseq_iter_del(it);
+        lval_del(l);
+        return x ? x : lval_err("Function 'first' passed {}");
+    }
+
     LASSERT(l, l->cell[0]->count != 0, "Function 'first' passed {}");
 
     // take the first element
@@ -312,6 +498,26 @@ lval* builtin_rest(lenv* e, lval* l) {
     return v;
 }
 
+// '(x) for a list starting with x. unlike first, x isn't evaluated, so macros
+// can take code apart with it
+lval* builtin_head(lenv* e, lval* l) {
+    LASSERT(l, l->cell[0]->count != 0, "Function 'head' passed {}");
+    lval* v = lval_take(l, 0);
+    while (v->count > 1) { lval_del(lval_pop(v, v->count - 1)); }
+    return v;
+}
+
+// the list backwards, turned around where it is
+lval* builtin_reverse(lenv* e, lval* l) {
+    lval* v = lval_take(l, 0);
+    for (int i = 0, j = v->count - 1; i < j; i++, j--) {
+        lval* x = v->cell[i];
+        v->cell[i] = v->cell[j];
+        v->cell[j] = x;
+    }
+    return v;
+}
+
 // literally just switches the lval type to a qexpr
 lval* builtin_list(lenv* e, lval* l) {
     l->type = LVAL_QEXPR;
@@ -327,19 +533,11 @@ lval* builtin_eval(lenv* e, lval* l) {
         "Function 'eval' passed incorrect type | got %s, expected %s",
         ltype_name(l->cell[0]->type), ltype_name(LVAL_QEXPR));
 
-    lval* x = lval_take(l, 0);
-    x->type = LVAL_SEXPR;
-    return lval_eval(e, x);
+    return lval_eval_qexpr(e, lval_take(l, 0));
 }
 
 // joins two lists
 lval* builtin_join(lenv* e, lval* l) {
-    for (int i = 0; i < l->count; i++) {
-        LASSERT(l, l->cell[i]->type == LVAL_QEXPR, 
-            "Function 'join' passed incorrect type | got %s, expected %s",
-            ltype_name(l->cell[i]->type), ltype_name(LVAL_QEXPR));
-    }
-
     lval* x = lval_pop(l, 0);
 
     while (l->count) {
@@ -355,139 +553,202 @@ lval* builtin_count(lenv* e, lval* l) {
     LASSERT(l, l->count == 1, 
         "Function 'count' passed incorrect number of arguments | got %d, expected 1",
         l->count);
-    LASSERT(l, l->cell[0]->type == LVAL_QEXPR, 
-        "Function 'count' passed incorrect type | got %s, expected %s",
-        ltype_name(l->cell[0]->type), ltype_name(LVAL_QEXPR));
+    LASSERT_ARGS_COLL("count", l, 0);
 
-    return lval_num(l->cell[0]->count);
-}
+    if (l->cell[0]->type == LVAL_QEXPR) {
+        lval* n = lval_num(l->cell[0]->count);
+        lval_del(l);
+        return n;
+    }
 
-// used for binding values to symbols
-lval* builtin_var(lenv* e, lval* a, char* func) {
-    LASSERT_ARGS_TYPE(func, a, 0, LVAL_QEXPR);
+    lseq* s = l->cell[0]->seq;
+    long n = 0;
 
-    // the first symbol should contain the argument symbols
-    lval* syms = a->cell[0];
+    // ranges and plain lists know their length without running anything
+    if (s->kind == LSEQ_RANGE) {
+        n = s->end >= s->start ? s->end - s->start + 1 : 0;
+    } else if (s->kind == LSEQ_LIST) {
+        n = s->list->count;
+    } else {
+        lseq_iter* it = lseq_iter_new(s);
+        lval* x;
+        while ((x = lseq_next(e, it))) {
+            if (x->type == LVAL_ERR) {
+                lseq_iter_del(it);
+                lval_del(l);
+                return x;
+            }
+            lval_del(x);
+            n++;
+        }
+        lseq_iter_del(it);
+    }
+
+    lval_del(l);
+    return lval_num(n);
+}
+
+// binds each of syms to the values in a from its first'th on, globally for
+// def or in e for let. neither gets freed, the values are copied. returns the
+// error if they don't line up, otherwise NULL
+lval* builtin_bind(lenv* e, lval* syms, lval* a, int first, int local) {
+    char* func = local ? "let" : "def";
     for (int i = 0; i < syms->count; i++) {
-        LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
-            "Function '%s' cannot define non-symbol | Got %s, expected %s",
-            ltype_name(syms->cell[i]->type), ltype_name(LVAL_SYM));
+        if (syms->cell[i]->type != LVAL_SYM) {
+            return lval_err("Function '%s' cannot define non-symbol | Got %s, expected %s",
+                func, ltype_name(syms->cell[i]->type), ltype_name(LVAL_SYM));
+        }
     }
 
-    LASSERT(a, (syms->count == a->count - 1),
-        "Function '%s' passed too many arguments for symbols | got %i, expected %i",
-        func, syms->count, a->count - 1);
+    if (syms->count != a->count - first) {
+        return lval_err("Function '%s' passed too many arguments for symbols | got %i, expected %i",
+            func, syms->count, a->count - first);
+    }
 
     for (int i = 0; i < syms->count; i++) {
-        // if `def` define it globally. if `ler` define it locally
-        if (strcmp(func, "def") == 0) {
-            lenv_def(e, syms->cell[i], a->cell[i + 1]);
-        } 
-        if (strcmp(func, "let") == 0) {
-            lenv_put(e, syms->cell[i], a->cell[i + 1]);
+        // if `def` define it globally. if `let` define it locally
+        if (!local) {
+            lenv_def(e, syms->cell[i], a->cell[i + first]);
+        } else {
+            if (e->parent) {
+                lenv_note_local(e, syms->cell[i]);
+                lenv_interp(e)->rebound |= lenv_bit(syms->cell[i]->sym);
+            }
+            lenv_put(e, syms->cell[i], a->cell[i + first]);
         }
     }
+    return NULL;
+}
+
+// used for binding values to symbols, globally for def or in e for let.
+// the evaluator binds def and let itself when their symbols are written out
+// (see eval.c), this is for everything else
+lval* builtin_var(lenv* e, lval* a, int local) {
+    LASSERT_ARGS_TYPE(local ? "let" : "def", a, 0, LVAL_QEXPR);
 
+    // the first symbol should contain the argument symbols
+    lval* err = builtin_bind(e, a->cell[0], a, 1, local);
     lval_del(a);
-    return lval_sexpr();
+    return err ? err : lval_sexpr();
 }
 
 // bind a value / function to a symbol. 
 // takes 1+ symbols in a qexpr, and then a list for each symbol to bind
 // uses lenv_put (basically a bootleg hashmap) to mutate the environment
 lval* builtin_def(lenv* e, lval* a) {
-    return builtin_var(e, a, "def");
+    return builtin_var(e, a, 0);
 }
 
 // like builtin_def() but locally scoped
 lval* builtin_let(lenv* e, lval* a) {
-    return builtin_var(e, a, "let");
+    return builtin_var(e, a, 1);
 }
 
-// create a new annonymous function
-lval* builtin_lambda(lenv* e, lval* a) {
-    // check for any potential user errors
-    LASSERT_ARGS_NUM("\\", a, 2);
-    LASSERT_ARGS_TYPE("\\", a, 0, LVAL_QEXPR);
-    LASSERT_ARGS_TYPE("\\", a, 1, LVAL_QEXPR);
-    for (int i = 0; i < a->cell[0]->count; i++) {
-        LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM), 
-            "Cannot define non-symbol | Got %s, expected %s",
-            ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+// makes a lambda out of formals and body, which it takes
+lval* builtin_make_lambda(lenv* e, lval* formals, lval* body) {
+    for (int i = 0; i < formals->count; i++) {
+        if (formals->cell[i]->type != LVAL_SYM) {
+            lval* err = lval_err("Cannot define non-symbol | Got %s, expected %s",
+                ltype_name(formals->cell[i]->type), ltype_name(LVAL_SYM));
+            lval_del(formals);
+            lval_del(body);
+            return err;
+        }
     }
 
+    // calls bind the formals locally, so global lookups can't skip them
+    for (int i = 0; i < formals->count; i++) {
+        lenv_note_local(e, formals->cell[i]);
+    }
+    lval_add_caches(body);
+
+    lval* f = lval_lambda(formals, body);
+    lval_fold_lambda(f);
+    return f;
+}
+
+// create a new annonymous function. the evaluator makes them itself when
+// the formals and body are written out (see eval.c)
+lval* builtin_lambda(lenv* e, lval* a) {
     // popping out the first two args which we will give to lval_lambda
     lval* formals = lval_pop(a, 0);
     lval* body = lval_pop(a, 0);
     lval_del(a);
+    return builtin_make_lambda(e, formals, body);
+}
 
-    return lval_lambda(formals, body);
+// (partial f args...) is f with args given to it in advance. a lambda does
+// the same when it's called with too few arguments, but this works for any
+// function, builtins and ones taking & rest included
+lval* builtin_partial(lenv* e, lval* a) {
+    LASSERT(a, a->count >= 1,
+        "Function 'partial' passed incorrect number of args | got %d, expected at least 1",
+        a->count);
+    LASSERT_ARGS_TYPE("partial", a, 0, LVAL_FUN);
+
+    lval* f = lval_pop(a, 0);
+    return lval_partial(f, a);
 }
 
 lval* builtin_print(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("print", a, 1);
-    LASSERT_ARGS_TYPE("print", a, 0, LVAL_STR);
-
-    printf("%s\n", a->cell[0]->str);
+    FILE* out = lenv_interp(e)->out;
+    // one line at a time, even with isolates printing at once
+    flockfile(out);
+    fputs(a->cell[0]->str, out);
+    fputc('\n', out);
+    funlockfile(out);
 
     lval_del(a);
     return lval_sexpr();
 }
 
 lval* builtin_exit(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("exit", a, 1);
-    LASSERT_ARGS_TYPE("exit", a, 0, LVAL_NUM);
-
-    printf("\033[91mProgram ending...\033[0m\n");
+    // scripts shouldn't have this in their output
+    if (isatty(STDOUT_FILENO)) {
+        printf("\033[91mProgram ending...\033[0m\n");
+    }
     exit(a->cell[0]->num);
     return lval_sexpr();
 }
 
 lval* builtin_error(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("error", a, 1);
-    LASSERT_ARGS_TYPE("error", a, 0, LVAL_STR);
-
-    lval* err = lval_err(a->cell[0]->str);
+    lval* err = lval_error(LERR_USER, "%s", a->cell[0]->str);
 
     lval_del(a);
     return err;
 }
 
 lval* builtin_atoi(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("atoi", a, 1);
-    LASSERT_ARGS_TYPE("atoi", a, 0, LVAL_STR);
-
     lval* n = lval_pop(a, 0);
     lval_del(a);
 
     errno = 0;
     long x = strtol(n->str, NULL, 10);
-    return errno != ERANGE ? 
-        lval_num(x) : lval_err("not a number");
+    lval* r = errno != ERANGE ? lval_num(x) : lbig_read(n->str);
+    lval_del(n);
+    return r;
 }
 
 lval* builtin_itoa(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("itoa", a, 1);
-    LASSERT_ARGS_TYPE("itoa", a, 0, LVAL_NUM);
-
     lval* n = lval_pop(a, 0);
     lval_del(a);
 
-    // calculating how big the str needs to be
-    // number of digits (log10 rounded up) + 1 for 10x + 1 for null terminating char 
-    // * sizeof char
-    size_t size = (int)(((ceil(log10(n->num))) + 1) + 1) * sizeof(char);
-
-    char* str = malloc(size);
-    snprintf(str, size, "%lu", n->num);
-    lval* new = lval_str(str);
-    free(str); free(n);
+    lval* new;
+    if (n->type == LVAL_BIG) {
+        char* str = lbig_str(n->big);
+        new = lval_str(str);
+        free(str);
+    } else {
+        // sign, 19 digits and the null terminating char
+        char str[21];
+        snprintf(str, sizeof(str), "%ld", n->num);
+        new = lval_str(str);
+    }
+    lval_del(n);
     return new;
 }
 
 lval* builtin_strtoascii(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("strtoascii", a, 1);
-    LASSERT_ARGS_TYPE("strtoascii", a, 0, LVAL_STR);
     LASSERT(a, (strlen(a->cell[0]->str) == 1), 
         "'strtoascii' function string takes one char in string");
 
@@ -498,10 +759,6 @@ lval* builtin_strtoascii(lenv* e, lval* a) {
 }
 
 lval* builtin_asciitostr(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("asciitostr", a, 1);
-    LASSERT_ARGS_TYPE("asciitostr", a, 0, LVAL_NUM);
-    
-
     lval* x = lval_pop(a, 0);
     char str[2] = {(char)x->num, '\0'};
     lval_del(x);lval_del(a);
@@ -509,13 +766,14 @@ lval* builtin_asciitostr(lenv* e, lval* a) {
 }
 
 lval* builtin_input_num(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("input-num", a, 1);
-    LASSERT_ARGS_TYPE("input-num", a, 0, LVAL_STR);
-
-    printf("%s\n", a->cell[0]->str);
+    FILE* out = lenv_interp(e)->out;
+    fprintf(out, "%s\n", a->cell[0]->str);
+    // the prompt might still be sitting in the batch mode buffer
+    fflush(out);
 
     long num;
     if (scanf("%li", &num) != 1) {
+        lval_del(a);
         return lval_err("invalid input: not a number");
     }
 
@@ -524,32 +782,26 @@ lval* builtin_input_num(lenv* e, lval* a) {
 }
 // takes one argument: the max
 lval* builtin_random_number(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("random-number", a, 1);
-    LASSERT_ARGS_TYPE("random-number", a, 0, LVAL_NUM);
+    LASSERT(a, a->cell[0]->num > 0,
+        "Function 'random-number' passed a max of %li | expected a positive number",
+        a->cell[0]->num);
 
-    srand(time(NULL));
-    long r = (long) rand() % a->cell[0]->num;
+    // every interpreter has its own generator, seeded when it was created
+    long r = (long)(deeprose_random(lenv_interp(e)) % (unsigned long)a->cell[0]->num);
     lval_del(a);
     return lval_num(r);
 }
 
 lval* builtin_do(lenv* e, lval* a) {
-    for (int i = 0; i < a->count; i++) {
-        LASSERT(a, (a->cell[i]->type == LVAL_QEXPR),
-            "Function 'do' passed incorrect type | got %s, expected %s",
-            ltype_name(a->cell[i]->type), ltype_name(LVAL_QEXPR));
-    }
-
     while (1) {
         lval* proc = lval_pop(a, 0);
         if (a->count != 0) {
-            proc->type = LVAL_SEXPR;
-            lval_eval(e, proc);
+            // these are only run for their side effects, so run any sequences too
+            lval_del(lval_realize(e, lval_eval_qexpr(e, proc)));
         } else {
             // return the final expression
-            proc->type = LVAL_SEXPR;
             lval_del(a);
-            return lval_eval(e, proc);
+            return lval_eval_qexpr(e, proc);
         }
     }
 
@@ -561,10 +813,6 @@ lval* builtin_concat_str(lenv* e, lval* a) {
     size_t stringsize = 0;
 
     for (int i = 0; i < a->count; i++) {
-        LASSERT(a, (a->cell[i]->type == LVAL_STR),
-            "Function 'concat-str' passed incorrect type | got %s, expected %s",
-            ltype_name(a->cell[i]->type), ltype_name(LVAL_STR));
-
         stringsize += strlen(a->cell[i]->str);
     }
 
@@ -578,11 +826,287 @@ lval* builtin_concat_str(lenv* e, lval* a) {
     return lval_str(newstring);
 }
 
+// runs a shell command, waiting for it, and gives back its exit status the
+// way process-wait does. see spawn-process for anything more than that
 lval* builtin_run(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("run", a, 1);
-    LASSERT_ARGS_TYPE("run", a, 0, LVAL_STR);
+    // the command writes straight to stdout, so what we've printed goes first
+    fflush(lenv_interp(e)->out);
+    int st = system(a->cell[0]->str);
+    lval_del(a);
+    if (st == -1) { return lval_err("Function 'run' couldn't start a shell | %s", strerror(errno)); }
+    return lval_num(WIFSIGNALED(st) ? 128 + WTERMSIG(st) : WEXITSTATUS(st));
+}
 
-    system(a->cell[0]->str);
-    free(a);
-    return lval_sexpr();
-}
\ No newline at end of file
+// the flags from f's signature (see builtin.h), for a builtin
+static int builtin_flags(lval* f) {
+    return f->type == LVAL_FUN && f->builtin && f->sig ? f->sig->flags : 0;
+}
+
+int builtin_nullary(lval* f) {
+    return builtin_flags(f) & LSIG_NULLARY;
+}
+
+int builtin_takes_seq(lval* f) {
+    return builtin_flags(f) & LSIG_TAKES_SEQ;
+}
+
+int builtin_pure(lval* f) {
+    return builtin_flags(f) & LSIG_PURE;
+}
+
+// `first` evaluates what it takes out of the list, so it isn't pure, but it's
+// fine as long as the wrapper's formals aren't in the list (fold.c checks that)
+int builtin_inlinable(lval* f) {
+    return builtin_flags(f) & (LSIG_PURE | LSIG_INLINABLE);
+}
+
+static long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// nanoseconds from a monotonic clock, only useful for differences
+lval* builtin_now_ns(lenv* e, lval* a) {
+    lval_del(a);
+    return lval_num(monotonic_ns());
+}
+
+// evaluates a quoted expression and returns '(result elapsed-ns allocations).
+// a lazy result is run to the end before the clock stops, or the work would
+// happen after it's been timed
+lval* builtin_time(lenv* e, lval* a) {
+    lval* x = lval_take(a, 0);
+
+    unsigned long allocs = lval_allocations;
+    long start = monotonic_ns();
+    lval* result = lval_realize(e, lval_eval_qexpr(e, x));
+    long elapsed = monotonic_ns() - start;
+    allocs = lval_allocations - allocs;
+
+    if (result->type == LVAL_ERR) { return result; }
+
+    lval* r = lval_qexpr();
+    lval_add(r, result);
+    lval_add(r, lval_num(elapsed));
+    lval_add(r, lval_num(allocs));
+    return r;
+}
+
+static int compare_long(const void* x, const void* y) {
+    long a = *(const long*)x;
+    long b = *(const long*)y;
+    return (a > b) - (a < b);
+}
+
+// every run's time is kept to sort, so there's a limit to how many there are
+#define BENCH_MAX_RUNS 10000000
+
+// evaluates a quoted expression n times after a warm-up and returns
+// '(min median p99) in nanoseconds. like time, lazy results are run out
+lval* builtin_bench(lenv* e, lval* a) {
+    LASSERT(a, a->cell[1]->num > 0 && a->cell[1]->num <= BENCH_MAX_RUNS,
+        "Function 'bench' passed %li iterations | expected a number from 1 to %d",
+        a->cell[1]->num, BENCH_MAX_RUNS);
+
+    lval* expr = a->cell[0];
+    long n = a->cell[1]->num;
+    long warmup = n / 10 > 0 ? n / 10 : 1;
+    long* times = malloc(sizeof(long) * n);
+    LASSERT(a, times != NULL,
+        "Function 'bench' couldn't allocate room for %li timings", n);
+
+    for (long i = 0; i < warmup + n; i++) {
+        lval* x = lval_copy(expr);
+        long start = monotonic_ns();
+        lval* result = lval_realize(e, lval_eval_qexpr(e, x));
+        long elapsed = monotonic_ns() - start;
+
+        if (result->type == LVAL_ERR) {
+            free(times); lval_del(a);
+            return result;
+        }
+        lval_del(result);
+
+        if (i >= warmup) { times[i - warmup] = elapsed; }
+    }
+
+    qsort(times, n, sizeof(long), compare_long);
+
+    // nearest rank percentile
+    long p99 = (99 * n + 99) / 100 - 1;
+
+    lval* r = lval_qexpr();
+    lval_add(r, lval_num(times[0]));
+    lval_add(r, lval_num(times[n / 2]));
+    lval_add(r, lval_num(times[p99]));
+
+    free(times); lval_del(a);
+    return r;
+}
+
+// (with-limits '(steps n alloc-bytes m ms t) 'expr) runs expr, and any lazy
+// sequence it gives back, stopping it with an error once it's gone past any
+// of the limits (see eval.h). any of them can be left out
+lval* builtin_with_limits(lenv* e, lval* a) {
+    lval* spec = a->cell[0];
+    LASSERT(a, spec->count % 2 == 0,
+        "Function 'with-limits' passed %d values as limits, expected pairs of a name and a number", spec->count);
+
+    llimits limits = { 0, 0, 0 };
+    for (int i = 0; i < spec->count; i += 2) {
+        lval* k = spec->cell[i];
+        lval* v = spec->cell[i + 1];
+        LASSERT(a, k->type == LVAL_SYM,
+            "Function 'with-limits' passed incorrect type for a limit's name | got %s, expected %s",
+            ltype_name(k->type), ltype_name(LVAL_SYM));
+        LASSERT(a, v->type == LVAL_NUM && v->num > 0,
+            "Function 'with-limits' passed a bad %s, expected a Number above 0", k->sym);
+
+        if (strcmp(k->sym, "steps") == 0) { limits.steps = v->num; }
+        else if (strcmp(k->sym, "alloc-bytes") == 0) { limits.alloc_bytes = v->num; }
+        else if (strcmp(k->sym, "ms") == 0) { limits.ms = v->num; }
+        else {
+            LASSERT(a, 0, "Function 'with-limits' passed an unknown limit %s, expected steps, alloc-bytes or ms", k->sym);
+        }
+    }
+
+    deeprose* d = lenv_interp(e);
+    lquota q;
+    lquota_begin(d, &q, limits);
+    lval* r = lval_realize(e, lval_eval_qexpr(e, lval_take(a, 1)));
+    lquota_end(d, &q);
+    return r;
+}
+
+// the sequence of the elements of a list or sequence. takes ownership of coll
+static lseq* seq_of(lval* coll) {
+    if (coll->type == LVAL_QEXPR) { return lseq_list(coll); }
+
+    lseq* s = lseq_retain(coll->seq);
+    lval_del(coll);
+    return s;
+}
+
+// (range start end) lazily counts from start to end inclusive
+lval* builtin_range(lenv* e, lval* a) {
+    lval* s = lval_seq(lseq_range(a->cell[0]->num, a->cell[1]->num));
+    lval_del(a);
+    return s;
+}
+
+// fn (which this takes) with the locals its body uses bound in its own env.
+// a stage only runs fn once something consumes the sequence, by which time
+// the call that made it (and with dynamic scope, the formals fn was counting
+// on) can be long gone. so whatever those symbols are right now goes along
+// with it, which is what they'd have been if fn had run straight away
+static lval* capture_locals(lenv* e, lval* fn) {
+    if (fn->part) {
+        lval* inner = capture_locals(e, lval_copy(fn->part->fn));
+        lval* args = lval_copy(fn->part->args);
+        lval_del(fn);
+        return lval_partial(inner, args);
+    }
+    deeprose* d = lenv_interp(e);
+    if (fn->builtin || !fn->body || !d) { return fn; }
+
+    lwork w;
+    lwork_init(&w);
+    lwork_push(&w, fn->body);
+    while (w.count) {
+        lval* v = w.items[--w.count];
+        for (int i = 0; i < v->count; i++) {
+            lval* c = v->cell[i];
+            if (c->type == LVAL_SEXPR || c->type == LVAL_QEXPR) {
+                lwork_push(&w, c);
+                continue;
+            }
+            if (c->type != LVAL_SYM || lenv_find(fn->env, c->sym, NULL)) { continue; }
+
+            int formal = 0;
+            for (int j = 0; j < fn->formals->count && !formal; j++) {
+                formal = strcmp(fn->formals->cell[j]->sym, c->sym) == 0;
+            }
+            lenv* where;
+            lval* x = formal ? NULL : lenv_find(e, c->sym, &where);
+            if (x && where != d->env) { lenv_put(fn->env, c, x); }
+        }
+    }
+    lwork_free(&w);
+    return fn;
+}
+
+// (map f coll) and (filter pred? coll)
+static lval* builtin_fn_stage(lenv* e, lval* a, char* name, int kind) {
+    lval* fn = capture_locals(e, lval_pop(a, 0));
+    lseq* inner = seq_of(lval_take(a, 0));
+    return lval_seq(lseq_stage(kind, inner, fn, 0));
+}
+
+lval* builtin_map(lenv* e, lval* a) {
+    return builtin_fn_stage(e, a, "map", LSEQ_MAP);
+}
+
+lval* builtin_filter(lenv* e, lval* a) {
+    return builtin_fn_stage(e, a, "filter", LSEQ_FILTER);
+}
+
+// (take n coll) and (drop n coll)
+static lval* builtin_count_stage(lval* a, char* name, int kind) {
+    long n = a->cell[0]->num;
+    lseq* inner = seq_of(lval_pop(a, 1));
+    lval_del(a);
+    return lval_seq(lseq_stage(kind, inner, NULL, n));
+}
+
+lval* builtin_take(lenv* e, lval* a) {
+    return builtin_count_stage(a, "take", LSEQ_TAKE);
+}
+
+lval* builtin_drop(lenv* e, lval* a) {
+    return builtin_count_stage(a, "drop", LSEQ_DROP);
+}
+
+// (foldl f accum coll), pulling one element at a time through coll's pipeline
+lval* builtin_foldl(lenv* e, lval* a) {
+    lval* fn = lval_pop(a, 0);
+    lval* accum = lval_pop(a, 0);
+    lseq* s = seq_of(lval_take(a, 0));
+    lseq_iter* it = lseq_iter_new(s);
+
+    lval* x;
+    while ((x = lseq_next(e, it))) {
+        if (x->type == LVAL_ERR) {
+            lval_del(accum);
+            accum = x;
+            break;
+        }
+
+        accum = lval_call(e, fn, lval_add(lval_add(lval_sexpr(), accum), x));
+        if (accum->type == LVAL_ERR) { break; }
+    }
+
+    lseq_iter_del(it);
+    lseq_release(s);
+    lval_del(fn);
+    return accum;
+}
+
+// (collect coll) runs a sequence into a list
+lval* builtin_collect(lenv* e, lval* a) {
+    return lval_realize(e, lval_take(a, 0));
+}
+
+// (generator f) is a lazy sequence of what f yields. f gets called with no
+// arguments, and runs until its next (yield x) each time another element is
+// wanted
+lval* builtin_generator(lenv* e, lval* a) {
+    return lval_seq(lseq_stage(LSEQ_GEN, NULL, capture_locals(e, lval_take(a, 0)), 0));
+}
+
+// yields are done by the evaluator (see eval.c), so this only gets called
+// when there's nothing to yield to
+lval* builtin_yield(lenv* e, lval* a) {
+    lval_del(a);
+    return lval_err("Function 'yield' can only be used inside a generator");
+}
@@ -13,7 +13,7 @@
 
 #define LASSERT_ARGS_NUM(fnname_str, lval_ptr, num) \
     if (lval_ptr->count != num) { \
-        lval* err = lval_err(   \
+        lval* err = lval_error(LERR_ARGS, \
             "Function '%s' passed incorrect number of args | got %d, expected %d", \
             fnname_str, lval_ptr->count, num \
             ); \
@@ -23,15 +23,74 @@
 
 #define LASSERT_ARGS_TYPE(fnname_str, lval_ptr, index, checktype) \
     if (lval_ptr->cell[index]->type != checktype) { \
-        lval* err = lval_err( \
+        lval* err = lval_error(LERR_TYPE, \
             "Function '%s' passed incorrect type | got %s, expected %s", \
             fnname_str, ltype_name(lval_ptr->cell[index]->type), ltype_name(checktype)); \
         lval_del(lval_ptr); \
         return err; \
     }
 
+// for builtins that take either a list or a lazy sequence
+#define LASSERT_ARGS_COLL(fnname_str, lval_ptr, index) \
+    if (lval_ptr->cell[index]->type != LVAL_QEXPR && lval_ptr->cell[index]->type != LVAL_SEQ) { \
+        lval* err = lval_error(LERR_TYPE, \
+            "Function '%s' passed incorrect type | got %s, expected %s or %s", \
+            fnname_str, ltype_name(lval_ptr->cell[index]->type), \
+            ltype_name(LVAL_QEXPR), ltype_name(LVAL_SEQ)); \
+        lval_del(lval_ptr); \
+        return err; \
+    }
+
+// a mask of types, for signatures
+#define LTYPE(t) (1 << (t))
+#define LT_NUM LTYPE(LVAL_NUM)
+#define LT_STR LTYPE(LVAL_STR)
+#define LT_QEXPR LTYPE(LVAL_QEXPR)
+#define LT_FUN LTYPE(LVAL_FUN)
+#define LT_BIG LTYPE(LVAL_BIG)
+#define LT_CHAN LTYPE(LVAL_CHAN)
+#define LT_PROC LTYPE(LVAL_PROC)
+#define LT_COLL (LTYPE(LVAL_QEXPR) | LTYPE(LVAL_SEQ))
+
+// a signature that takes any number of arguments
+#define LSIG_ANY -1
+#define LSIG_MAX_ARGS 3
+
+// what the evaluator and the folder need to know about a builtin
+enum {
+    // it gets called when it's on its own in an s-expression, like (now-ns)
+    LSIG_NULLARY = 1,
+    // it's given lazy sequences as they are. every other builtin gets them
+    // run into lists first
+    LSIG_TAKES_SEQ = 2,
+    // it only looks at its arguments, with no side effects, so a call on
+    // constants can be worked out when a lambda is made (see fold.h)
+    LSIG_PURE = 4,
+    // a wrapper can call it and still be inlined (see fold.c)
+    LSIG_INLINABLE = 8,
+};
+
+// a builtin's entry in the table lenv_add_builtins goes through. the
+// arguments of every call get checked against it before the builtin sees
+// them (see builtin_check), with the same errors as LASSERT_ARGS_NUM,
+// LASSERT_ARGS_TYPE and LASSERT_ARGS_COLL, so the builtin can count on them
+// being right. anything more than that (a positive number, a list of
+// symbols) is still up to the builtin
+struct lsig {
+    char* name;
+    lbuiltin func;
+    // how many arguments it takes, or LSIG_ANY for it to check itself
+    int args;
+    // the types each of those can be, as masks. 0 is anything
+    int types[LSIG_MAX_ARGS];
+    // for LSIG_ANY, the type every argument has to be. 0 is anything
+    int all;
+    int flags;
+};
+
 extern void lenv_add_builtin(lenv* e, char* name, lbuiltin func);
 extern void lenv_add_builtins(lenv* e);
+lval* builtin_check(const lsig* s, lval* a);
 
 lval* builtin(lenv* e, lval* a, char* func);
 lval* builtin_operator(lenv* e, lval* v, char* op);
@@ -51,6 +110,9 @@ lval* builtin_count(lenv* e, lval* l);
 lval* builtin_def(lenv* e, lval* a);
 lval* builtin_let(lenv* e, lval* a);
 lval* builtin_lambda(lenv* e, lval* a);
+lval* builtin_bind(lenv* e, lval* syms, lval* a, int first, int local);
+lval* builtin_make_lambda(lenv* e, lval* formals, lval* body);
+lval* builtin_partial(lenv* e, lval* a);
 lval* builtin_gt(lenv* e, lval* a);
 lval* builtin_ge(lenv* e, lval* a);
 lval* builtin_lt(lenv* e, lval* a);
@@ -77,4 +139,49 @@ lval* builtin_concat_str(lenv* e, lval* a);
 lval* builtin_input_num(lenv* e, lval* a);
 lval* builtin_random_number(lenv* e, lval* a);
 lval* builtin_run(lenv* e, lval* a);
+lval* builtin_read_file(lenv* e, lval* a);
+lval* builtin_lines(lenv* e, lval* a);
+lval* builtin_read_csv(lenv* e, lval* a);
+lval* builtin_read_i64(lenv* e, lval* a);
+lval* builtin_write_file(lenv* e, lval* a);
+lval* builtin_append_file(lenv* e, lval* a);
+lval* builtin_sort(lenv* e, lval* a);
+lval* builtin_stable_sort(lenv* e, lval* a);
+lval* builtin_sort_by(lenv* e, lval* a);
+lval* builtin_spawn(lenv* e, lval* a);
+lval* builtin_chan(lenv* e, lval* a);
+lval* builtin_send(lenv* e, lval* a);
+lval* builtin_recv(lenv* e, lval* a);
+lval* builtin_select(lenv* e, lval* a);
+lval* builtin_head(lenv* e, lval* a);
+lval* builtin_reverse(lenv* e, lval* a);
+lval* builtin_defmacro(lenv* e, lval* a);
+lval* builtin_sexpr(lenv* e, lval* a);
+lval* builtin_spawn_process(lenv* e, lval* a);
+lval* builtin_process_wait(lenv* e, lval* a);
+lval* builtin_process_output(lenv* e, lval* a);
+lval* builtin_process_select(lenv* e, lval* a);
+
+int lval_eq(lval* x, lval* y);
+// less than 0, 0 or more than 0, like strcmp. the order sort uses by default
+int lval_cmp(lval* x, lval* y);
+
+int builtin_nullary(lval* f);
+lval* builtin_now_ns(lenv* e, lval* a);
+lval* builtin_time(lenv* e, lval* a);
+lval* builtin_bench(lenv* e, lval* a);
+lval* builtin_with_limits(lenv* e, lval* a);
+
+int builtin_takes_seq(lval* f);
+int builtin_pure(lval* f);
+int builtin_inlinable(lval* f);
+lval* builtin_range(lenv* e, lval* a);
+lval* builtin_map(lenv* e, lval* a);
+lval* builtin_filter(lenv* e, lval* a);
+lval* builtin_take(lenv* e, lval* a);
+lval* builtin_drop(lenv* e, lval* a);
+lval* builtin_foldl(lenv* e, lval* a);
+lval* builtin_collect(lenv* e, lval* a);
+lval* builtin_generator(lenv* e, lval* a);
+lval* builtin_yield(lenv* e, lval* a);
 #endif
\ No newline at end of file
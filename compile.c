@@ -0,0 +1,922 @@
+/// `deeprose --compile`: translates a script, along with the prelude, into C
+/// that links against libdeeprose, so it runs without parsing anything.
+///
+/// every top-level form becomes a C function run in order by main, once its
+/// macros are expanded (see macro.h). a function defined at the top level
+/// (with defn, or def of a \) whose name is never bound anywhere else is
+/// "known": calls to it and to builtins that are never rebound are direct C
+/// calls rather than lookups. known functions are registered as builtins,
+/// and fall back to an interpreted copy of the lambda for anything compiled
+/// code doesn't handle (partial application, the wrong number of arguments).
+///
+/// known functions that only ever do arithmetic on their arguments are
+/// compiled a second time as C functions on plain longs, calling each other
+/// directly; their builtin is then just a wrapper that unboxes the arguments
+/// (or falls back if they aren't numbers, or something overflows a long).
+///
+/// all of it relies on knowing every binding the program can make, so a
+/// program that uses load, or defines things with names it computes, is
+/// compiled without any of it: every form is still built in without
+/// parsing, but run by the interpreter as is.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "compile.h"
+#include "deeprose.h"
+#include "parsing.h"
+#include "lbig.h"
+#include "macro.h"
+
+enum { FN_NONE, FN_GENERIC, FN_NUMERIC };
+
+// everything the program binds, and the builtins
+typedef struct {
+    char* name;
+    // definitions by a top-level form
+    int defs;
+    // bindings anywhere else: def or let inside something, or a formal
+    int rebound;
+    int builtin;
+    // from the single top-level definition, if it defines a function
+    int kind;
+    lval* formals;
+    lval* body;
+    // from the single top-level definition, if it's (def '(name) number)
+    int constant;
+    long value;
+    // which top-level form defines it
+    int form;
+    // what it's defined with (def or defn, and \ for def), which have to
+    // mean what they normally do
+    lval* head;
+    lval* lambda;
+} cname;
+
+typedef struct {
+    cname* names;
+    int count;
+    // something binds names we can't see, so nothing is known
+    int dynamic;
+} program;
+
+// the code for one C function being generated
+typedef struct {
+    program* p;
+    FILE* out;
+    int temps;
+    int indent;
+    // the env the code runs in, "e" or "le"
+    char* env;
+    // temporaries holding argument lists being built, freed if an argument errors
+    int open[256];
+    int nopen;
+    int used_out;
+    // the top-level form the code belongs to (for a function, the one
+    // defining it). constants defined after it can't be used yet
+    int form;
+} gen;
+
+static cname* name_find(program* p, char* name) {
+    for (int i = 0; i < p->count; i++) {
+        if (strcmp(p->names[i].name, name) == 0) { return &p->names[i]; }
+    }
+    return NULL;
+}
+
+static cname* name_get(program* p, char* name) {
+    cname* n = name_find(p, name);
+    if (n) { return n; }
+
+    p->names = realloc(p->names, sizeof(cname) * (p->count + 1));
+    n = &p->names[p->count++];
+    memset(n, 0, sizeof(cname));
+    n->name = name;
+    n->builtin = -1;
+    n->form = -1;
+    return n;
+}
+
+static int is_sym(lval* x, char* name) {
+    return x->type == LVAL_SYM && strcmp(x->sym, name) == 0;
+}
+
+// the names in a literal '(...) of symbols, or 0 if it isn't one
+static int sym_list(lval* x) {
+    if (x->type != LVAL_QEXPR) { return 0; }
+    for (int i = 0; i < x->count; i++) {
+        if (x->cell[i]->type != LVAL_SYM) { return 0; }
+    }
+    return 1;
+}
+
+static void rebind_all(program* p, lval* syms) {
+    for (int i = 0; i < syms->count; i++) {
+        if (strcmp(syms->cell[i]->sym, "&") != 0) { name_get(p, syms->cell[i]->sym)->rebound++; }
+    }
+}
+
+// finds every binding in x (any list, quoted or not, since quoted code gets
+// evaluated too). top is set for a top-level form, whose own definition is
+// counted separately. in_macro is set inside a defmacro, whose body builds
+// code with computed names on purpose: what it builds has been expanded
+// into the program already
+static void scan_bindings(program* p, lval* x, int top, int in_macro) {
+    if (x->type != LVAL_SEXPR && x->type != LVAL_QEXPR) { return; }
+
+    if (x->count >= 2 && x->cell[0]->type == LVAL_SYM) {
+        char* head = x->cell[0]->sym;
+        lval* arg = x->cell[1];
+        int is_def = strcmp(head, "def") == 0 || strcmp(head, "defn") == 0;
+
+        if (is_def || strcmp(head, "let") == 0 || strcmp(head, "\\") == 0) {
+            if (!sym_list(arg)) {
+                if (!in_macro) { p->dynamic = 1; }
+            } else if (!(top && is_def)) {
+                rebind_all(p, arg);
+            }
+        }
+        if (strcmp(head, "defn") == 0 && x->count >= 3) {
+            if (sym_list(x->cell[2])) { rebind_all(p, x->cell[2]); }
+            else if (!in_macro) { p->dynamic = 1; }
+        }
+        if (strcmp(head, "load") == 0) { p->dynamic = 1; }
+    }
+
+    for (int i = 0; i < x->count; i++) {
+        scan_bindings(p, x->cell[i], 0, in_macro);
+    }
+}
+
+// records what a top-level form defines
+static void scan_definition(program* p, lval* x, int form) {
+    if (x->type != LVAL_SEXPR || x->count < 2 || x->cell[0]->type != LVAL_SYM) { return; }
+    int defn = is_sym(x->cell[0], "defn");
+    if (!defn && !is_sym(x->cell[0], "def")) { return; }
+    if (!sym_list(x->cell[1])) { return; }
+
+    for (int i = 0; i < x->cell[1]->count; i++) {
+        cname* n = name_get(p, x->cell[1]->cell[i]->sym);
+        n->defs++;
+        n->form = form;
+        n->kind = FN_NONE;
+        n->constant = 0;
+    }
+    if (x->cell[1]->count != 1) { return; }
+    cname* n = name_get(p, x->cell[1]->cell[0]->sym);
+
+    // (defn '(name) '(formals) '(body)) or (def '(name) (\ '(formals) '(body)))
+    lval* formals = NULL;
+    lval* body = NULL;
+    if (defn && x->count == 4) {
+        formals = x->cell[2];
+        body = x->cell[3];
+    }
+    lval* v = x->count == 3 ? x->cell[2] : NULL;
+    if (!defn && v && v->type == LVAL_SEXPR && v->count == 3 && is_sym(v->cell[0], "\\")) {
+        formals = v->cell[1];
+        body = v->cell[2];
+    }
+    if (!defn && v && v->type == LVAL_NUM) {
+        n->constant = 1;
+        n->value = v->num;
+    }
+
+    n->head = x->cell[0];
+    n->lambda = formals && !defn ? v->cell[0] : NULL;
+    if (formals && body && sym_list(formals) && body->type == LVAL_QEXPR) {
+        for (int i = 0; i < formals->count; i++) {
+            if (is_sym(formals->cell[i], "&")) { return; }
+        }
+        n->kind = FN_GENERIC;
+        n->formals = formals;
+        n->body = body;
+    }
+}
+
+// a name whose meaning we know everywhere in the program
+static cname* known(program* p, lval* sym) {
+    if (p->dynamic || sym->type != LVAL_SYM) { return NULL; }
+    cname* n = name_find(p, sym->sym);
+    if (!n || n->rebound) { return NULL; }
+    if (n->builtin >= 0) { return n->defs ? NULL : n; }
+    return n->defs == 1 ? n : NULL;
+}
+
+static int formal_index(lval* formals, lval* sym) {
+    if (!formals || sym->type != LVAL_SYM) { return -1; }
+    for (int i = 0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, sym->sym) == 0) { return i; }
+    }
+    return -1;
+}
+
+static int is_numeric(program* p, lval* x, lval* formals, int form);
+
+// a q-expression evaluated as code, like a body or a branch of if
+static int is_numeric_form(program* p, lval* x, lval* formals, int form) {
+    if (x->count == 1) { return is_numeric(p, x->cell[0], formals, form); }
+    if (x->count < 2) { return 0; }
+
+    lval* call = lval_copy(x);
+    call->type = LVAL_SEXPR;
+    int ok = is_numeric(p, call, formals, form);
+    lval_del(call);
+    return ok;
+}
+
+// whether x only ever produces a number, computed from numbers (and the
+// formals, which are numbers in a numeric function), in code belonging to
+// the top-level form given
+static int is_numeric(program* p, lval* x, lval* formals, int form) {
+    if (x->type == LVAL_NUM) { return 1; }
+    if (x->type == LVAL_SYM) {
+        if (formal_index(formals, x) >= 0) { return 1; }
+        cname* n = known(p, x);
+        return n && n->constant && n->form < form;
+    }
+    if (x->type != LVAL_SEXPR) { return 0; }
+    if (x->count == 1) { return is_numeric(p, x->cell[0], formals, form); }
+    if (x->count < 2 || formal_index(formals, x->cell[0]) >= 0) { return 0; }
+
+    cname* n = known(p, x->cell[0]);
+    if (!n) { return 0; }
+    int argc = x->count - 1;
+
+    if (n->kind == FN_NUMERIC) {
+        if (argc != n->formals->count) { return 0; }
+    } else if (n->builtin >= 0 && strcmp(n->name, "if") == 0) {
+        return argc == 3 && is_numeric(p, x->cell[1], formals, form)
+            && x->cell[2]->type == LVAL_QEXPR && is_numeric_form(p, x->cell[2], formals, form)
+            && x->cell[3]->type == LVAL_QEXPR && is_numeric_form(p, x->cell[3], formals, form);
+    } else if (n->builtin >= 0 && strchr("+-*/%", n->name[0]) && !n->name[1]) {
+        if (argc < 1) { return 0; }
+    } else if (n->builtin >= 0 && (strcmp(n->name, "<") == 0 || strcmp(n->name, ">") == 0
+            || strcmp(n->name, "=") == 0 || strcmp(n->name, "and") == 0 || strcmp(n->name, "or") == 0)) {
+        if (argc != 2) { return 0; }
+    } else if (n->builtin >= 0 && strcmp(n->name, "not") == 0) {
+        if (argc != 1) { return 0; }
+    } else {
+        return 0;
+    }
+
+    for (int i = 1; i < x->count; i++) {
+        if (!is_numeric(p, x->cell[i], formals, form)) { return 0; }
+    }
+    return 1;
+}
+
+static int known_name(program* p, char* name) {
+    lval sym = { .type = LVAL_SYM, .sym = name };
+    return known(p, &sym) != NULL;
+}
+
+// which functions we know, and which of those are numeric. start by assuming
+// all of them are, then drop any that call something that isn't until
+// nothing changes
+static void find_functions(program* p) {
+    for (int i = 0; i < p->count; i++) {
+        cname* n = &p->names[i];
+        if (n->constant && !known(p, n->head)) { n->constant = 0; }
+        if (n->kind == FN_NONE) { continue; }
+        if (!known_name(p, n->name) || !known(p, n->head) || (n->lambda && !known(p, n->lambda))) {
+            n->kind = FN_NONE;
+            continue;
+        }
+        n->kind = FN_NUMERIC;
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < p->count; i++) {
+            cname* n = &p->names[i];
+            if (n->kind == FN_NUMERIC && !is_numeric_form(p, n->body, n->formals, n->form)) {
+                n->kind = FN_GENERIC;
+                changed = 1;
+            }
+        }
+    }
+}
+
+// c string literal
+static void emit_string(FILE* f, char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char ch = *s;
+        if (ch == '"' || ch == '\\') { fprintf(f, "\\%c", ch); }
+        else if (ch < 32 || ch >= 127) { fprintf(f, "\\%03o", ch); }
+        else { fputc(ch, f); }
+    }
+    fputc('"', f);
+}
+
+static void emit_long(FILE* f, long x) {
+    if (x == LONG_MIN) { fputs("(-9223372036854775807L - 1)", f); }
+    else { fprintf(f, "%ldL", x); }
+}
+
+// c expression building a copy of x
+static void emit_value(FILE* f, lval* x) {
+    switch (x->type) {
+        case LVAL_NUM: fputs("lval_num(", f); emit_long(f, x->num); fputc(')', f); break;
+        case LVAL_BIG: {
+            char* s = lbig_str(x->big);
+            fputs("lbig_read(", f); emit_string(f, s); fputc(')', f);
+            free(s);
+            break;
+        }
+        case LVAL_SYM: fputs("lval_sym(", f); emit_string(f, x->sym); fputc(')', f); break;
+        case LVAL_STR: fputs("lval_str(", f); emit_string(f, x->str); fputc(')', f); break;
+
+        case LVAL_SEXPR:
+        case LVAL_QEXPR: {
+            char* empty = x->type == LVAL_QEXPR ? "lval_qexpr()" : "lval_sexpr()";
+            if (!x->count) { fputs(empty, f); break; }
+            fprintf(f, "rt_list(%s, %d", empty, x->count);
+            for (int i = 0; i < x->count; i++) {
+                fputs(", ", f);
+                emit_value(f, x->cell[i]);
+            }
+            fputc(')', f);
+            break;
+        }
+    }
+}
+
+static void line(gen* g, char* fmt, ...) {
+    for (int i = 0; i < g->indent; i++) { fputs("    ", g->out); }
+    va_list va;
+    va_start(va, fmt);
+    vfprintf(g->out, fmt, va);
+    va_end(va);
+    fputc('\n', g->out);
+}
+
+static int temp(gen* g) {
+    return g->temps++;
+}
+
+// bail out of the function with t if it's an error
+static void check(gen* g, int t) {
+    line(g, "if (t%d->type == LVAL_ERR) {", t);
+    g->indent++;
+    for (int i = 0; i < g->nopen; i++) { line(g, "lval_del(t%d);", g->open[i]); }
+    line(g, "r = t%d;", t);
+    line(g, "goto out;");
+    g->indent--;
+    line(g, "}");
+    g->used_out = 1;
+}
+
+static void num_expr(gen* g, lval* x, lval* formals);
+
+static void num_form(gen* g, lval* x, lval* formals) {
+    if (x->count == 1) { num_expr(g, x->cell[0], formals); return; }
+    lval* call = lval_copy(x);
+    call->type = LVAL_SEXPR;
+    num_expr(g, call, formals);
+    lval_del(call);
+}
+
+// writes x as a c expression on longs. it's already been checked with is_numeric
+static void num_expr(gen* g, lval* x, lval* formals) {
+    FILE* f = g->out;
+    if (x->type == LVAL_NUM) { fputc('(', f); emit_long(f, x->num); fputc(')', f); return; }
+    if (x->type == LVAL_SYM) {
+        int i = formal_index(formals, x);
+        if (i >= 0) { fprintf(f, "a%d", i); }
+        else { fputc('(', f); emit_long(f, known(g->p, x)->value); fputc(')', f); }
+        return;
+    }
+    if (x->count == 1) { num_expr(g, x->cell[0], formals); return; }
+
+    cname* n = known(g->p, x->cell[0]);
+    int argc = x->count - 1;
+
+    if (n->kind == FN_NUMERIC) {
+        fprintf(f, "n_%d(", (int)(n - g->p->names));
+        for (int i = 1; i < x->count; i++) {
+            if (i > 1) { fputs(", ", f); }
+            num_expr(g, x->cell[i], formals);
+        }
+        fputc(')', f);
+        return;
+    }
+
+    char* op = n->name;
+    if (strcmp(op, "if") == 0) {
+        fputs("(", f);
+        num_expr(g, x->cell[1], formals);
+        fputs(" ? ", f);
+        num_form(g, x->cell[2], formals);
+        fputs(" : ", f);
+        num_form(g, x->cell[3], formals);
+        fputs(")", f);
+        return;
+    }
+    if (strcmp(op, "not") == 0) {
+        fputs("(long)!", f);
+        num_expr(g, x->cell[1], formals);
+        return;
+    }
+
+    char* infix = NULL;
+    if (strcmp(op, "<") == 0) { infix = "<"; }
+    if (strcmp(op, ">") == 0) { infix = ">"; }
+    if (strcmp(op, "=") == 0) { infix = "=="; }
+    if (strcmp(op, "and") == 0) { infix = "&&"; }
+    if (strcmp(op, "or") == 0) { infix = "||"; }
+    if (infix) {
+        fputs("(long)(", f);
+        num_expr(g, x->cell[1], formals);
+        fprintf(f, " %s ", infix);
+        num_expr(g, x->cell[2], formals);
+        fputs(")", f);
+        return;
+    }
+
+    char* fn = op[0] == '+' ? "rt_add" : op[0] == '-' ? "rt_sub" : op[0] == '*' ? "rt_mul"
+        : op[0] == '/' ? "rt_div" : "rt_mod";
+    if (argc == 1) {
+        // (- x) negates, the rest just give x back
+        if (op[0] == '-') { fputs("rt_neg(", f); }
+        else { fputs("(", f); }
+        num_expr(g, x->cell[1], formals);
+        fputs(")", f);
+        return;
+    }
+    // left to right, like builtin_operator
+    for (int i = 2; i < x->count; i++) { fprintf(f, "%s(", fn); }
+    num_expr(g, x->cell[1], formals);
+    for (int i = 2; i < x->count; i++) {
+        fputs(", ", f);
+        num_expr(g, x->cell[i], formals);
+        fputs(")", f);
+    }
+}
+
+static int gen_expr(gen* g, lval* x);
+
+// evaluates the list x (an s-expression, or a q-expression being run as
+// code) like lval_eval_sexpr does
+static int gen_call(gen* g, lval* x) {
+    int t = temp(g);
+    if (x->count == 0) {
+        line(g, "lval* t%d = lval_sexpr();", t);
+        return t;
+    }
+
+    // plain arithmetic runs on longs
+    if (x->count > 1 && is_numeric_form(g->p, x, NULL, g->form)) {
+        line(g, "rt_error = NULL;");
+        for (int i = 0; i < g->indent; i++) { fputs("    ", g->out); }
+        fprintf(g->out, "long n%d = ", t);
+        num_form(g, x, NULL);
+        fputs(";\n", g->out);
+        // too big for a long: the interpreter does it again, with bignums
+        lval* call = lval_copy(x);
+        call->type = LVAL_SEXPR;
+        for (int i = 0; i < g->indent; i++) { fputs("    ", g->out); }
+        fprintf(g->out, "lval* t%d = rt_error == rt_overflow ? lval_eval(%s, ", t, g->env);
+        emit_value(g->out, call);
+        fprintf(g->out, ")\n");
+        lval_del(call);
+        line(g, "    : rt_error ? lval_err(\"%%s\", rt_error) : lval_num(n%d);", t);
+        check(g, t);
+        return t;
+    }
+
+    if (x->count == 1) {
+        int v = gen_expr(g, x->cell[0]);
+        line(g, "lval* t%d = rt_single(%s, t%d);", t, g->env, v);
+        check(g, t);
+        return t;
+    }
+
+    // calls to functions that aren't defined yet fail in the function, like
+    // the lookup would have
+    cname* n = known(g->p, x->cell[0]);
+
+    if (n && n->builtin >= 0 && strcmp(n->name, "if") == 0 && x->count == 4
+            && x->cell[2]->type == LVAL_QEXPR && x->cell[3]->type == LVAL_QEXPR) {
+        int c = gen_expr(g, x->cell[1]);
+        line(g, "lval* t%d;", t);
+        // builtin_if has the error message for a condition that isn't a number
+        line(g, "if (t%d->type != LVAL_NUM) {", c);
+        g->indent++;
+        for (int i = 0; i < g->indent; i++) { fputs("    ", g->out); }
+        fprintf(g->out, "t%d = lval_call(%s, B[%d], rt_list(lval_sexpr(), 3, t%d, ", t, g->env, n->builtin, c);
+        emit_value(g->out, x->cell[2]);
+        fputs(", ", g->out);
+        emit_value(g->out, x->cell[3]);
+        fputs("));\n", g->out);
+        g->indent--;
+        for (int branch = 2; branch <= 3; branch++) {
+            line(g, branch == 2 ? "} else if (t%d->num) {" : "} else {", c);
+            g->indent++;
+            line(g, "lval_del(t%d);", c);
+            int b = gen_call(g, x->cell[branch]);
+            line(g, "t%d = t%d;", t, b);
+            g->indent--;
+        }
+        line(g, "}");
+        check(g, t);
+        return t;
+    }
+
+    // anything else that could be a special form (see builtin_special), or
+    // a call to something we don't know, is left to the interpreter
+    int direct = n && (n->builtin >= 0 || n->kind != FN_NONE);
+    if (!direct || (n->builtin >= 0 && (strcmp(n->name, "if") == 0
+            || strcmp(n->name, "and") == 0 || strcmp(n->name, "or") == 0))) {
+        for (int i = 0; i < g->indent; i++) { fputs("    ", g->out); }
+        fprintf(g->out, "lval* t%d = lval_eval_sexpr(%s, ", t, g->env);
+        emit_value(g->out, x);
+        fputs(");\n", g->out);
+        check(g, t);
+        return t;
+    }
+
+    // known function: evaluate the arguments and call it directly
+    int args = temp(g);
+    line(g, "lval* t%d = lval_sexpr();", args);
+    g->open[g->nopen++] = args;
+    for (int i = 1; i < x->count; i++) {
+        int a = gen_expr(g, x->cell[i]);
+        line(g, "lval_add(t%d, t%d);", args, a);
+    }
+    g->nopen--;
+
+    if (n->builtin >= 0) {
+        line(g, "lval* t%d = lval_call(%s, B[%d], t%d);", t, g->env, n->builtin, args);
+    } else {
+        line(g, "lval* t%d = rt_call(%s, c_%d, t%d);", t, g->env, (int)(n - g->p->names), args);
+    }
+    check(g, t);
+    return t;
+}
+
+// code evaluating x, returning the temporary holding the result
+static int gen_expr(gen* g, lval* x) {
+    if (x->type == LVAL_SEXPR) { return gen_call(g, x); }
+
+    int t = temp(g);
+    if (x->type == LVAL_SYM) {
+        for (int i = 0; i < g->indent; i++) { fputs("    ", g->out); }
+        fprintf(g->out, "lval* t%d = rt_get(%s, ", t, g->env);
+        emit_string(g->out, x->sym);
+        fputs(");\n", g->out);
+        check(g, t);
+        return t;
+    }
+
+    // anything else evaluates to itself
+    for (int i = 0; i < g->indent; i++) { fputs("    ", g->out); }
+    fprintf(g->out, "lval* t%d = ", t);
+    emit_value(g->out, x);
+    fputs(";\n", g->out);
+    return t;
+}
+
+// writes the body of a c function evaluating the list x in env, into f. if
+// name is given it's the function being compiled, for error traces
+static void gen_function_body(program* p, FILE* f, lval* x, char* env, int form, char* cleanup, char* name) {
+    char* code = NULL;
+    size_t size = 0;
+    gen g = { p, open_memstream(&code, &size), 0, 1, env };
+    g.form = form;
+
+    int t = gen_call(&g, x);
+    fclose(g.out);
+
+    fputs("    lval* r;\n", f);
+    fputs(code, f);
+    fprintf(f, "    r = t%d;\n", t);
+    if (g.used_out) { fputs("out:\n", f); }
+    if (cleanup) { fputs(cleanup, f); }
+    if (name) {
+        fputs("    return rt_trace(r, ", f);
+        emit_string(f, name);
+        fputs(");\n", f);
+    } else {
+        fputs("    return r;\n", f);
+    }
+    free(code);
+}
+
+static const char* prologue =
+    "#include <stdarg.h>\n"
+    "#include <limits.h>\n"
+    "#include \"deeprose.h\"\n"
+    "#include \"builtin.h\"\n"
+    "#include \"lseq.h\"\n"
+    "#include \"lbig.h\"\n"
+    "\n"
+    "// every program gets all of these, whether it calls them or not\n"
+    "#define RT_HELPER static __attribute__((unused))\n"
+    "\n"
+    "// numeric code sets this instead of returning an error. rt_overflow means\n"
+    "// something didn't fit in a long, and the interpreter (which has bignums)\n"
+    "// has to work it out instead\n"
+    "static const char* rt_error;\n"
+    "static const char rt_overflow[] = \"overflow\";\n"
+    "\n"
+    "RT_HELPER lval* rt_list(lval* v, int n, ...) {\n"
+    "    va_list va;\n"
+    "    va_start(va, n);\n"
+    "    for (int i = 0; i < n; i++) { lval_add(v, va_arg(va, lval*)); }\n"
+    "    va_end(va);\n"
+    "    return v;\n"
+    "}\n"
+    "\n"
+    "RT_HELPER long rt_overflowed(void) {\n"
+    "    if (!rt_error) { rt_error = rt_overflow; }\n"
+    "    return 0;\n"
+    "}\n"
+    "RT_HELPER long rt_add(long x, long y) { long r; return __builtin_add_overflow(x, y, &r) ? rt_overflowed() : r; }\n"
+    "RT_HELPER long rt_sub(long x, long y) { long r; return __builtin_sub_overflow(x, y, &r) ? rt_overflowed() : r; }\n"
+    "RT_HELPER long rt_mul(long x, long y) { long r; return __builtin_mul_overflow(x, y, &r) ? rt_overflowed() : r; }\n"
+    "RT_HELPER long rt_neg(long x) { return x == LONG_MIN ? rt_overflowed() : -x; }\n"
+    "RT_HELPER long rt_div(long x, long y) {\n"
+    "    if (y == 0) { if (!rt_error) { rt_error = \"can't divide by zero\"; } return 0; }\n"
+    "    return y == -1 ? rt_neg(x) : x / y;\n"
+    "}\n"
+    "RT_HELPER long rt_mod(long x, long y) {\n"
+    "    if (y == 0) { if (!rt_error) { rt_error = \"can't divide by zero\"; } return 0; }\n"
+    "    return y == -1 ? 0 : x % y;\n"
+    "}\n"
+    "\n"
+    "RT_HELPER lval* rt_get(lenv* e, char* sym) {\n"
+    "    lval* v = lenv_find(e, sym, NULL);\n"
+    "    return v ? lval_copy(v) : lval_err(\"Unbound symbol %s\", sym);\n"
+    "}\n"
+    "\n"
+    "RT_HELPER lval* rt_call(lenv* e, lbuiltin fn, lval* a) {\n"
+    "    lval f = { .type = LVAL_FUN, .builtin = fn };\n"
+    "    return lval_call(e, &f, a);\n"
+    "}\n"
+    "\n"
+    "// (x) is x, unless x is a builtin that takes no arguments\n"
+    "RT_HELPER lval* rt_single(lenv* e, lval* v) {\n"
+    "    if (v->type != LVAL_FUN || !v->builtin || !builtin_nullary(v)) { return v; }\n"
+    "    lval* r = lval_call(e, v, lval_sexpr());\n"
+    "    lval_del(v);\n"
+    "    return r;\n"
+    "}\n"
+    "\n"
+    "// an error coming back out of a call to name has it in its trace, like\n"
+    "// the interpreter's lambdas do\n"
+    "RT_HELPER lval* rt_trace(lval* r, char* name) {\n"
+    "    if (r->type == LVAL_ERR) { lval_err_trace(r, name); }\n"
+    "    return r;\n"
+    "}\n"
+    "\n"
+    "// calls the interpreted lambda instead\n"
+    "RT_HELPER lval* rt_fallback(lenv* e, lval* s, lval* a, char* name) {\n"
+    "    return rt_trace(lval_call(e, s, a), name);\n"
+    "}\n"
+    "\n"
+    "// the env a call runs in, with the arguments bound to the formals\n"
+    "RT_HELPER lenv* rt_frame(lenv* e, lval* a, char** formals) {\n"
+    "    lenv* le = lenv_new();\n"
+    "    lenv_set_parent(le, e);\n"
+    "    for (int i = 0; i < a->count; i++) {\n"
+    "        lval* sym = lval_sym(formals[i]);\n"
+    "        lenv_put(le, sym, a->cell[i]);\n"
+    "        lval_del(sym);\n"
+    "    }\n"
+    "    lval_del(a);\n"
+    "    return le;\n"
+    "}\n"
+    "\n"
+    "// runs a top-level form's result like --script does\n"
+    "RT_HELPER int rt_run(lenv* e, lval* r) {\n"
+    "    r = lval_realize(e, r);\n"
+    "    int failed = r->type == LVAL_ERR;\n"
+    "    if (failed) { lval_println(r); }\n"
+    "    lval_del(r);\n"
+    "    return failed;\n"
+    "}\n"
+    "\n";
+
+static void gen_functions(program* p, FILE* f) {
+    // prototypes first, they all call each other
+    for (int i = 0; i < p->count; i++) {
+        cname* n = &p->names[i];
+        if (n->kind == FN_NONE) { continue; }
+
+        fprintf(f, "// %s\n", n->name);
+        fprintf(f, "static lval* s_%d;\n", i);
+        fprintf(f, "static lval* c_%d(lenv* e, lval* a);\n", i);
+        if (n->kind == FN_NUMERIC) {
+            fprintf(f, "static long n_%d(", i);
+            for (int j = 0; j < n->formals->count; j++) { fprintf(f, "%slong a%d", j ? ", " : "", j); }
+            if (!n->formals->count) { fputs("void", f); }
+            fputs(");\n", f);
+        }
+    }
+    fputc('\n', f);
+
+    for (int i = 0; i < p->count; i++) {
+        cname* n = &p->names[i];
+        if (n->kind == FN_NONE) { continue; }
+        int argc = n->formals->count;
+
+        fprintf(f, "// %s\n", n->name);
+        fprintf(f, "static lval* c_%d(lenv* e, lval* a) {\n", i);
+        fputs("    // not defined yet\n", f);
+        fprintf(f, "    if (!s_%d) { lval_del(a); return lval_err(\"Unbound symbol %%s\", ", i);
+        emit_string(f, n->name);
+        fputs("); }\n", f);
+        fprintf(f, "    if (a->count != %d) { return rt_fallback(e, s_%d, a, ", argc, i);
+        emit_string(f, n->name);
+        fputs("); }\n", f);
+
+        if (n->kind == FN_NUMERIC) {
+            for (int j = 0; j < argc; j++) {
+                fprintf(f, "    if (a->cell[%d]->type != LVAL_NUM) { return rt_fallback(e, s_%d, a, ", j, i);
+                emit_string(f, n->name);
+                fputs("); }\n", f);
+            }
+            fputs("    rt_error = NULL;\n", f);
+            fprintf(f, "    long r = n_%d(", i);
+            for (int j = 0; j < argc; j++) { fprintf(f, "%sa->cell[%d]->num", j ? ", " : "", j); }
+            fputs(");\n", f);
+            fprintf(f, "    if (rt_error == rt_overflow) { return rt_fallback(e, s_%d, a, ", i);
+            emit_string(f, n->name);
+            fputs("); }\n", f);
+            fputs("    lval_del(a);\n", f);
+            fputs("    if (!rt_error) { return lval_num(r); }\n", f);
+            fputs("    return rt_trace(lval_err(\"%s\", rt_error), ", f);
+            emit_string(f, n->name);
+            fputs(");\n", f);
+            fputs("}\n\n", f);
+
+            fprintf(f, "static long n_%d(", i);
+            for (int j = 0; j < argc; j++) { fprintf(f, "%slong a%d", j ? ", " : "", j); }
+            if (!argc) { fputs("void", f); }
+            fputs(") {\n", f);
+            fputs("    if (rt_error) { return 0; }\n", f);
+            fprintf(f, "    if (!s_%d) { rt_error = \"Unbound symbol \" ", i);
+            emit_string(f, n->name);
+            fputs("; return 0; }\n", f);
+            fputs("    return ", f);
+            gen g = { p, f, 0, 1, "e" };
+            g.form = -1;
+            num_form(&g, n->body, n->formals);
+            fputs(";\n}\n\n", f);
+            continue;
+        }
+
+        fputs("    lenv* le = rt_frame(e, a, (char*[]){ ", f);
+        for (int j = 0; j < argc; j++) {
+            if (j) { fputs(", ", f); }
+            emit_string(f, n->formals->cell[j]->sym);
+        }
+        if (!argc) { fputs("NULL", f); }
+        fputs(" });\n", f);
+
+        lval* body = lval_copy(n->body);
+        body->type = LVAL_SEXPR;
+        gen_function_body(p, f, body, "le", n->form, "    lenv_del(le);\n", n->name);
+        lval_del(body);
+        fputs("}\n\n", f);
+    }
+}
+
+int compile_program(char* script, char* out_path) {
+    deeprose* d = deeprose_new();
+
+    char prelude[1024];
+    if (!getenv("DRLIBPATH")) {
+        puts("undefined env variable $DRLIBPATH");
+        deeprose_del(d);
+        return 0;
+    }
+    snprintf(prelude, sizeof(prelude), "%s/stdlib.deeprose", getenv("DRLIBPATH"));
+
+    // the prelude's forms then the script's, in the order they'd run
+    lval* forms = lval_sexpr();
+    char* files[] = { prelude, script };
+    for (int i = 0; i < 2; i++) {
+        lval* x = read_program(d, files[i], NULL);
+        if (x->type == LVAL_ERR) {
+            lval_println(x);
+            lval_del(x);
+            lval_del(forms);
+            deeprose_del(d);
+            return 0;
+        }
+        forms = lval_join(forms, x);
+    }
+
+    // macros are expanded now, as the interpreter would when it read each
+    // form, so what's compiled is the expansion. a defmacro is run here to
+    // define its macro, and again when the program starts, for code the
+    // program makes itself. anything that can't be expanded without running
+    // the program is left to be expanded when it runs
+    for (int i = 0; i < forms->count; i++) {
+        lval* x = forms->cell[i];
+        if (x->type == LVAL_SEXPR && x->count && is_sym(x->cell[0], "defmacro")) {
+            lval_del(lval_eval(d->env, lval_copy(x)));
+        }
+        lval* expanded = lval_expand(d->env, lval_copy(x));
+        if (expanded->type == LVAL_ERR) {
+            lval_del(expanded);
+        } else {
+            lval_del(x);
+            forms->cell[i] = expanded;
+        }
+    }
+
+    program p = { NULL, 0, 0 };
+    for (int i = 0; i < d->env->count; i++) {
+        name_get(&p, d->env->syms[i])->builtin = i;
+    }
+    for (int i = 0; i < forms->count; i++) {
+        scan_definition(&p, forms->cell[i], i);
+    }
+    for (int i = 0; i < forms->count; i++) {
+        lval* x = forms->cell[i];
+        int in_macro = x->type == LVAL_SEXPR && x->count && is_sym(x->cell[0], "defmacro");
+        scan_bindings(&p, x, 1, in_macro);
+    }
+    find_functions(&p);
+
+    FILE* f = fopen(out_path, "w");
+    if (!f) {
+        perror(out_path);
+        free(p.names);
+        lval_del(forms);
+        deeprose_del(d);
+        return 0;
+    }
+
+    fprintf(f, "// generated by deeprose --compile from %s\n", script);
+    fputs("// gcc --std=c99 this.c -I<deeprose> <deeprose>/libdeeprose.a -lm -lpthread\n", f);
+    fputs(prologue, f);
+
+    fprintf(f, "// the builtins, straight from the env before anything can rebind them\n");
+    fprintf(f, "static lval* B[%d];\n\n", d->env->count);
+    gen_functions(&p, f);
+
+    for (int i = 0; i < forms->count; i++) {
+        lval* x = forms->cell[i];
+        fprintf(f, "static lval* form_%d(lenv* e) {\n", i);
+
+        cname* n = NULL;
+        if (x->type == LVAL_SEXPR && x->count >= 2 && sym_list(x->cell[1]) && x->cell[1]->count == 1) {
+            n = name_find(&p, x->cell[1]->cell[0]->sym);
+            if (n && (n->kind == FN_NONE || n->form != i || !known(&p, x->cell[1]->cell[0]))) { n = NULL; }
+        }
+
+        if (n) {
+            // a known function: keep the lambda to fall back on, and define the compiled one
+            int idx = (int)(n - p.names);
+            fprintf(f, "    s_%d = builtin_lambda(e, rt_list(lval_sexpr(), 2, ", idx);
+            emit_value(f, n->formals);
+            fputs(", ", f);
+            emit_value(f, n->body);
+            fputs("));\n", f);
+            fprintf(f, "    deeprose_register(e->interp, ");
+            emit_string(f, n->name);
+            fprintf(f, ", c_%d);\n", idx);
+            fputs("    return lval_sexpr();\n", f);
+        } else if (x->type == LVAL_SEXPR) {
+            gen_function_body(&p, f, x, "e", i, NULL, NULL);
+        } else {
+            // a lone atom at the top level
+            fputs("    return lval_eval(e, ", f);
+            emit_value(f, x);
+            fputs(");\n", f);
+        }
+        fputs("}\n\n", f);
+    }
+
+    fputs("int main(void) {\n", f);
+    fputs("    // full buffering, like deeprose's batch mode\n", f);
+    fputs("    setvbuf(stdout, NULL, _IOFBF, 1 << 16);\n", f);
+    fputs("    deeprose* d = deeprose_new();\n", f);
+    fputs("    lenv* e = d->env;\n", f);
+    for (int i = 0; i < d->env->count; i++) {
+        fprintf(f, "    B[%d] = lenv_find(e, ", i);
+        emit_string(f, d->env->syms[i]);
+        fputs(", NULL);\n", f);
+    }
+    fputs("\n    int failed = 0;\n", f);
+    for (int i = 0; i < forms->count; i++) {
+        fprintf(f, "    failed += rt_run(e, form_%d(e));\n", i);
+    }
+    fputs("\n    deeprose_del(d);\n", f);
+    fputs("    return failed ? 1 : 0;\n", f);
+    fputs("}\n", f);
+    fclose(f);
+
+    free(p.names);
+    lval_del(forms);
+    deeprose_del(d);
+    return 1;
+}
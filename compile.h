@@ -0,0 +1,8 @@
+#ifndef COMPILE_HEADER
+#define COMPILE_HEADER
+
+// writes a c program to out_path that runs the prelude then script, see
+// compile.c. returns 0 (having printed why) if it couldn't
+int compile_program(char* script, char* out_path);
+
+#endif
@@ -0,0 +1,120 @@
+/// the embedding api, see deeprose.h
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "deeprose.h"
+#include "builtin.h"
+#include "parsing.h"
+#include "lseq.h"
+#include "eval.h"
+#include "macro.h"
+
+deeprose* deeprose_new(void) {
+    deeprose* d = malloc(sizeof(deeprose));
+    parser_init(d);
+    d->out = stdout;
+    d->userdata = NULL;
+    d->version = 0;
+    d->locals = lenv_new();
+    d->rebound = 0;
+    d->macros = lenv_new();
+    d->jit = getenv("DEEPROSE_NO_JIT") == NULL;
+    char* limit = getenv("DEEPROSE_STACK_LIMIT");
+    d->stack_limit = limit ? strtoul(limit, NULL, 10) : EVAL_STACK_LIMIT;
+    char* steps = getenv("DEEPROSE_MAX_STEPS");
+    char* bytes = getenv("DEEPROSE_MAX_ALLOC");
+    char* ms = getenv("DEEPROSE_TIMEOUT_MS");
+    d->limits.steps = steps ? strtoul(steps, NULL, 10) : 0;
+    d->limits.alloc_bytes = bytes ? strtoul(bytes, NULL, 10) : 0;
+    d->limits.ms = ms ? strtol(ms, NULL, 10) : 0;
+    d->quota = NULL;
+
+    // seed from the clock, mixed with the handle so interpreters started in
+    // the same nanosecond still differ. xorshift can't have a zero state
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    d->random_state = (ts.tv_sec * 1000000000UL + ts.tv_nsec) ^ (unsigned long)d;
+    if (d->random_state == 0) { d->random_state = 1; }
+
+    d->env = lenv_new();
+    d->env->interp = d;
+    lenv_add_builtins(d->env);
+    return d;
+}
+
+void deeprose_del(deeprose* d) {
+    lenv_del(d->env);
+    lenv_del(d->locals);
+    lenv_del(d->macros);
+    parser_cleanup(d);
+    free(d);
+}
+
+// evaluates each expression in a parsed program, stopping at the first error
+static lval* eval_program(deeprose* d, lval* expr) {
+    if (expr->type == LVAL_ERR) { return expr; }
+
+    lquota q;
+    lquota_begin(d, &q, d->limits);
+    lval* result = lval_sexpr();
+    while (expr->count) {
+        lval_del(result);
+        // c can't do anything with a lazy sequence, so run them
+        result = lval_realize(d->env, lval_eval(d->env, lval_expand(d->env, lval_pop(expr, 0))));
+        if (result->type == LVAL_ERR) { break; }
+    }
+    lquota_end(d, &q);
+
+    lval_del(expr);
+    return result;
+}
+
+lval* deeprose_eval_string(deeprose* d, char* input) {
+    return eval_program(d, read_program(d, "<string>", input));
+}
+
+lval* deeprose_eval_file(deeprose* d, char* path) {
+    return eval_program(d, read_program(d, path, NULL));
+}
+
+void deeprose_set_limits(deeprose* d, unsigned long steps, unsigned long alloc_bytes, long ms) {
+    d->limits.steps = steps;
+    d->limits.alloc_bytes = alloc_bytes;
+    d->limits.ms = ms;
+}
+
+void deeprose_register(deeprose* d, char* name, lbuiltin func) {
+    lenv_add_builtin(d->env, name, func);
+}
+
+int deeprose_to_long(lval* v, long* out) {
+    if (v->type != LVAL_NUM) { return 0; }
+    *out = v->num;
+    return 1;
+}
+
+char* deeprose_to_string(lval* v) {
+    if (v->type == LVAL_STR) {
+        char* str = malloc(strlen(v->str) + 1);
+        strcpy(str, v->str);
+        return str;
+    }
+
+    char* buf = NULL;
+    size_t size = 0;
+    FILE* f = open_memstream(&buf, &size);
+    lval_fprint(f, v);
+    fclose(f);
+    return buf;
+}
+
+// xorshift64
+unsigned long deeprose_random(deeprose* d) {
+    unsigned long x = d->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    d->random_state = x;
+    return x;
+}
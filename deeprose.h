@@ -0,0 +1,90 @@
+#ifndef DEEPROSE_HEADER
+#define DEEPROSE_HEADER
+// the embedding api. an interpreter is a deeprose handle; it has no shared
+// state with any other, so separate handles can be used from separate threads
+// (a single handle must only be used by one thread at a time)
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lval.h"
+#include "lenv.h"
+#include "eval.h"
+
+#define DEEPROSE_GRAMMAR_RULES 8
+
+struct deeprose {
+    // global environment
+    lenv* env;
+    // number, symbol, sexpr, qexpr, string, comment, expr and the whole program,
+    // which is the one we parse with
+    mpc_parser_t* grammar[DEEPROSE_GRAMMAR_RULES];
+    // where print, and errors from load, go. isolates spawned from here print
+    // to it too, and can keep running after the call that spawned them, so
+    // it has to stay open as long as they might
+    FILE* out;
+    // state for random-number
+    unsigned long random_state;
+    // for the embedder to hang their own state off, we never touch it
+    void* userdata;
+
+    // bumped whenever a call site cache could have gone stale (see lenv.h)
+    unsigned long version;
+    // every name that's been a lambda's formal or let-bound in a function
+    lenv* locals;
+    // the lenv_bit of every name let has bound in a function's env. an env
+    // under that one worked out its names before, so those bits are never
+    // trusted to skip a lookup to the globals
+    unsigned long rebound;
+    // every name defmacro has defined, so expanding code only looks up the
+    // heads of lists that could be macro calls (see macro.h)
+    lenv* macros;
+    // compile hot lambdas to machine code (see jit.h). on unless
+    // DEEPROSE_NO_JIT is set
+    int jit;
+    // how many bytes of evaluation frames deeprose code can use before it's
+    // stopped with a stack overflow (see eval.h). EVAL_STACK_LIMIT unless
+    // DEEPROSE_STACK_LIMIT is set
+    size_t stack_limit;
+    // what every deeprose_eval_* call (and each program the command line
+    // runs) is limited to, see eval.h. none unless DEEPROSE_MAX_STEPS,
+    // DEEPROSE_MAX_ALLOC or DEEPROSE_TIMEOUT_MS are set
+    llimits limits;
+    // the counts for whatever's running under limits, NULL if nothing is
+    lquota* quota;
+};
+
+// a new interpreter with the builtins defined but no prelude loaded
+deeprose* deeprose_new(void);
+void deeprose_del(deeprose* d);
+
+// evaluate every expression in input / the file at path in order. returns the
+// value of the last one, or the first error (and stops there). the caller
+// owns the result and frees it with lval_del
+lval* deeprose_eval_string(deeprose* d, char* input);
+lval* deeprose_eval_file(deeprose* d, char* path);
+
+// limit each deeprose_eval_* call to so many evaluation steps, bytes
+// allocated and milliseconds, 0 meaning no limit on that. a call going over
+// stops with an error, everything it was in the middle of freed
+void deeprose_set_limits(deeprose* d, unsigned long steps, unsigned long alloc_bytes, long ms);
+
+// define a native builtin. it gets the calling environment and an s-expression
+// of its arguments, which it owns, and returns a new lval
+void deeprose_register(deeprose* d, char* name, lbuiltin func);
+
+// converting values back to c. to_long returns 0 if v isn't a number, or is
+// a bignum that doesn't fit; to_string gives a malloc'd string: a string's
+// contents, or how v prints
+int deeprose_to_long(lval* v, long* out);
+char* deeprose_to_string(lval* v);
+
+// the next number from the interpreter's own random number generator
+unsigned long deeprose_random(deeprose* d);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,946 @@
+/// the evaluator, see eval.h
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "eval.h"
+#include "lenv.h"
+#include "builtin.h"
+#include "deeprose.h"
+#include "lseq.h"
+#include "fold.h"
+#include "macro.h"
+#include "jit.h"
+
+// what a frame is waiting on
+enum { F_LIST, F_IF, F_LOGIC, F_DO, F_CALL, F_VAR };
+
+typedef struct {
+    unsigned char kind;
+    // F_LOGIC: the result that settles it early, 0 for and and 1 for or.
+    // F_VAR: 1 for let, 0 for def
+    unsigned char stop;
+    // F_CALL: whether the lambda v belongs to the frame
+    unsigned char owned;
+    // whether code belongs to the frame. most of the time it doesn't, it's a
+    // lambda body (or part of one) that something further down holds on to
+    unsigned char owns;
+    // F_LIST and F_VAR: the child of code being evaluated. F_IF: 1 while the condition
+    // is, then the branch. F_LOGIC: the operand being evaluated. F_DO: the
+    // next q-expression to run
+    int i;
+    lenv* e;
+    // the code being worked through, which is only ever read: a call, if, and
+    // or or (with their arguments), or the q-expressions do has to run.
+    // F_CALL: the call the lambda came from, to name it in error traces
+    lval* code;
+    // F_LIST: the values of code's children so far, which end up being the
+    // call's arguments. F_VAR: the values def or let binds, so far. F_CALL:
+    // the lambda whose env the body is running in
+    lval* v;
+    // F_CALL: roughly how many bytes the lambda's env holds on to (see
+    // env_bytes), which count towards the limit along with the frame
+    size_t held;
+} frame;
+typedef struct {
+    frame* frames;
+    int top;
+    int capacity;
+    // in bytes, from the interpreter (see deeprose.h)
+    size_t limit;
+    // the frames' held bytes added up
+    size_t held;
+} estack;
+
+struct ecoro {
+    estack stack;
+    lval* f;
+    int started;
+    int done;
+    // set when a run stops at a yield rather than finishing
+    int yielded;
+};
+
+// a run of the evaluator, started from c. a yield can only leave the
+// innermost one, and only if it belongs to a coroutine
+typedef struct erun {
+    struct erun* outer;
+    ecoro* co;
+} erun;
+
+static __thread estack thread_stack;
+static __thread erun* running = NULL;
+static __thread int nesting = 0;
+
+// what to do with x next: evaluate it, run it as code (a q-expression's
+// contents are a call), evaluate it as a call (a non-empty list), carry on
+// with the top frame's list, hand it back to the top frame as a result, or
+// stop the run because it's been yielded
+enum { M_EVAL, M_CODE, M_LIST, M_NEXT, M_RET, M_YIELD };
+
+#define TOP(s) (&(s)->frames[(s)->top - 1])
+
+static frame* push(estack* s, int kind, lenv* e, lval* code, int owns) {
+    if ((size_t)(s->top + 1) * sizeof(frame) + s->held > s->limit) { return NULL; }
+    if (s->top == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 64;
+        s->frames = realloc(s->frames, sizeof(frame) * s->capacity);
+    }
+
+    frame* fr = &s->frames[s->top++];
+    fr->kind = kind;
+    fr->i = 0;
+    fr->stop = 0;
+    fr->owned = 0;
+    fr->owns = owns;
+    fr->e = e;
+    fr->code = code;
+    fr->v = NULL;
+    fr->held = 0;
+    return fr;
+}
+
+// frees whatever s's top frame holds
+static void frame_free(estack* s) {
+    frame* fr = TOP(s);
+    if (fr->v && (fr->kind != F_CALL || fr->owned)) { lval_del(fr->v); }
+    if (fr->owns) { lval_del(fr->code); }
+    s->held -= fr->held;
+}
+
+// roughly what a call's env keeps alive until the call returns: the env and
+// the lambda it belongs to, and each value bound in it, all the way down
+static size_t env_bytes(lenv* e) {
+    size_t n = sizeof(lenv) + sizeof(lval);
+    for (int i = 0; i < e->count; i++) {
+        n += sizeof(lval*) + sizeof(char*) + lval_size(e->vals[i]);
+    }
+    return n;
+}
+
+// an empty list with room for n values
+static lval* values(int n) {
+    lval* v = lval_sexpr();
+    lval_reserve(v, n);
+    return v;
+}
+
+// the name a call was made through, for error traces
+static char* call_name(lval* code) {
+    return code && code->cell[0]->type == LVAL_SYM ? code->cell[0]->sym : NULL;
+}
+
+static lval* overflow(estack* s) {
+    return lval_err("Stack overflow | evaluation went past the limit of %lu bytes", s->limit);
+}
+
+static long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void lquota_begin(deeprose* d, lquota* q, llimits limits) {
+    lquota* outer = d->quota;
+    q->active = outer || limits.steps || limits.alloc_bytes || limits.ms;
+    if (!q->active) { return; }
+
+    q->steps = limits.steps ? limits.steps : ULONG_MAX;
+    q->bytes_until = limits.alloc_bytes && limits.alloc_bytes < ULONG_MAX - lval_alloc_bytes
+        ? lval_alloc_bytes + limits.alloc_bytes : ULONG_MAX;
+    long now = monotonic_ns();
+    q->deadline = limits.ms && limits.ms < (LONG_MAX - now) / 1000000L ? now + limits.ms * 1000000L : LONG_MAX;
+    if (outer) {
+        if (outer->steps < q->steps) { q->steps = outer->steps; }
+        if (outer->bytes_until < q->bytes_until) { q->bytes_until = outer->bytes_until; }
+        if (outer->deadline < q->deadline) { q->deadline = outer->deadline; }
+    }
+
+    q->given_steps = q->steps;
+    q->given_bytes = q->bytes_until - lval_alloc_bytes;
+    q->given_ms = q->deadline == LONG_MAX ? 0 : (q->deadline - now) / 1000000L;
+    q->tick = 0;
+    q->exceeded = outer ? outer->exceeded : 0;
+    q->outer = outer;
+    d->quota = q;
+}
+
+void lquota_end(deeprose* d, lquota* q) {
+    if (!q->active) { return; }
+    d->quota = q->outer;
+    // the outer limits had at least as many steps, so this can't go under
+    if (q->outer) { q->outer->steps -= q->given_steps - q->steps; }
+}
+
+enum { LQUOTA_STEPS = 1, LQUOTA_BYTES, LQUOTA_TIME };
+
+static lval* lquota_step(lquota* q) {
+    if (!q->exceeded) {
+        if (!q->steps) {
+            q->exceeded = LQUOTA_STEPS;
+        } else if (lval_alloc_bytes > q->bytes_until) {
+            q->exceeded = LQUOTA_BYTES;
+        } else if (q->deadline != LONG_MAX && ++q->tick == LQUOTA_CLOCK_EVERY) {
+            q->tick = 0;
+            if (monotonic_ns() > q->deadline) { q->exceeded = LQUOTA_TIME; }
+        }
+        if (!q->exceeded) {
+            q->steps--;
+            return NULL;
+        }
+    }
+
+    switch (q->exceeded) {
+        case LQUOTA_STEPS:
+            return lval_err("Limit exceeded | took more than %lu evaluation steps", q->given_steps);
+        case LQUOTA_BYTES:
+            return lval_err("Limit exceeded | allocated more than %lu bytes", q->given_bytes);
+    }
+    return lval_err("Limit exceeded | ran for longer than %li ms", q->given_ms);
+}
+
+lval* lquota_check(lenv* e) {
+    deeprose* d = lenv_interp(e);
+    return d && d->quota ? lquota_step(d->quota) : NULL;
+}
+
+long lquota_deadline(lenv* e) {
+    deeprose* d = lenv_interp(e);
+    return d && d->quota ? d->quota->deadline : LONG_MAX;
+}
+
+lval* lquota_expire(lenv* e) {
+    lquota* q = lenv_interp(e)->quota;
+    if (!q->exceeded) { q->exceeded = LQUOTA_TIME; }
+    return lquota_step(q);
+}
+
+static lval* lookup(lenv* e, lval* sym) {
+    return sym->cache ? lenv_get_cached(e, sym) : lenv_get(e, sym);
+}
+
+// the same errors the builtins' LASSERTs give
+static lval* args_error(char* func, int got, int expected) {
+    return lval_error(LERR_ARGS, "Function '%s' passed incorrect number of args | got %d, expected %d",
+        func, got, expected);
+}
+
+static lval* type_error(char* func, int got, int expected) {
+    return lval_error(LERR_TYPE, "Function '%s' passed incorrect type | got %s, expected %s",
+        func, ltype_name(got), ltype_name(expected));
+}
+
+// gives up on the top frame (anything but a call), which is done with, and
+// returns x in its place. x is usually the error that stopped it
+static lval* drop(estack* s, lval* x) {
+    frame_free(s);
+    s->top--;
+    return x;
+}
+
+// builtins the evaluator does itself, since they evaluate code in place of
+// their call
+static int evaluates(lbuiltin func) {
+    return func == builtin_eval || func == builtin_if
+        || func == builtin_do || func == builtin_yield;
+}
+
+// most builtins only understand lists, so any lazy sequences get run into
+// lists first. then the arguments get checked against the builtin's
+// signature, if it has one, so the builtin itself doesn't have to
+static lval* call_builtin(lenv* e, lbuiltin func, const lsig* sig, lval* a) {
+    if (!sig || !(sig->flags & LSIG_TAKES_SEQ)) {
+        for (int i = 0; i < a->count; i++) {
+            if (a->cell[i]->type != LVAL_SEQ) { continue; }
+            a->cell[i] = lval_realize(e, a->cell[i]);
+            if (a->cell[i]->type == LVAL_ERR) { return lval_take(a, i); }
+        }
+    }
+    if (sig) {
+        lval* err = builtin_check(sig, a);
+        if (err) {
+            lval_del(a);
+            return err;
+        }
+    }
+    return func(e, a);
+}
+
+// how many arguments f has to be given before its body can run: its formals
+// up to any &
+static int required(lval* f) {
+    int n = 0;
+    while (n < f->formals->count && strcmp(f->formals->cell[n]->sym, "&") != 0) { n++; }
+    return n;
+}
+
+// binds a to f's formals, which it needs to have enough of. returns NULL if
+// the body should run, otherwise the error
+static lval* bind(lenv* e, lval* f, lval* a) {
+    int given = a->count;
+    int total = f->formals->count;
+
+    while (a->count) {
+        // if we ran out of formals to bind
+        if (f->formals->count == 0) {
+            lval_del(a);
+            return lval_error(LERR_ARGS, "Function passed too many arguments | got %d, expected %d",
+                given, total);
+        }
+
+        // pop out the next symbol and argument
+        lval* sym = lval_pop(f->formals, 0);
+
+        // incase the next arg is the & operator (rest)
+        if (strcmp(sym->sym, "&") == 0) {
+            // make sure & is followed by another symbol
+            if (f->formals->count != 1) {
+                lval_del(a);
+                return lval_err("Function format invalid | Symbol '&' not followed by a single symbol");
+            }
+
+            // next formal should be bound to remaining arguments
+            lval* nsym = lval_pop(f->formals, 0);
+            lenv_put_take(f->env, nsym, builtin_list(e, a));
+            lval_del(sym); lval_del(nsym);
+            // builtin_list makes a itself the list, which the env has now
+            a = NULL;
+            break;
+        }
+
+        // the argument is ours, so it's bound as it is rather than copied
+        lenv_put_take(f->env, sym, lval_pop(a, 0));
+        lval_del(sym);
+    }
+
+    if (a) { lval_del(a); }
+
+    // if & remains in formal list bind to empty list
+    if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") == 0) {
+        // check that & isnt passed invalid-ly
+        if (f->formals->count != 2) {
+            return lval_err("Function form invalid | Symbol & not followed by single symbol");
+        }
+
+        // pop and delete &
+        lval_del(lval_pop(f->formals, 0));
+
+        // pop the next symbol, creating an empty list to bind it to
+        lval* sym = lval_pop(f->formals, 0);
+        lenv_put_take(f->env, sym, lval_qexpr());
+        lval_del(sym);
+    }
+
+    return NULL;
+}
+
+// starts calling f with the arguments a, in e. either the call is done
+// straight away and *x is its result, or it's been set up for the run to
+// carry on with: *x and *e are what to evaluate next (owned if *own is set),
+// and the mode it returns says how. code is the call it came from, if there
+// was one. takes a, code if owns is set and f if owned is
+static int start_call(estack* s, lenv** e, lval** x, int* own, lval* f, int owned, lval* a,
+        lval* code, int owns) {
+    // a partial application is a call to the function underneath, with its
+    // arguments in front of a's. that function gets copied since calling a
+    // lambda binds its formals away
+    if (!f->builtin && f->part) {
+        lval* g = lval_copy(f->part->fn);
+        lval* args = values(f->part->args->count + a->count);
+        for (int i = 0; i < f->part->args->count; i++) {
+            args->cell[args->count++] = lval_copy(f->part->args->cell[i]);
+        }
+        for (int i = 0; i < a->count; i++) {
+            args->cell[args->count++] = a->cell[i];
+        }
+        a->count = 0;
+        lval_del(a);
+        if (owned) { lval_del(f); }
+        f = g;
+        owned = 1;
+        a = args;
+    }
+
+    if (f->builtin) {
+        lbuiltin func = f->builtin;
+        const lsig* sig = f->sig;
+        if (owned) { lval_del(f); }
+        if (owns) { lval_del(code); }
+
+        if (!evaluates(func)) {
+            *x = call_builtin(*e, func, sig, a);
+            return M_RET;
+        }
+
+        // run sequences into lists like any other builtin. anything that
+        // isn't right is left to the builtin itself to complain about
+        for (int i = 0; i < a->count; i++) {
+            if (a->cell[i]->type != LVAL_SEQ) { continue; }
+            a->cell[i] = lval_realize(*e, a->cell[i]);
+            if (a->cell[i]->type == LVAL_ERR) {
+                *x = lval_take(a, i);
+                return M_RET;
+            }
+        }
+
+        if (func == builtin_eval && a->count == 1 && a->cell[0]->type == LVAL_QEXPR) {
+            *x = lval_take(a, 0);
+            *own = 1;
+            return M_CODE;
+        }
+
+        if (func == builtin_if && a->count == 3 && a->cell[0]->type == LVAL_NUM
+                && a->cell[1]->type == LVAL_QEXPR && a->cell[2]->type == LVAL_QEXPR) {
+            *x = lval_take(a, a->cell[0]->num ? 1 : 2);
+            *own = 1;
+            return M_CODE;
+        }
+
+        if (func == builtin_do) {
+            int ok = 1;
+            for (int i = 0; i < a->count; i++) {
+                if (a->cell[i]->type != LVAL_QEXPR) { ok = 0; }
+            }
+            if (ok && a->count == 0) {
+                lval_del(a);
+                *x = lval_sexpr();
+                return M_RET;
+            }
+            if (ok && a->count == 1) {
+                *x = lval_take(a, 0);
+                *own = 1;
+                return M_CODE;
+            }
+            if (ok) {
+                frame* fr = push(s, F_DO, *e, a, 1);
+                if (!fr) {
+                    lval_del(a);
+                    *x = overflow(s);
+                    return M_RET;
+                }
+                fr->i = 1;
+                *x = a->cell[0];
+                *own = 0;
+                return M_CODE;
+            }
+        }
+
+        if (func == builtin_yield && a->count == 1 && running->co) {
+            running->co->yielded = 1;
+            *x = lval_take(a, 0);
+            return M_YIELD;
+        }
+        if (func == builtin_yield && a->count == 1) {
+            for (erun* r = running; r; r = r->outer) {
+                if (!r->co) { continue; }
+                lval_del(a);
+                *x = lval_err("Function 'yield' can't yield out of a builtin the generator called (like foldl or map)");
+                return M_RET;
+            }
+        }
+
+        *x = call_builtin(*e, func, sig, a);
+        return M_RET;
+    }
+
+    // a macro only means anything at the head of its own call
+    if (f->macro) {
+        if (owned) { lval_del(f); }
+        if (owns) { lval_del(code); }
+        lval_del(a);
+        *x = lval_err("Macros can't be called like functions | only expanded where they're written");
+        return M_RET;
+    }
+
+    // given too few arguments, a lambda is partially applied to them
+    if (a->count < required(f)) {
+        if (owns) { lval_del(code); }
+        *x = lval_partial(owned ? f : lval_copy(f), a);
+        return M_RET;
+    }
+
+    // hot lambdas get folded, then compiled (see fold.h and jit.h)
+    if (f->fold) {
+        f->fold->calls++;
+        lval* result = jit_call(*e, f, a);
+        if (result) {
+            if (owned) { lval_del(f); }
+            if (owns) { lval_del(code); }
+            *x = result;
+            return M_RET;
+        }
+    }
+
+    lval* result = bind(*e, f, a);
+    if (result) {
+        if (owned) { lval_del(f); }
+        if (owns) { lval_del(code); }
+        *x = result;
+        return M_RET;
+    }
+
+    // the body runs in the function's env, under the caller's
+    lenv_set_parent(f->env, *e);
+    lval* body = f->fold ? lfold_body(*e, f) : f->body;
+
+    // what the arguments take up counts too, or recursion that hands big
+    // values down would run out of memory long before it ran out of frames
+    size_t held = env_bytes(f->env);
+    s->held += held;
+    frame* fr = push(s, F_CALL, *e, code, owns);
+    if (!fr) {
+        s->held -= held;
+        if (owned) { lval_del(f); }
+        if (owns) { lval_del(code); }
+        *x = overflow(s);
+        return M_RET;
+    }
+    fr->owned = owned;
+    fr->v = f;
+    fr->held = held;
+
+    // the body isn't copied: it's only read, and f keeps it alive until the
+    // call returns
+    *x = body;
+    *own = 0;
+    *e = f->env;
+    return M_CODE;
+}
+
+// evaluates x in e, with the mode saying how (see above). own says whether x
+// is the run's to free, or code that it mustn't change. the run finishes
+// when everything it pushed onto s has been popped again, or at a yield if
+// it's co's. if call is set, x is a function to call with the arguments
+// call, instead
+static lval* run(estack* s, int mode, lenv* e, lval* x, int own, lval* call, ecoro* co) {
+    if (nesting >= EVAL_MAX_NESTING) {
+        if (call) { lval_del(call); }
+        if (own) { lval_del(x); }
+        return lval_err("Stack overflow | more than %d evaluations started by builtins inside each other",
+            EVAL_MAX_NESTING);
+    }
+
+    deeprose* d = lenv_interp(e);
+    s->limit = d ? d->stack_limit : EVAL_STACK_LIMIT;
+
+    // a coroutine's stack is its own, so its run always goes to the bottom
+    int base = co ? 0 : s->top;
+    erun r = { running, co };
+    running = &r;
+    nesting++;
+
+    if (call) { mode = start_call(s, &e, &x, &own, x, own, call, NULL, 0); }
+
+    while (mode != M_YIELD) {
+        switch (mode) {
+            case M_EVAL:
+                if (x->type == LVAL_SYM) {
+                    lval* v = lookup(e, x);
+                    if (own) { lval_del(x); }
+                    x = v;
+                    mode = M_RET;
+                } else if (x->type == LVAL_SEXPR && x->count) {
+                    mode = M_LIST;
+                } else {
+                    if (!own) { x = lval_copy(x); }
+                    mode = M_RET;
+                }
+                break;
+
+            case M_CODE:
+                if (!x->count) {
+                    if (own) { lval_del(x); }
+                    x = lval_sexpr();
+                    mode = M_RET;
+                } else {
+                    mode = M_LIST;
+                }
+                break;
+
+            case M_LIST: {
+                if (d && d->quota) {
+                    lval* err = lquota_step(d->quota);
+                    if (err) {
+                        if (own) { lval_del(x); }
+                        x = err;
+                        mode = M_RET;
+                        break;
+                    }
+                }
+
+                frame* fr = push(s, F_LIST, e, x, own);
+                if (!fr) {
+                    if (own) { lval_del(x); }
+                    x = overflow(s);
+                    mode = M_RET;
+                    break;
+                }
+                mode = M_NEXT;
+                if (x->cell[0]->type != LVAL_SYM) {
+                    fr->v = values(x->count);
+                    break;
+                }
+
+                lval* head = lookup(e, x->cell[0]);
+                if (head->type == LVAL_ERR) {
+                    x = drop(s, head);
+                    mode = M_RET;
+                    break;
+                }
+
+                // a macro call that wasn't expanded ahead of time, in code
+                // made while running: expanded now, every time
+                if (head->type == LVAL_FUN && head->macro) {
+                    lval* expansion = lval_expand_call(e, head, x);
+                    lval_del(head);
+                    x = drop(s, expansion);
+                    // it's being run, wherever it came from
+                    if (x->type == LVAL_QEXPR) { x->type = LVAL_SEXPR; }
+                    own = 1;
+                    mode = x->type == LVAL_ERR ? M_RET : M_EVAL;
+                    break;
+                }
+
+                // \ is a special form when its formals and body are written
+                // out: they're taken from the code as they are, no call needed
+                if (head->type == LVAL_FUN && head->builtin == builtin_lambda && x->count == 3
+                        && x->cell[1]->type == LVAL_QEXPR && x->cell[2]->type == LVAL_QEXPR) {
+                    lval_del(head);
+                    x = drop(s, builtin_make_lambda(e, lval_copy(x->cell[1]), lval_copy(x->cell[2])));
+                    mode = M_RET;
+                    break;
+                }
+
+                // so are def and let when their symbols are: only the values
+                // get evaluated, and they're bound once they all are
+                if (head->type == LVAL_FUN && x->count > 1 && x->cell[1]->type == LVAL_QEXPR
+                        && (head->builtin == builtin_def || head->builtin == builtin_let)) {
+                    fr->kind = F_VAR;
+                    fr->stop = head->builtin == builtin_let;
+                    fr->v = values(x->count - 2);
+                    fr->i = 2;
+                    lval_del(head);
+                    break;
+                }
+
+                // if, and and or are special forms: they get their arguments
+                // unevaluated, and only evaluate what they need
+                int special = x->count > 1 && head->type == LVAL_FUN && head->builtin
+                    ? (head->builtin == builtin_if ? F_IF
+                        : head->builtin == builtin_and || head->builtin == builtin_or ? F_LOGIC : 0)
+                    : 0;
+                if (!special) {
+                    fr->v = values(x->count);
+                    fr->v->cell[fr->v->count++] = head;
+                    fr->i = 1;
+                    break;
+                }
+
+                fr->stop = head->builtin == builtin_or;
+                fr->kind = special;
+                fr->i = 1;
+                lval_del(head);
+
+                char* func = special == F_IF ? "if" : fr->stop ? "or" : "and";
+                int expected = special == F_IF ? 3 : 2;
+                if (x->count - 1 != expected) {
+                    x = drop(s, args_error(func, x->count - 1, expected));
+                    mode = M_RET;
+                    break;
+                }
+
+                x = x->cell[1];
+                own = 0;
+                mode = M_EVAL;
+                break;
+            }
+
+            case M_NEXT: {
+                frame* fr = TOP(s);
+                lval* code = fr->code;
+                lval* v = fr->v;
+
+                // atoms and symbols are done right here, only calls need a frame
+                lval* err = NULL;
+                while (fr->i < code->count) {
+                    lval* c = code->cell[fr->i];
+                    if (c->type == LVAL_SEXPR && c->count) { break; }
+                    lval* val = c->type == LVAL_SYM ? lookup(fr->e, c) : lval_copy(c);
+                    if (val->type == LVAL_ERR) {
+                        err = val;
+                        break;
+                    }
+                    v->cell[v->count++] = val;
+                    fr->i++;
+                }
+
+                if (err) {
+                    x = drop(s, err);
+                    mode = M_RET;
+                    break;
+                }
+                if (fr->i < code->count) {
+                    x = code->cell[fr->i];
+                    own = 0;
+                    e = fr->e;
+                    mode = M_LIST;
+                    break;
+                }
+
+                // everything's evaluated, so make the call
+                int owns = fr->owns;
+                int kind = fr->kind;
+                int local = fr->stop;
+                e = fr->e;
+                s->top--;
+
+                if (kind == F_VAR) {
+                    x = builtin_bind(e, code->cell[1], v, 0, local);
+                    if (!x) { x = lval_sexpr(); }
+                    lval_del(v);
+                    if (owns) { lval_del(code); }
+                    mode = M_RET;
+                    break;
+                }
+
+                // builtins that take no arguments (like now-ns) get called
+                // when they're on their own, anything else is just itself
+                if (v->count == 1) {
+                    if (v->cell[0]->type == LVAL_FUN && builtin_nullary(v->cell[0])) {
+                        mode = start_call(s, &e, &x, &own, lval_pop(v, 0), 1, v, code, owns);
+                    } else {
+                        x = lval_take(v, 0);
+                        if (owns) { lval_del(code); }
+                        mode = M_RET;
+                    }
+                    break;
+                }
+
+                lval* f = lval_pop(v, 0);
+                if (f->type != LVAL_FUN) {
+                    x = lval_error(LERR_TYPE,
+                        "S-expression starts with incorrect type | got %s, expected %s",
+                        ltype_name(f->type), ltype_name(LVAL_FUN));
+                    lval_del(f); lval_del(v);
+                    if (owns) { lval_del(code); }
+                    mode = M_RET;
+                    break;
+                }
+                mode = start_call(s, &e, &x, &own, f, 1, v, code, owns);
+                break;
+            }
+
+            case M_RET: {
+                if (s->top == base) { goto done; }
+                frame* fr = TOP(s);
+
+                if (fr->kind == F_LIST || fr->kind == F_VAR) {
+                    if (x->type == LVAL_ERR) {
+                        x = drop(s, x);
+                    } else {
+                        fr->v->cell[fr->v->count++] = x;
+                        fr->i++;
+                        mode = M_NEXT;
+                    }
+                    break;
+                }
+
+                if (fr->kind == F_CALL) {
+                    char* name = call_name(fr->code);
+                    if (x->type == LVAL_ERR && name) { lval_err_trace(x, name); }
+                    frame_free(s);
+                    s->top--;
+                    break;
+                }
+
+                if (fr->kind == F_DO) {
+                    // only the last step's result is wanted, the rest are run
+                    // for their side effects (sequences included)
+                    lval_del(lval_realize(fr->e, x));
+                    fr = TOP(s);
+                    e = fr->e;
+                    if (fr->i == fr->code->count - 1) {
+                        x = lval_take(fr->code, fr->i);
+                        own = 1;
+                        s->top--;
+                    } else {
+                        x = fr->code->cell[fr->i++];
+                        own = 0;
+                    }
+                    mode = M_CODE;
+                    break;
+                }
+
+                // if, and and or: x is the value of their i'th argument
+                if (x->type == LVAL_SEQ) {
+                    x = lval_realize(fr->e, x);
+                    fr = TOP(s);
+                }
+                if (x->type == LVAL_ERR) {
+                    x = drop(s, x);
+                    break;
+                }
+
+                if (fr->kind == F_LOGIC) {
+                    if (x->type != LVAL_NUM) {
+                        lval* err = type_error(fr->stop ? "or" : "and", x->type, LVAL_NUM);
+                        lval_del(x);
+                        x = drop(s, err);
+                        break;
+                    }
+
+                    int result = x->num != 0;
+                    lval_del(x);
+                    if (result == fr->stop || fr->i == 2) {
+                        x = drop(s, lval_num(result));
+                        break;
+                    }
+                    fr->i = 2;
+                    x = fr->code->cell[2];
+                    own = 0;
+                    e = fr->e;
+                    mode = M_EVAL;
+                    break;
+                }
+
+                // if: once the condition's known, a quoted branch runs as it
+                // is, anything else gets evaluated to find the q-expression
+                e = fr->e;
+                if (fr->i == 1) {
+                    if (x->type != LVAL_NUM) {
+                        lval* err = type_error("if", x->type, LVAL_NUM);
+                        lval_del(x);
+                        x = drop(s, err);
+                        break;
+                    }
+                    fr->i = x->num ? 2 : 3;
+                    lval_del(x);
+
+                    lval* branch = fr->code->cell[fr->i];
+                    if (branch->type != LVAL_QEXPR) {
+                        x = branch;
+                        own = 0;
+                        mode = M_EVAL;
+                        break;
+                    }
+                    own = fr->owns;
+                    x = own ? lval_take(fr->code, fr->i) : branch;
+                    s->top--;
+                    mode = M_CODE;
+                    break;
+                }
+
+                if (x->type != LVAL_QEXPR) {
+                    lval* err = type_error("if", x->type, LVAL_QEXPR);
+                    lval_del(x);
+                    x = drop(s, err);
+                    break;
+                }
+                x = drop(s, x);
+                own = 1;
+                mode = M_CODE;
+                break;
+            }
+        }
+    }
+
+done:
+    running = r.outer;
+    nesting--;
+    return x;
+}
+
+lval* lval_eval(lenv* e, lval* v) {
+    // the common cases don't need a run
+    if (v->type == LVAL_SYM) {
+        lval* x = lookup(e, v);
+        lval_del(v);
+        return x;
+    }
+    if (v->type != LVAL_SEXPR || !v->count) { return v; }
+    return run(&thread_stack, M_LIST, e, v, 1, NULL, NULL);
+}
+
+// evaluates a list as a call, whatever type it is
+lval* lval_eval_sexpr(lenv* e, lval* v) {
+    if (!v->count) { return v; }
+    return run(&thread_stack, M_LIST, e, v, 1, NULL, NULL);
+}
+
+// evaluates a q-expression as code, like a branch of if, without having to
+// make it an s-expression first
+lval* lval_eval_qexpr(lenv* e, lval* q) {
+    return run(&thread_stack, M_CODE, e, q, 1, NULL, NULL);
+}
+
+// calls f with the arguments a. f is left as it was, and still the caller's:
+// calling a lambda binds the arguments into it, so that's done to a copy
+lval* lval_call(lenv* e, lval* f, lval* a) {
+    if (f->builtin && !evaluates(f->builtin)) { return call_builtin(e, f->builtin, f->sig, a); }
+    if (f->builtin || f->part) { return run(&thread_stack, M_RET, e, f, 0, a, NULL); }
+    return run(&thread_stack, M_RET, e, lval_copy(f), 1, a, NULL);
+}
+
+// like lval_call, but takes f, so a lambda can be called without a copy
+lval* lval_call_take(lenv* e, lval* f, lval* a) {
+    if (f->builtin && !evaluates(f->builtin)) {
+        lval* r = call_builtin(e, f->builtin, f->sig, a);
+        lval_del(f);
+        return r;
+    }
+    return run(&thread_stack, M_RET, e, f, 1, a, NULL);
+}
+
+void eval_thread_done(void) {
+    free(thread_stack.frames);
+    thread_stack.frames = NULL;
+    thread_stack.top = 0;
+    thread_stack.capacity = 0;
+    thread_stack.held = 0;
+}
+
+ecoro* ecoro_new(lval* f) {
+    ecoro* co = calloc(1, sizeof(ecoro));
+    co->f = f;
+    return co;
+}
+
+lval* ecoro_resume(lenv* e, ecoro* co) {
+    if (co->done) { return NULL; }
+
+    co->yielded = 0;
+    lval* x;
+    if (!co->started) {
+        co->started = 1;
+        x = run(&co->stack, M_RET, e, co->f, 0, lval_sexpr(), co);
+    } else {
+        // carry on from the yield, which evaluates to ()
+        x = run(&co->stack, M_RET, e, lval_sexpr(), 1, NULL, co);
+    }
+    if (co->yielded) { return x; }
+
+    co->done = 1;
+    // what it finishes with isn't an element, but a sequence in it still
+    // runs, like a step of do. a yield in there (from a map's function, say)
+    // can't reach the generator any more, so it's an error rather than
+    // something that silently never happens. it's run as part of the
+    // generator, so the error says why
+    erun r = { running, co };
+    running = &r;
+    x = lval_realize(e, x);
+    running = r.outer;
+    if (x->type == LVAL_ERR) { return x; }
+    lval_del(x);
+    return NULL;
+}
+
+void ecoro_del(ecoro* co) {
+    while (co->stack.top) {
+        frame_free(&co->stack);
+        co->stack.top--;
+    }
+    free(co->stack.frames);
+    lval_del(co->f);
+    free(co);
+}
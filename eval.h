@@ -0,0 +1,92 @@
+#ifndef EVAL_HEADER
+#define EVAL_HEADER
+#include "lval.h"
+
+// the evaluator (lval_eval, lval_call and friends) never recurses on the c
+// stack. everything waiting on an evaluation to finish, like a call whose
+// arguments are half evaluated or a lambda whose body is running, is a frame
+// on a stack of its own that grows on the heap. how deep deeprose code can
+// recurse is only limited by how big that's allowed to get: the interpreter's
+// stack_limit, in bytes (see deeprose.h). each call's env and the arguments
+// bound in it count towards that as well as its frames.
+//
+// builtins that evaluate things themselves, like foldl or map, start a new
+// run of the evaluator from c. those still nest on the c stack, so there can
+// only be EVAL_MAX_NESTING of them inside each other. if, do and eval are
+// handled by the evaluator itself and don't count.
+//
+// code is never changed by evaluating it. a call's values go into a list of
+// their own (which then becomes the arguments), so a lambda body is run
+// straight from the function, shared by all its copies, instead of being
+// copied for every call.
+#define EVAL_STACK_LIMIT (64UL << 20)
+#define EVAL_MAX_NESTING 1000
+
+// frees the stack the calling thread's evaluations ran on. for a thread
+// that's about to exit, like an isolate's (see lchan.h)
+void eval_thread_done(void);
+
+// budgets for an evaluation, so code that can't be trusted to finish gets
+// stopped with an error rather than running (or allocating) forever. a step
+// is an s-expression being evaluated, and alloc_bytes counts everything
+// allocated for values as it's made, with nothing given back for freeing it.
+// 0 is no limit. jitted lambdas run through the interpreter while there are
+// limits, so every step is counted (compiled programs' own functions aren't)
+typedef struct {
+    unsigned long steps;
+    unsigned long alloc_bytes;
+    long ms;
+} llimits;
+
+// the clock is only looked at every this many steps
+#define LQUOTA_CLOCK_EVERY 1024
+
+// the counts for limits that are running. limits inside other limits get
+// whatever's left of the outer ones at most
+struct lquota {
+    // whether there's anything to count. when there isn't the interpreter's
+    // quota isn't touched
+    int active;
+    // steps still to go, and how far lval_alloc_bytes and the monotonic clock
+    // (in ns) can get. ULONG_MAX or LONG_MAX for no limit
+    unsigned long steps;
+    unsigned long bytes_until;
+    long deadline;
+    // what they were to start with, for the error
+    unsigned long given_steps;
+    unsigned long given_bytes;
+    long given_ms;
+    int tick;
+    // which of them ran out, if one has. from then on every step fails
+    int exceeded;
+    lquota* outer;
+};
+
+// starts counting the evaluation d does against limits, keeping the counts
+// in q until lquota_end
+void lquota_begin(deeprose* d, lquota* q, llimits limits);
+void lquota_end(deeprose* d, lquota* q);
+// counts a step, and gives back the error if that's gone over a limit. the
+// evaluator does this for every s-expression; builtins that can go on in c
+// for as long as they're asked to (like a range) do it too
+lval* lquota_check(lenv* e);
+// for builtins that wait on something: the monotonic time in ns that e's
+// limits run out at (LONG_MAX if never), and the error for having waited
+// until then
+long lquota_deadline(lenv* e);
+lval* lquota_expire(lenv* e);
+
+// a coroutine: a function running on a stack of its own, which it leaves
+// where it is every time it calls (yield x). generators (see lseq.h) are built
+// on these. a yield has to come from the coroutine's own run, so not from
+// inside something like foldl that it called
+typedef struct ecoro ecoro;
+
+// takes ownership of f, which gets called with no arguments
+ecoro* ecoro_new(lval* f);
+// runs the coroutine until its next yield and returns what it yielded. NULL
+// once the function has returned, or the error if it failed
+lval* ecoro_resume(lenv* e, ecoro* co);
+void ecoro_del(ecoro* co);
+
+#endif
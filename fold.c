@@ -0,0 +1,278 @@
+/// constant folding and inlining of lambda bodies, see fold.h
+#include <stdlib.h>
+#include <string.h>
+#include "fold.h"
+#include "jit.h"
+#include "builtin.h"
+#include "deeprose.h"
+
+typedef struct {
+    deeprose* d;
+    // what the folded body relies on, see struct lfold
+    lval* deps;
+    int changed;
+} folder;
+
+static lval* fold_call(folder* fl, lval* x);
+
+// the global that sym names, if it's safe to decide that now: it has to be
+// bound globally and never bound by any local env, or dynamic scope could
+// hand the call something else
+static lval* fold_global(folder* fl, lval* sym) {
+    if (sym->type != LVAL_SYM) { return NULL; }
+    if (lenv_find(fl->d->locals, sym->sym, NULL)) { return NULL; }
+    return lenv_find(fl->d->env, sym->sym, NULL);
+}
+
+// adds sym and v to a list of dependencies, unless sym is already there.
+// lambdas are kept without their fold: it isn't compared, and holding on to
+// it could make a cycle of references (a lambda depending on itself)
+void lfold_depend(lval* deps, lval* sym, lval* v) {
+    for (int i = 0; i < deps->count; i += 2) {
+        if (strcmp(deps->cell[i]->sym, sym->sym) == 0) { return; }
+    }
+
+    lval* x = lval_copy(v);
+    if (x->type == LVAL_FUN && !x->builtin && x->fold) {
+        lfold_release(x->fold);
+        x->fold = NULL;
+    }
+    lval_add(deps, lval_sym(sym->sym));
+    lval_add(deps, x);
+}
+
+// remember that the folded body relies on sym being v
+static void fold_depend(folder* fl, lval* sym, lval* v) {
+    lfold_depend(fl->deps, sym, v);
+}
+
+static int fold_constant(lval* x) {
+    return x->type == LVAL_NUM || x->type == LVAL_BIG || x->type == LVAL_STR || x->type == LVAL_QEXPR;
+}
+
+// how many times sym is used as code in x. -1 if it turns up in a
+// q-expression, where something like `first` could evaluate it later
+static int fold_uses(lval* x, char* sym) {
+    if (x->type == LVAL_SYM) { return strcmp(x->sym, sym) == 0; }
+    if (x->type != LVAL_SEXPR && x->type != LVAL_QEXPR) { return 0; }
+
+    int uses = 0;
+    for (int i = 0; i < x->count; i++) {
+        int n = fold_uses(x->cell[i], sym);
+        if (n < 0 || (n > 0 && x->cell[i]->type == LVAL_QEXPR)) { return -1; }
+        uses += n;
+    }
+    return uses;
+}
+
+// every call in a wrapper's body has to be to a builtin that doesn't look at
+// the environment, since inlined it runs in the caller's env instead of the
+// wrapper's
+static int fold_inlinable_calls(folder* fl, lval* x) {
+    if (!x->count) { return 0; }
+
+    lval* head = fold_global(fl, x->cell[0]);
+    if (!head || head->type != LVAL_FUN || !head->builtin || !builtin_inlinable(head)) {
+        return 0;
+    }
+    fold_depend(fl, x->cell[0], head);
+
+    for (int i = 1; i < x->count; i++) {
+        if (x->cell[i]->type == LVAL_SEXPR && !fold_inlinable_calls(fl, x->cell[i])) { return 0; }
+    }
+    return 1;
+}
+
+// swaps each formal in x for its argument
+static lval* fold_substitute(lval* x, lval* formals, lval* args) {
+    if (x->type == LVAL_SYM) {
+        for (int i = 0; i < formals->count; i++) {
+            if (strcmp(x->sym, formals->cell[i]->sym) == 0) {
+                lval_del(x);
+                return lval_copy(args->cell[i + 1]);
+            }
+        }
+    }
+    if (x->type == LVAL_SEXPR) {
+        for (int i = 0; i < x->count; i++) {
+            x->cell[i] = fold_substitute(x->cell[i], formals, args);
+        }
+    }
+    return x;
+}
+
+// the body of the lambda w with x's arguments in place of its formals, or
+// NULL if it isn't a wrapper simple enough to inline. a wrapper is a single
+// call to builtins, using each formal exactly once
+static lval* fold_inline(folder* fl, lval* x, lval* w) {
+    lval* body = w->body;
+    lval* formals = w->formals;
+    if (!formals->count || formals->count != x->count - 1 || body->count < 2) { return NULL; }
+
+    for (int i = 0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, "&") == 0) { return NULL; }
+        if (fold_uses(body, formals->cell[i]->sym) != 1) { return NULL; }
+        // with more than one argument they'd no longer be evaluated in order,
+        // so only allow ones where order can't matter
+        lval* arg = x->cell[i + 1];
+        if (formals->count > 1 && !fold_constant(arg) && arg->type != LVAL_SYM) { return NULL; }
+    }
+
+    if (!fold_inlinable_calls(fl, body)) { return NULL; }
+
+    lval* inlined = lval_copy(body);
+    inlined->type = LVAL_SEXPR;
+    return fold_substitute(inlined, formals, x);
+}
+
+// folds a q-expression that's going to be evaluated as code: a lambda's
+// body, or a branch of `if`. takes ownership
+static lval* fold_branch(folder* fl, lval* q) {
+    q->type = LVAL_SEXPR;
+    lval* r = fold_call(fl, q);
+    if (r->type == LVAL_SEXPR) {
+        r->type = LVAL_QEXPR;
+        return r;
+    }
+    // (r) evaluates to r
+    return lval_add(lval_qexpr(), r);
+}
+
+// folds a call, returning what should replace it. takes ownership
+static lval* fold_call(folder* fl, lval* x) {
+    if (!x->count) { return x; }
+    lval* head = fold_global(fl, x->cell[0]);
+    int is_if = head && head->type == LVAL_FUN && head->builtin == builtin_if;
+
+    // arguments first. q-expressions are data, other than if's branches
+    for (int i = 0; i < x->count; i++) {
+        if (x->cell[i]->type == LVAL_SEXPR) {
+            x->cell[i] = fold_call(fl, x->cell[i]);
+        } else if (is_if && i >= 2 && x->cell[i]->type == LVAL_QEXPR) {
+            x->cell[i] = fold_branch(fl, x->cell[i]);
+        }
+    }
+    if (is_if) { fold_depend(fl, x->cell[0], head); }
+
+    // (x) just evaluates x
+    if (x->count == 1 || !head || head->type != LVAL_FUN) { return x; }
+
+    // partial applications are left to be called, and macro calls to be
+    // expanded
+    if (head->part || head->macro) { return x; }
+
+    if (!head->builtin) {
+        lval* inlined = fold_inline(fl, x, head);
+        if (!inlined) { return x; }
+
+        fold_depend(fl, x->cell[0], head);
+        fl->changed = 1;
+        lval_del(x);
+        return fold_call(fl, inlined);
+    }
+
+    if (!builtin_pure(head)) { return x; }
+    for (int i = 1; i < x->count; i++) {
+        if (!fold_constant(x->cell[i])) { return x; }
+    }
+
+    // errors (like dividing by zero) are left for the call to report
+    lval* args = lval_sexpr();
+    for (int i = 1; i < x->count; i++) {
+        lval_add(args, lval_copy(x->cell[i]));
+    }
+    lval* result = lval_call(fl->d->env, head, args);
+    if (!fold_constant(result)) {
+        lval_del(result);
+        return x;
+    }
+
+    fold_depend(fl, x->cell[0], head);
+    fl->changed = 1;
+    lval_del(x);
+    return result;
+}
+
+// gets the freshly made lambda f ready to be folded. nothing is done until
+// it's called a second time: lambdas made inside a function are made again
+// on every call and are usually only called once, and for those the pass
+// would cost more than it saves
+void lval_fold_lambda(lval* f) {
+    lfold* fo = malloc(sizeof(lfold));
+    fo->refs = 1;
+    fo->calls = 0;
+    fo->off = 0;
+    fo->interp = NULL;
+    fo->version = 0;
+    fo->body = NULL;
+    fo->deps = NULL;
+    fo->jit = NULL;
+    f->fold = fo;
+}
+
+static void lfold_run(lfold* fo, deeprose* d, lval* f) {
+    folder fl = { d, lval_qexpr(), 0 };
+    lval* body = fold_branch(&fl, lval_copy(f->body));
+    if (!fl.changed) {
+        lval_del(body);
+        lval_del(fl.deps);
+        fo->off = 1;
+        return;
+    }
+
+    fo->interp = d;
+    fo->version = d->version;
+    fo->body = body;
+    fo->deps = fl.deps;
+}
+
+// whether every global in deps (pairs of symbol and value) still has the
+// value it had, and still can't be shadowed by a local
+int lfold_deps_hold(deeprose* d, lval* deps) {
+    for (int i = 0; i < deps->count; i += 2) {
+        char* sym = deps->cell[i]->sym;
+        lval* v = lenv_find(d->env, sym, NULL);
+        if (!v || !lval_eq(v, deps->cell[i + 1]) || lenv_find(d->locals, sym, NULL)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// the body a call to f should run: the folded one, unless something it
+// relied on has changed since it was folded
+lval* lfold_body(lenv* e, lval* f) {
+    lfold* fo = f->fold;
+    deeprose* d = e->interp;
+    if (fo->off || !d) { return f->body; }
+
+    // the evaluator counts the calls
+    if (!fo->body) {
+        if (fo->calls < LFOLD_AFTER_CALLS) { return f->body; }
+        lfold_run(fo, d, f);
+        if (fo->off) { return f->body; }
+    }
+    if (d == fo->interp && d->version == fo->version) { return fo->body; }
+
+    // something global changed, see if it was anything we cared about
+    if (d != fo->interp || !lfold_deps_hold(d, fo->deps)) {
+        fo->off = 1;
+        return f->body;
+    }
+
+    fo->version = d->version;
+    return fo->body;
+}
+
+lfold* lfold_retain(lfold* fo) {
+    fo->refs++;
+    return fo;
+}
+
+void lfold_release(lfold* fo) {
+    if (!fo || --fo->refs) { return; }
+    if (fo->body) { lval_del(fo->body); }
+    if (fo->deps) { lval_del(fo->deps); }
+    if (fo->jit) { jit_free(fo->jit); }
+    free(fo);
+}
@@ -0,0 +1,45 @@
+#ifndef FOLD_HEADER
+#define FOLD_HEADER
+#include "lval.h"
+
+typedef struct ljit ljit;
+
+// a lambda that's called more than once gets a pass over its body that
+// works out anything that can't change between calls: calls to pure builtins
+// on constants, like `(+ 1 2)` or `(list 1 2)`, become their result, and calls
+// to tiny stdlib wrappers like `inc` or `empty?` are replaced by the
+// wrapper's body.
+//
+// all of that assumes the names involved still mean what they did when the
+// body was folded, so the fold remembers what it assumed. if any of them is
+// rebound (or becomes a name a local can shadow) calls go back to the body
+// as written.
+#define LFOLD_AFTER_CALLS 2
+
+// shared by every copy of a lambda
+struct lfold {
+    int refs;
+    // calls so far, counted by the evaluator. folding and compiling (see jit.h)
+    // both wait for a lambda to get hot
+    unsigned long calls;
+    // nothing to fold, or something the fold relied on changed. never cleared
+    int off;
+    // the interpreter version the assumptions were last checked against
+    deeprose* interp;
+    unsigned long version;
+    // the folded body, NULL until it's been folded
+    lval* body;
+    // pairs of symbol, and the global value the fold assumed it had
+    lval* deps;
+    // machine code for the lambda, once it's been compiled
+    ljit* jit;
+};
+
+void lval_fold_lambda(lval* f);
+lval* lfold_body(lenv* e, lval* f);
+int lfold_deps_hold(deeprose* d, lval* deps);
+void lfold_depend(lval* deps, lval* sym, lval* v);
+lfold* lfold_retain(lfold* fo);
+void lfold_release(lfold* fo);
+
+#endif
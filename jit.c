@@ -0,0 +1,443 @@
+/// compiling hot lambdas to machine code, see jit.h
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <stddef.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include "builtin.h"
+#include "deeprose.h"
+
+// what compiled code expects to find in each argument slot
+enum jitkind { JIT_ANY, JIT_NUM, JIT_LIST };
+
+struct ljit {
+    // NULL if the lambda couldn't be compiled, or the code was thrown away
+    void* code;
+    size_t size;
+    int kinds[JIT_MAX_ARGS];
+    // calls that had to go back to the interpreter
+    int bails;
+    // like lfold: pairs of symbol and the global value the code relies on
+    lval* deps;
+    deeprose* interp;
+    unsigned long version;
+};
+
+// a lambda that keeps bailing isn't worth running natively
+#define JIT_MAX_BAILS 16
+// how much c stack compiled code can recurse into before it gives up and
+// leaves the rest to the evaluator, which doesn't use the c stack
+#define JIT_STACK (4L << 20)
+
+// where compiled code goes when it gives up
+static __thread jmp_buf* jit_bail_to;
+
+static void jit_bail(void) {
+    longjmp(*jit_bail_to, 1);
+}
+
+// the code being generated
+typedef struct {
+    unsigned char* buf;
+    size_t len;
+    size_t cap;
+    int ok;
+
+    deeprose* d;
+    lval* f;
+    int kinds[JIT_MAX_ARGS];
+    int self_calls;
+    lval* deps;
+
+    // jumps to the bail stub, patched once we know where it is
+    size_t* bails;
+    int nbails;
+} jitc;
+
+static void emit(jitc* c, int n, ...) {
+    if (c->len + n > c->cap) {
+        c->cap = (c->cap + n) * 2;
+        c->buf = realloc(c->buf, c->cap);
+    }
+    va_list va;
+    va_start(va, n);
+    for (int i = 0; i < n; i++) {
+        c->buf[c->len++] = va_arg(va, int);
+    }
+    va_end(va);
+}
+
+static void emit32(jitc* c, int x) {
+    emit(c, 4, x & 0xff, (x >> 8) & 0xff, (x >> 16) & 0xff, (x >> 24) & 0xff);
+}
+
+static void emit64(jitc* c, long x) {
+    emit32(c, (int)x);
+    emit32(c, (int)(x >> 32));
+}
+
+static void patch32(jitc* c, size_t at, int x) {
+    memcpy(c->buf + at, &x, 4);
+}
+
+// jcc rel32 to the bail stub. cc is the second opcode byte (0x80 + condition)
+static void emit_bail_if(jitc* c, int cc) {
+    emit(c, 2, 0x0f, cc);
+    c->bails = realloc(c->bails, sizeof(size_t) * (c->nbails + 1));
+    c->bails[c->nbails++] = c->len;
+    emit32(c, 0);
+}
+
+#define JO  0x80
+#define JNE 0x85
+#define JLE 0x8e
+#define JB  0x82
+
+static int jit_fail(jitc* c) {
+    c->ok = 0;
+    return 0;
+}
+
+static void jit_depend(jitc* c, lval* sym, lval* v) {
+    lfold_depend(c->deps, sym, v);
+}
+
+static int jit_formal(jitc* c, lval* sym) {
+    lval* formals = c->f->formals;
+    for (int i = 0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, sym->sym) == 0) { return i; }
+    }
+    return -1;
+}
+
+// a formal can only be one kind of thing throughout the body
+static int jit_use_formal(jitc* c, int i, int kind) {
+    if (c->kinds[i] != JIT_ANY && c->kinds[i] != kind) { return jit_fail(c); }
+    c->kinds[i] = kind;
+    // mov rax, [rbx + 8i]
+    emit(c, 3, 0x48, 0x8b, 0x83);
+    emit32(c, 8 * i);
+    return 1;
+}
+
+static int jit_expr(jitc* c, lval* x);
+static int jit_form(jitc* c, lval* x);
+
+static int jit_call_builtin(jitc* c, lval* x, lbuiltin fn) {
+    int argc = x->count - 1;
+
+    if (fn == builtin_add || fn == builtin_sub || fn == builtin_mul) {
+        if (argc < 1 || !jit_expr(c, x->cell[1])) { return jit_fail(c); }
+        if (fn == builtin_sub && argc == 1) {
+            // neg rax
+            emit(c, 3, 0x48, 0xf7, 0xd8);
+            emit_bail_if(c, JO);
+        }
+        for (int i = 2; i < x->count; i++) {
+            // push rax, then the next argument into rcx
+            emit(c, 1, 0x50);
+            if (!jit_expr(c, x->cell[i])) { return 0; }
+            // mov rcx, rax; pop rax
+            emit(c, 4, 0x48, 0x89, 0xc1, 0x58);
+            if (fn == builtin_add) { emit(c, 3, 0x48, 0x01, 0xc8); }
+            if (fn == builtin_sub) { emit(c, 3, 0x48, 0x29, 0xc8); }
+            if (fn == builtin_mul) { emit(c, 4, 0x48, 0x0f, 0xaf, 0xc1); }
+            emit_bail_if(c, JO);
+        }
+        return 1;
+    }
+
+    if (fn == builtin_lt || fn == builtin_gt || fn == builtin_eq) {
+        if (argc != 2 || !jit_expr(c, x->cell[1])) { return jit_fail(c); }
+        emit(c, 1, 0x50);
+        if (!jit_expr(c, x->cell[2])) { return 0; }
+        // mov rcx, rax; pop rax; cmp rax, rcx
+        emit(c, 7, 0x48, 0x89, 0xc1, 0x58, 0x48, 0x39, 0xc8);
+        // setl / setg / sete al
+        int cc = fn == builtin_lt ? 0x9c : fn == builtin_gt ? 0x9f : 0x94;
+        emit(c, 3, 0x0f, cc, 0xc0);
+        // movzx eax, al
+        emit(c, 3, 0x0f, 0xb6, 0xc0);
+        return 1;
+    }
+
+    if (fn == builtin_if) {
+        if (argc != 3 || x->cell[2]->type != LVAL_QEXPR || x->cell[3]->type != LVAL_QEXPR) {
+            return jit_fail(c);
+        }
+        if (!jit_expr(c, x->cell[1])) { return 0; }
+        // test rax, rax; je else
+        emit(c, 3, 0x48, 0x85, 0xc0);
+        emit(c, 2, 0x0f, 0x84);
+        size_t to_else = c->len;
+        emit32(c, 0);
+
+        if (!jit_form(c, x->cell[2])) { return 0; }
+        // jmp end
+        emit(c, 1, 0xe9);
+        size_t to_end = c->len;
+        emit32(c, 0);
+
+        patch32(c, to_else, c->len - (to_else + 4));
+        if (!jit_form(c, x->cell[3])) { return 0; }
+        patch32(c, to_end, c->len - (to_end + 4));
+        return 1;
+    }
+
+    // only `first` of a formal, which has to be a list starting with a number
+    if (fn == builtin_first) {
+        if (argc != 1 || x->cell[1]->type != LVAL_SYM) { return jit_fail(c); }
+        int i = jit_formal(c, x->cell[1]);
+        if (i < 0 || !jit_use_formal(c, i, JIT_LIST)) { return jit_fail(c); }
+
+        // cmp dword [rax + type], LVAL_QEXPR; jne bail
+        emit(c, 2, 0x81, 0xb8);
+        emit32(c, offsetof(lval, type));
+        emit32(c, LVAL_QEXPR);
+        emit_bail_if(c, JNE);
+        // cmp dword [rax + count], 0; jle bail
+        emit(c, 2, 0x83, 0xb8);
+        emit32(c, offsetof(lval, count));
+        emit(c, 1, 0);
+        emit_bail_if(c, JLE);
+        // mov rax, [rax + cell]; mov rax, [rax]
+        emit(c, 2, 0x48, 0x8b); emit(c, 1, 0x80);
+        emit32(c, offsetof(lval, cell));
+        emit(c, 3, 0x48, 0x8b, 0x00);
+        // cmp dword [rax + type], LVAL_NUM; jne bail
+        emit(c, 2, 0x81, 0xb8);
+        emit32(c, offsetof(lval, type));
+        emit32(c, LVAL_NUM);
+        emit_bail_if(c, JNE);
+        // mov rax, [rax + num]
+        emit(c, 3, 0x48, 0x8b, 0x80);
+        emit32(c, offsetof(lval, num));
+        return 1;
+    }
+
+    return jit_fail(c);
+}
+
+// a call back to the lambda being compiled. the arguments go on the stack
+// last first, so they end up in order for the callee
+static int jit_call_self(jitc* c, lval* x) {
+    int argc = x->count - 1;
+    if (argc != c->f->formals->count) { return jit_fail(c); }
+
+    for (int i = x->count - 1; i >= 1; i--) {
+        if (!jit_expr(c, x->cell[i])) { return 0; }
+        emit(c, 1, 0x50);
+    }
+    // mov rdi, rsp; call start
+    emit(c, 3, 0x48, 0x89, 0xe7);
+    emit(c, 1, 0xe8);
+    emit32(c, -(int)(c->len + 4));
+    // add rsp, 8 * argc
+    emit(c, 3, 0x48, 0x81, 0xc4);
+    emit32(c, 8 * argc);
+
+    c->self_calls = 1;
+    return 1;
+}
+
+static int jit_apply(jitc* c, lval* x) {
+    lval* sym = x->cell[0];
+    if (sym->type != LVAL_SYM || jit_formal(c, sym) >= 0) { return jit_fail(c); }
+
+    // like fold.c, only globals nothing local can shadow
+    if (lenv_find(c->d->locals, sym->sym, NULL)) { return jit_fail(c); }
+    lval* fn = lenv_find(c->d->env, sym->sym, NULL);
+    if (!fn || fn->type != LVAL_FUN || fn->part) { return jit_fail(c); }
+    jit_depend(c, sym, fn);
+
+    if (fn->builtin) { return jit_call_builtin(c, x, fn->builtin); }
+    // copies of a lambda share their fold, so this is us
+    if (fn->fold && fn->fold == c->f->fold) { return jit_call_self(c, x); }
+    return jit_fail(c);
+}
+
+// leaves the value of x in rax
+static int jit_expr(jitc* c, lval* x) {
+    switch (x->type) {
+        case LVAL_NUM:
+            // mov rax, imm64
+            emit(c, 2, 0x48, 0xb8);
+            emit64(c, x->num);
+            return 1;
+
+        case LVAL_SYM: {
+            int i = jit_formal(c, x);
+            if (i < 0) { return jit_fail(c); }
+            return jit_use_formal(c, i, JIT_NUM);
+        }
+
+        case LVAL_SEXPR:
+            if (x->count == 1) { return jit_expr(c, x->cell[0]); }
+            if (x->count < 2) { return jit_fail(c); }
+            return jit_apply(c, x);
+    }
+    return jit_fail(c);
+}
+
+// a q-expression evaluated as code: the body, or a branch of if
+static int jit_form(jitc* c, lval* x) {
+    if (x->count == 1) { return jit_expr(c, x->cell[0]); }
+    if (x->count < 2) { return jit_fail(c); }
+    return jit_apply(c, x);
+}
+
+// compiles f's body into code taking a pointer to its arguments in rdi and
+// returning the result in rax. rsi is the lowest the stack can go
+static ljit* jit_compile(deeprose* d, lval* f) {
+    ljit* j = malloc(sizeof(ljit));
+    j->code = NULL;
+    j->bails = 0;
+    j->deps = NULL;
+
+    lval* formals = f->formals;
+    if (formals->count > JIT_MAX_ARGS) { return j; }
+    for (int i = 0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, "&") == 0) { return j; }
+    }
+
+    jitc c = { NULL, 0, 0, 1, d, f, { JIT_ANY }, 0, lval_qexpr(), NULL, 0 };
+
+    // the folded body is better, but then we rely on what it relied on too
+    lval* body = f->body;
+    lfold* fo = f->fold;
+    if (fo->body && !fo->off) {
+        body = fo->body;
+        for (int i = 0; i < fo->deps->count; i += 2) {
+            jit_depend(&c, fo->deps->cell[i], fo->deps->cell[i + 1]);
+        }
+    }
+
+    // cmp rsp, rsi; jb bail. nothing else touches rsi, so it's still there
+    // for calls to ourselves
+    emit(&c, 3, 0x48, 0x39, 0xf4);
+    emit_bail_if(&c, JB);
+    // push rbx; mov rbx, rdi
+    emit(&c, 4, 0x53, 0x48, 0x89, 0xfb);
+    jit_form(&c, body);
+    // pop rbx; ret
+    emit(&c, 2, 0x5b, 0xc3);
+
+    // calling ourselves passes numbers, so that's all we can take
+    for (int i = 0; i < formals->count; i++) {
+        if (c.self_calls && c.kinds[i] == JIT_LIST) { c.ok = 0; }
+    }
+
+    if (c.ok) {
+        // bail: realign the stack for c, then jit_bail, which doesn't return
+        size_t stub = c.len;
+        emit(&c, 4, 0x48, 0x83, 0xe4, 0xf0);
+        emit(&c, 2, 0x48, 0xb8);
+        emit64(&c, (long)jit_bail);
+        emit(&c, 2, 0xff, 0xd0);
+        for (int i = 0; i < c.nbails; i++) {
+            patch32(&c, c.bails[i], stub - (c.bails[i] + 4));
+        }
+
+        // written while writable, then swapped to executable
+        void* code = mmap(NULL, c.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code != MAP_FAILED) {
+            memcpy(code, c.buf, c.len);
+            if (mprotect(code, c.len, PROT_READ | PROT_EXEC) == 0) {
+                j->code = code;
+                j->size = c.len;
+            } else {
+                munmap(code, c.len);
+            }
+        }
+    }
+
+    memcpy(j->kinds, c.kinds, sizeof(j->kinds));
+    j->deps = c.deps;
+    j->interp = d;
+    j->version = d->version;
+    free(c.buf);
+    free(c.bails);
+    return j;
+}
+
+static void jit_discard(ljit* j) {
+    if (j->code) { munmap(j->code, j->size); }
+    j->code = NULL;
+}
+
+// runs f natively if it's been compiled, compiling it if it's just got hot.
+// takes ownership of a only if it returns a result
+lval* jit_call(lenv* e, lval* f, lval* a) {
+    deeprose* d = e->interp;
+    lfold* fo = f->fold;
+    // machine code can't count steps, so under limits it's all interpreted
+    if (!d || !d->jit || d->quota) { return NULL; }
+
+    if (!fo->jit) {
+        if (fo->calls < JIT_AFTER_CALLS) { return NULL; }
+        fo->jit = jit_compile(d, f);
+    }
+
+    ljit* j = fo->jit;
+    if (!j->code) { return NULL; }
+    // the wrong number of arguments is an error (or a partial application)
+    // for the interpreter to sort out
+    if (a->count != f->formals->count) { return NULL; }
+
+    if (d != j->interp || d->version != j->version) {
+        if (d != j->interp || !lfold_deps_hold(d, j->deps)) {
+            jit_discard(j);
+            return NULL;
+        }
+        j->version = d->version;
+    }
+
+    long args[JIT_MAX_ARGS];
+    for (int i = 0; i < a->count; i++) {
+        if (j->kinds[i] == JIT_NUM) {
+            if (a->cell[i]->type != LVAL_NUM) { return NULL; }
+            args[i] = a->cell[i]->num;
+        } else if (j->kinds[i] == JIT_LIST) {
+            args[i] = (long)a->cell[i];
+        } else {
+            args[i] = 0;
+        }
+    }
+
+    jmp_buf bail;
+    jmp_buf* outer = jit_bail_to;
+    jit_bail_to = &bail;
+    if (setjmp(bail)) {
+        jit_bail_to = outer;
+        if (++j->bails >= JIT_MAX_BAILS) { jit_discard(j); }
+        return NULL;
+    }
+    long floor = (long)&bail - JIT_STACK;
+    long result = ((long (*)(long*, long))j->code)(args, floor);
+    jit_bail_to = outer;
+
+    lval_del(a);
+    return lval_num(result);
+}
+
+void jit_free(ljit* j) {
+    jit_discard(j);
+    if (j->deps) { lval_del(j->deps); }
+    free(j);
+}
+
+#else
+
+// no jit on this platform, everything is interpreted
+lval* jit_call(lenv* e, lval* f, lval* a) {
+    return NULL;
+}
+
+void jit_free(ljit* j) {
+}
+
+#endif
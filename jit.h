@@ -0,0 +1,29 @@
+#ifndef JIT_HEADER
+#define JIT_HEADER
+#include "lval.h"
+#include "fold.h"
+
+// a template jit for small numeric lambdas. once a lambda has been called
+// JIT_AFTER_CALLS times its body (folded, if it could be) is compiled to
+// x86-64, a fixed chunk of machine code per kind of expression. it handles
+// numbers, the lambda's formals, + - * < > =, if, first on a formal, and calls
+// back to itself; a lambda using anything else just stays interpreted.
+//
+// compiled code works on raw longs. whenever it meets something it can't
+// handle (an argument that isn't a number, first of something that isn't a
+// list of numbers, an overflow) it gives up and the whole call is run by the
+// interpreter instead, which is fine since everything it handles is pure. a
+// bignum (see lbig.h) is never a number as far as compiled code goes.
+//
+// the code relies on the globals it calls meaning what they did when it was
+// compiled, and is thrown away if any of them change (like fold.h).
+//
+// only built on linux x86-64. DEEPROSE_NO_JIT in the environment, or
+// --no-jit, turns it off
+#define JIT_AFTER_CALLS 50
+#define JIT_MAX_ARGS 8
+
+lval* jit_call(lenv* e, lval* f, lval* a);
+void jit_free(ljit* j);
+
+#endif
@@ -0,0 +1,451 @@
+/// arbitrary-precision integers, see lbig.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include "lbig.h"
+
+#define BASE LBIG_BASE
+
+lbig* lbig_retain(lbig* b) {
+    b->refs++;
+    return b;
+}
+
+void lbig_release(lbig* b) {
+    if (--b->refs == 0) { free(b); }
+}
+
+static lbig* big_new(int len) {
+    lbig* b = malloc(sizeof(lbig) + sizeof(uint32_t) * (len ? len : 1));
+    lval_alloc_bytes += sizeof(lbig) + sizeof(uint32_t) * len;
+    b->refs = 1;
+    b->sign = 1;
+    b->len = len;
+    return b;
+}
+
+lbig* lbig_clone(lbig* b) {
+    lbig* c = big_new(b->len);
+    c->sign = b->sign;
+    memcpy(c->d, b->d, sizeof(uint32_t) * b->len);
+    return c;
+}
+
+static int trim(const uint32_t* d, int len) {
+    while (len && !d[len - 1]) { len--; }
+    return len;
+}
+
+// a number of either kind as a sign and digits. a long doesn't need more
+// than three, LONG_MIN included
+typedef struct {
+    int sign;
+    int len;
+    const uint32_t* d;
+    uint32_t small[3];
+} lmag;
+
+static void mag_of(lval* x, lmag* m) {
+    if (x->type == LVAL_BIG) {
+        m->sign = x->big->sign;
+        m->len = x->big->len;
+        m->d = x->big->d;
+        return;
+    }
+    unsigned long u = x->num < 0 ? 0UL - (unsigned long)x->num : (unsigned long)x->num;
+    m->sign = x->num < 0 ? -1 : 1;
+    m->len = 0;
+    while (u) {
+        m->small[m->len++] = u % BASE;
+        u /= BASE;
+    }
+    m->d = m->small;
+}
+
+// b as a number: a long if it fits, otherwise a bignum. takes b
+static lval* big_result(lbig* b) {
+    b->len = trim(b->d, b->len);
+    if (b->len <= 3) {
+        unsigned long u = 0;
+        int fits = 1;
+        for (int i = b->len - 1; i >= 0 && fits; i--) {
+            if (u > (ULONG_MAX - b->d[i]) / BASE) { fits = 0; }
+            else { u = u * BASE + b->d[i]; }
+        }
+        if (fits && b->sign > 0 && u <= LONG_MAX) {
+            free(b);
+            return lval_num((long)u);
+        }
+        if (fits && b->sign < 0 && u <= (unsigned long)LONG_MAX + 1) {
+            free(b);
+            return lval_num(u == (unsigned long)LONG_MAX + 1 ? LONG_MIN : -(long)u);
+        }
+    }
+    return lval_big(b);
+}
+
+static int mag_cmp(const uint32_t* a, int an, const uint32_t* b, int bn) {
+    if (an != bn) { return an < bn ? -1 : 1; }
+    for (int i = an - 1; i >= 0; i--) {
+        if (a[i] != b[i]) { return a[i] < b[i] ? -1 : 1; }
+    }
+    return 0;
+}
+
+// r = a + b. r has room for one digit more than the longer of them, and
+// that's the length it returns
+static int mag_add(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    if (an < bn) {
+        const uint32_t* t = a; a = b; b = t;
+        int tn = an; an = bn; bn = tn;
+    }
+    uint32_t carry = 0;
+    for (int i = 0; i < an; i++) {
+        uint32_t s = a[i] + (i < bn ? b[i] : 0) + carry;
+        carry = s >= BASE;
+        r[i] = carry ? s - BASE : s;
+    }
+    r[an] = carry;
+    return an + 1;
+}
+
+// r = a - b, for a at least b. r can be a
+static int mag_sub(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    int borrow = 0;
+    for (int i = 0; i < an; i++) {
+        int64_t s = (int64_t)a[i] - (i < bn ? b[i] : 0) - borrow;
+        borrow = s < 0;
+        r[i] = borrow ? s + BASE : s;
+    }
+    return an;
+}
+
+// r += a, carrying as far as it has to. r has to be long enough
+static void mag_add_at(uint32_t* r, const uint32_t* a, int an) {
+    uint32_t carry = 0;
+    int i;
+    for (i = 0; i < an; i++) {
+        uint32_t s = r[i] + a[i] + carry;
+        carry = s >= BASE;
+        r[i] = carry ? s - BASE : s;
+    }
+    for (; carry; i++) {
+        uint32_t s = r[i] + 1;
+        carry = s >= BASE;
+        r[i] = carry ? 0 : s;
+    }
+}
+
+// r = a * k, an + 1 digits
+static void mag_mul_small(uint32_t* r, const uint32_t* a, int an, uint32_t k) {
+    uint64_t carry = 0;
+    for (int i = 0; i < an; i++) {
+        uint64_t t = (uint64_t)a[i] * k + carry;
+        r[i] = t % BASE;
+        carry = t / BASE;
+    }
+    r[an] = carry;
+}
+
+// r = a * b by the book, an + bn digits
+static void mag_mul_school(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+    for (int i = 0; i < an; i++) {
+        uint64_t ai = a[i], carry = 0;
+        if (!ai) { continue; }
+        for (int j = 0; j < bn; j++) {
+            uint64_t t = ai * b[j] + r[i + j] + carry;
+            r[i + j] = t % BASE;
+            carry = t / BASE;
+        }
+        r[i + bn] = carry;
+    }
+}
+
+// r = a * b, an + bn digits
+static void mag_mul(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    if (an < bn) {
+        const uint32_t* t = a; a = b; b = t;
+        int tn = an; an = bn; bn = tn;
+    }
+    if (bn < LBIG_KARATSUBA) {
+        mag_mul_school(r, a, an, b, bn);
+        return;
+    }
+
+    // a lot longer than b: a piece of b's length at a time
+    if (an >= 2 * bn) {
+        memset(r, 0, sizeof(uint32_t) * (an + bn));
+        uint32_t* t = malloc(sizeof(uint32_t) * 2 * bn);
+        for (int i = 0; i < an; i += bn) {
+            int n = an - i < bn ? an - i : bn;
+            mag_mul(t, a + i, n, b, bn);
+            mag_add_at(r + i, t, n + bn);
+        }
+        free(t);
+        return;
+    }
+
+    // with a = a1 B^m + a0 and b = b1 B^m + b0, ab is
+    // a1b1 B^2m + ((a0 + a1)(b0 + b1) - a1b1 - a0b0) B^m + a0b0:
+    // three multiplications of half the length instead of four
+    int m = an / 2;
+    int a1n = an - m, b1n = bn - m;
+    int sn = a1n + 1, tn = (m > b1n ? m : b1n) + 1;
+    uint32_t* sa = malloc(sizeof(uint32_t) * 2 * (sn + tn));
+    uint32_t* sb = sa + sn;
+    uint32_t* mid = sb + tn;
+    mag_add(sa, a, m, a + m, a1n);
+    mag_add(sb, b, m, b + m, b1n);
+    mag_mul(mid, sa, sn, sb, tn);
+
+    // a0b0 and a1b1 go straight into their places in r
+    mag_mul(r, a, m, b, m);
+    mag_mul(r + 2 * m, a + m, a1n, b + m, b1n);
+    int midn = mag_sub(mid, mid, sn + tn, r, 2 * m);
+    midn = mag_sub(mid, mid, midn, r + 2 * m, a1n + b1n);
+    mag_add_at(r + m, mid, trim(mid, midn));
+    free(sa);
+}
+
+// q = a / k, giving back the remainder. q can be a
+static uint32_t mag_div_small(uint32_t* q, const uint32_t* a, int an, uint32_t k) {
+    uint64_t rem = 0;
+    for (int i = an - 1; i >= 0; i--) {
+        uint64_t cur = rem * BASE + a[i];
+        q[i] = cur / k;
+        rem = cur % k;
+    }
+    return rem;
+}
+
+// q = a / b and r = a % b, for b of at least two digits and no longer than
+// a (knuth's algorithm D). q has an - bn + 1 digits and r has bn
+static void mag_div(uint32_t* q, uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    // scaled so b's top digit is at least BASE / 2, a guess at each digit of
+    // q from the top two digits is never more than two too big
+    uint32_t k = BASE / (b[bn - 1] + 1);
+    uint32_t* u = malloc(sizeof(uint32_t) * (an + bn + 2));
+    uint32_t* v = u + an + 1;
+    mag_mul_small(u, a, an, k);
+    mag_mul_small(v, b, bn, k);
+
+    for (int j = an - bn; j >= 0; j--) {
+        uint64_t top = (uint64_t)u[j + bn] * BASE + u[j + bn - 1];
+        uint64_t qhat = top / v[bn - 1];
+        uint64_t rhat = top % v[bn - 1];
+        while (qhat >= BASE || qhat * v[bn - 2] > rhat * BASE + u[j + bn - 2]) {
+            qhat--;
+            rhat += v[bn - 1];
+            if (rhat >= BASE) { break; }
+        }
+
+        // u -= qhat * v, from digit j
+        uint64_t carry = 0;
+        int borrow = 0;
+        for (int i = 0; i < bn; i++) {
+            uint64_t p = qhat * v[i] + carry;
+            carry = p / BASE;
+            int64_t t = (int64_t)u[i + j] - (int64_t)(p % BASE) - borrow;
+            borrow = t < 0;
+            u[i + j] = borrow ? t + BASE : t;
+        }
+        int64_t t = (int64_t)u[j + bn] - (int64_t)carry - borrow;
+
+        // still one too big: add v back
+        if (t < 0) {
+            qhat--;
+            uint32_t c = 0;
+            for (int i = 0; i < bn; i++) {
+                uint32_t s = u[i + j] + v[i] + c;
+                c = s >= BASE;
+                u[i + j] = c ? s - BASE : s;
+            }
+            t += c;
+        }
+        u[j + bn] = t;
+        q[j] = qhat;
+    }
+
+    mag_div_small(r, u, bn, k);
+    free(u);
+}
+
+// x + sign * y
+static lval* add_signed(lval* x, lval* y, int sign) {
+    lmag a, b;
+    mag_of(x, &a);
+    mag_of(y, &b);
+    b.sign *= sign;
+
+    lbig* r = big_new((a.len > b.len ? a.len : b.len) + 1);
+    if (a.sign == b.sign) {
+        r->len = mag_add(r->d, a.d, a.len, b.d, b.len);
+        r->sign = a.sign;
+    } else if (mag_cmp(a.d, a.len, b.d, b.len) >= 0) {
+        r->len = mag_sub(r->d, a.d, a.len, b.d, b.len);
+        r->sign = a.sign;
+    } else {
+        r->len = mag_sub(r->d, b.d, b.len, a.d, a.len);
+        r->sign = b.sign;
+    }
+    return big_result(r);
+}
+
+lval* lbig_add(lval* x, lval* y) {
+    return add_signed(x, y, 1);
+}
+
+lval* lbig_sub(lval* x, lval* y) {
+    return add_signed(x, y, -1);
+}
+
+lval* lbig_mul(lval* x, lval* y) {
+    long n;
+    if (x->type == LVAL_NUM && y->type == LVAL_NUM && !__builtin_mul_overflow(x->num, y->num, &n)) {
+        return lval_num(n);
+    }
+
+    lmag a, b;
+    mag_of(x, &a);
+    mag_of(y, &b);
+    if (!a.len || !b.len) { return lval_num(0); }
+
+    lbig* r = big_new(a.len + b.len);
+    mag_mul(r->d, a.d, a.len, b.d, b.len);
+    r->sign = a.sign * b.sign;
+    return big_result(r);
+}
+
+static lval* divide(lval* x, lval* y, int rem) {
+    lmag a, b;
+    mag_of(x, &a);
+    mag_of(y, &b);
+    if (!b.len) { return lval_error(LERR_DIV_ZERO, "can't divide by zero"); }
+    if (mag_cmp(a.d, a.len, b.d, b.len) < 0) { return rem ? lval_copy(x) : lval_num(0); }
+
+    lbig* q = big_new(a.len - b.len + 1);
+    lbig* r = big_new(b.len);
+    if (b.len == 1) {
+        r->d[0] = mag_div_small(q->d, a.d, a.len, b.d[0]);
+    } else {
+        mag_div(q->d, r->d, a.d, a.len, b.d, b.len);
+    }
+    q->sign = a.sign * b.sign;
+    r->sign = a.sign;
+
+    if (rem) {
+        free(q);
+        return big_result(r);
+    }
+    free(r);
+    return big_result(q);
+}
+
+lval* lbig_div(lval* x, lval* y) {
+    return divide(x, y, 0);
+}
+
+lval* lbig_mod(lval* x, lval* y) {
+    return divide(x, y, 1);
+}
+
+lval* lbig_pow(lval* x, lval* y) {
+    lmag a;
+    mag_of(x, &a);
+    int ysign = y->type == LVAL_BIG ? y->big->sign : (y->num > 0) - (y->num < 0);
+    int yodd = y->type == LVAL_BIG ? y->big->d[0] & 1 : y->num & 1;
+
+    // 0, 1 and -1 come out the same however big y is
+    if (!a.len) {
+        if (ysign < 0) { return lval_error(LERR_DIV_ZERO, "can't divide by zero"); }
+        return lval_num(ysign == 0);
+    }
+    if (a.len == 1 && a.d[0] == 1) { return lval_num(a.sign < 0 && yodd ? -1 : 1); }
+    if (ysign < 0) { return lval_num(0); }
+
+    // roughly how many digits it'd take
+    double digits = a.len - 1 + log10(a.d[a.len - 1] + 1.0) / 9;
+    if (y->type == LVAL_BIG || digits * y->num > LBIG_MAX_DIGITS) {
+        return lval_error(LERR_BAD_NUM, "number too big");
+    }
+
+    // square and multiply
+    lval* r = lval_num(1);
+    lval* b = lval_copy(x);
+    for (unsigned long n = y->num; n; n >>= 1) {
+        if (n & 1) {
+            lval* t = lbig_mul(r, b);
+            lval_del(r);
+            r = t;
+        }
+        if (n > 1) {
+            lval* t = lbig_mul(b, b);
+            lval_del(b);
+            b = t;
+        }
+    }
+    lval_del(b);
+    return r;
+}
+
+lval* lbig_neg(lval* x) {
+    lmag a;
+    mag_of(x, &a);
+    lbig* r = big_new(a.len);
+    memcpy(r->d, a.d, sizeof(uint32_t) * a.len);
+    r->sign = -a.sign;
+    return big_result(r);
+}
+
+int lbig_cmp(lval* x, lval* y) {
+    if (x->type == LVAL_NUM && y->type == LVAL_NUM) {
+        return (x->num > y->num) - (x->num < y->num);
+    }
+
+    lmag a, b;
+    mag_of(x, &a);
+    mag_of(y, &b);
+    int as = a.len ? a.sign : 0;
+    int bs = b.len ? b.sign : 0;
+    if (as != bs) { return as < bs ? -1 : 1; }
+    int c = mag_cmp(a.d, a.len, b.d, b.len);
+    return as < 0 ? -c : c;
+}
+
+lval* lbig_read(char* s) {
+    while (isspace((unsigned char)*s)) { s++; }
+    int sign = 1;
+    if (*s == '-' || *s == '+') {
+        if (*s == '-') { sign = -1; }
+        s++;
+    }
+    while (*s == '0') { s++; }
+    int n = 0;
+    while (isdigit((unsigned char)s[n])) { n++; }
+
+    // nine decimal digits to a digit, from the end
+    lbig* b = big_new((n + 8) / 9);
+    b->sign = sign;
+    int len = 0;
+    for (int end = n; end > 0; end -= 9) {
+        uint32_t d = 0;
+        for (int i = end > 9 ? end - 9 : 0; i < end; i++) { d = d * 10 + (s[i] - '0'); }
+        b->d[len++] = d;
+    }
+    return big_result(b);
+}
+
+char* lbig_str(lbig* b) {
+    char* str = malloc(9 * (size_t)b->len + 2);
+    char* p = str;
+    if (b->sign < 0) { *p++ = '-'; }
+    p += sprintf(p, "%u", (unsigned)b->d[b->len - 1]);
+    for (int i = b->len - 2; i >= 0; i--) {
+        p += sprintf(p, "%09u", (unsigned)b->d[i]);
+    }
+    return str;
+}
@@ -0,0 +1,55 @@
+#ifndef LBIG_HEADER
+#define LBIG_HEADER
+#include <stdint.h>
+#include "lval.h"
+
+// integers too big for a long. numbers are plain longs (LVAL_NUM) until some
+// arithmetic on them overflows, and only then is the result an LVAL_BIG.
+// anything that fits in a long always goes back to being one, so every
+// number has just the one form: = can go by type, and a bignum is never 0.
+//
+// the digits are base 10^9, so printing and reading are just a matter of
+// splitting into groups of nine decimal digits. multiplying is by the book
+// for short numbers and karatsuba from LBIG_KARATSUBA digits up.
+#define LBIG_BASE 1000000000U
+#define LBIG_KARATSUBA 32
+// ^ won't make a number with more digits than this (about 150 million
+// decimal digits)
+#define LBIG_MAX_DIGITS (1 << 24)
+
+// the magnitude is d[0 .. len), least significant digit first, with no
+// zeros on the end. sign is 1 or -1. never changes once made, so copies of a
+// bignum share it
+struct lbig {
+    int refs;
+    int sign;
+    int len;
+    uint32_t d[];
+};
+
+lbig* lbig_retain(lbig* b);
+void lbig_release(lbig* b);
+// a copy that shares nothing with b, for another thread (see lchan.h)
+lbig* lbig_clone(lbig* b);
+
+// these take numbers of either kind, which stay the caller's, and give back
+// a new one. the builtins only come here once plain longs won't do
+lval* lbig_add(lval* x, lval* y);
+lval* lbig_sub(lval* x, lval* y);
+lval* lbig_mul(lval* x, lval* y);
+// an error for dividing by zero. both round towards zero, like c
+lval* lbig_div(lval* x, lval* y);
+lval* lbig_mod(lval* x, lval* y);
+// a negative power is a fraction, so it rounds to 0 (or 1 or -1, for those)
+lval* lbig_pow(lval* x, lval* y);
+lval* lbig_neg(lval* x);
+// less than 0, 0 or more than 0, like strcmp
+int lbig_cmp(lval* x, lval* y);
+
+// the number at the start of s (after any spaces, with an optional sign),
+// however long it is
+lval* lbig_read(char* s);
+// malloc'd decimal
+char* lbig_str(lbig* b);
+
+#endif
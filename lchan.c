@@ -0,0 +1,403 @@
+/// isolates and channels, see lchan.h
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "lchan.h"
+#include "builtin.h"
+#include "deeprose.h"
+#include "eval.h"
+#include "fold.h"
+#include "lbig.h"
+#include "lfile.h"
+#include "lseq.h"
+
+// (chan n) can't ask for more room than this
+#define LCHAN_MAX_CAPACITY (1 << 24)
+
+lchan* lchan_new(int capacity) {
+    lchan* c = malloc(sizeof(lchan));
+    c->refs = 1;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->readable, NULL);
+    pthread_cond_init(&c->writable, NULL);
+    c->items = malloc(sizeof(lval*) * capacity);
+    c->capacity = capacity;
+    c->head = 0;
+    c->count = 0;
+    c->waiters = NULL;
+    return c;
+}
+
+lchan* lchan_retain(lchan* c) {
+    __atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+    return c;
+}
+
+void lchan_release(lchan* c) {
+    if (__atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) != 0) { return; }
+
+    // nobody else has it, so nobody can be waiting on it
+    for (int i = 0; i < c->count; i++) {
+        lval_del(c->items[(c->head + i) % c->capacity]);
+    }
+    free(c->items);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->readable);
+    pthread_cond_destroy(&c->writable);
+    free(c);
+}
+
+// puts an exported value on the end of c, waiting for room
+static void lchan_put(lchan* c, lval* v) {
+    pthread_mutex_lock(&c->lock);
+    while (c->count == c->capacity) {
+        pthread_cond_wait(&c->writable, &c->lock);
+    }
+    c->items[(c->head + c->count) % c->capacity] = v;
+    c->count++;
+
+    pthread_cond_signal(&c->readable);
+    for (lwaitlink* l = c->waiters; l; l = l->next) {
+        pthread_mutex_lock(&l->w->lock);
+        l->w->woken = 1;
+        pthread_cond_signal(&l->w->ready);
+        pthread_mutex_unlock(&l->w->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// the oldest value on c, which has one. c must be locked
+static lval* lchan_take_locked(lchan* c) {
+    lval* v = c->items[c->head];
+    c->head = (c->head + 1) % c->capacity;
+    c->count--;
+    pthread_cond_signal(&c->writable);
+    return v;
+}
+
+static lval* lchan_take(lchan* c) {
+    pthread_mutex_lock(&c->lock);
+    while (!c->count) {
+        pthread_cond_wait(&c->readable, &c->lock);
+    }
+    lval* v = lchan_take_locked(c);
+    pthread_mutex_unlock(&c->lock);
+    return v;
+}
+
+static void lchan_unwait(lchan* c, lwaitlink* link) {
+    pthread_mutex_lock(&c->lock);
+    lwaitlink** l = &c->waiters;
+    while (*l != link) { l = &(*l)->next; }
+    *l = link->next;
+    pthread_mutex_unlock(&c->lock);
+}
+
+// the oldest value on whichever of cs has one first, with its index in *which.
+// every channel has a link to w while it's being waited on, so a send to any
+// of them wakes this up. w is only ever locked after a channel (never the
+// other way round), and gets checked before sleeping, so no wakeup is lost
+static lval* lchan_select(lchan** cs, int n, int* which) {
+    lwaiter w;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.ready, NULL);
+    lwaitlink* links = malloc(sizeof(lwaitlink) * n);
+
+    lval* v = NULL;
+    while (!v) {
+        w.woken = 0;
+        int linked = 0;
+        for (; linked < n; linked++) {
+            lchan* c = cs[linked];
+            pthread_mutex_lock(&c->lock);
+            if (c->count) {
+                v = lchan_take_locked(c);
+                *which = linked;
+                pthread_mutex_unlock(&c->lock);
+                break;
+            }
+            links[linked].w = &w;
+            links[linked].next = c->waiters;
+            c->waiters = &links[linked];
+            pthread_mutex_unlock(&c->lock);
+        }
+
+        if (!v) {
+            pthread_mutex_lock(&w.lock);
+            while (!w.woken) { pthread_cond_wait(&w.ready, &w.lock); }
+            pthread_mutex_unlock(&w.lock);
+        }
+        // whatever woke us might have been taken by someone else by now, in
+        // which case it's round again
+        for (int i = 0; i < linked; i++) { lchan_unwait(cs[i], &links[i]); }
+    }
+
+    free(links);
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.ready);
+    return v;
+}
+
+// whether v can go to another thread as it is: nothing in it is shared with
+// anything else
+static int lval_movable(lval* v) {
+    lwork w;
+    lwork_init(&w);
+    lwork_push(&w, v);
+    int movable = 1;
+    while (movable && w.count) {
+        v = w.items[--w.count];
+        switch (v->type) {
+            case LVAL_NUM: case LVAL_ERR: case LVAL_CHAN: break;
+            case LVAL_SYM: movable = !v->cache; break;
+            case LVAL_STR: movable = !v->map; break;
+            case LVAL_FUN: movable = v->builtin != NULL; break;
+            case LVAL_QEXPR:
+            case LVAL_SEXPR:
+                for (int i = 0; i < v->count; i++) { lwork_push(&w, v->cell[i]); }
+                break;
+            default: movable = 0; break;
+        }
+    }
+    lwork_free(&w);
+    return movable;
+}
+
+static lval* export_copy(lval* v);
+
+// a sequence's description, stage by stage, with a mapped file opened again
+// for a mapping of its own
+static lseq* export_seq(lseq* s) {
+    switch (s->kind) {
+        case LSEQ_RANGE: return lseq_range(s->start, s->end);
+        case LSEQ_LIST: return lseq_list(export_copy(s->list));
+        case LSEQ_LINES: return lseq_lines(s->map ? lmap_open(s->path) : NULL, s->path);
+    }
+    return lseq_stage(s->kind, s->inner ? export_seq(s->inner) : NULL,
+        s->fn ? export_copy(s->fn) : NULL, s->n);
+}
+
+static lval* export_one(lval* v, lwork* w) {
+    switch (v->type) {
+        case LVAL_SYM: return lval_sym(v->sym);
+        case LVAL_STR: return lval_str(v->str);
+        case LVAL_BIG: return lval_big(lbig_clone(v->big));
+        case LVAL_SEQ: return lval_seq(export_seq(v->seq));
+        // only the thread that started it can wait for it
+        case LVAL_PROC: return lval_err("Processes can't be sent between isolates");
+
+        case LVAL_FUN: {
+            if (v->builtin) { break; }
+            if (v->part) { return lval_partial(export_copy(v->part->fn), export_copy(v->part->args)); }
+
+            lval* f = lval_lambda(export_copy(v->formals), export_copy(v->body));
+            f->macro = v->macro;
+            for (int i = 0; i < v->env->count; i++) {
+                lval* k = lval_sym(v->env->syms[i]);
+                lval* x = export_copy(v->env->vals[i]);
+                lenv_put(f->env, k, x);
+                lval_del(k);
+                lval_del(x);
+            }
+            return f;
+        }
+
+        case LVAL_QEXPR:
+        case LVAL_SEXPR: {
+            lval* x = v->type == LVAL_QEXPR ? lval_qexpr() : lval_sexpr();
+            lval_reserve(x, v->count);
+            x->count = v->count;
+            if (x->count) {
+                lwork_push(w, v);
+                lwork_push(w, x);
+            }
+            return x;
+        }
+    }
+    return lval_copy(v);
+}
+
+// like lval_copy, but sharing nothing
+static lval* export_copy(lval* v) {
+    lwork w;
+    lwork_init(&w);
+    lval* x = export_one(v, &w);
+    while (w.count) {
+        lval* to = w.items[--w.count];
+        lval* from = w.items[--w.count];
+        for (int i = 0; i < from->count; i++) {
+            to->cell[i] = export_one(from->cell[i], &w);
+        }
+    }
+    lwork_free(&w);
+    return x;
+}
+
+lval* lval_export(lval* v) {
+    if (lval_movable(v)) { return v; }
+    lval* x = export_copy(v);
+    lval_del(v);
+    return x;
+}
+
+void lval_import(lenv* e, lval* v) {
+    lwork w;
+    lwork_init(&w);
+    lwork_push(&w, v);
+    while (w.count) {
+        v = w.items[--w.count];
+        switch (v->type) {
+            case LVAL_QEXPR:
+            case LVAL_SEXPR:
+                for (int i = 0; i < v->count; i++) { lwork_push(&w, v->cell[i]); }
+                break;
+
+            case LVAL_SEQ:
+                for (lseq* s = v->seq; s; s = s->inner) {
+                    if (s->fn) { lwork_push(&w, s->fn); }
+                    if (s->list) { lwork_push(&w, s->list); }
+                }
+                break;
+
+            case LVAL_FUN:
+                if (v->part) {
+                    lwork_push(&w, v->part->fn);
+                    lwork_push(&w, v->part->args);
+                } else if (!v->builtin) {
+                    for (int i = 0; i < v->formals->count; i++) {
+                        lenv_note_local(e, v->formals->cell[i]);
+                    }
+                    lval_add_caches(v->body);
+                    lval_fold_lambda(v);
+                    for (int i = 0; i < v->env->count; i++) { lwork_push(&w, v->env->vals[i]); }
+                }
+                break;
+        }
+    }
+    lwork_free(&w);
+}
+
+// an isolate about to start: its interpreter, all set up, and what to call
+typedef struct {
+    deeprose* d;
+    lval* f;
+    lval* args;
+    lchan* result;
+} lisolate;
+
+static void* isolate_main(void* arg) {
+    lisolate* iso = arg;
+    lenv* e = iso->d->env;
+
+    lquota q;
+    lquota_begin(iso->d, &q, iso->d->limits);
+    lval* r = lval_call_take(e, iso->f, iso->args);
+    r = lval_realize(e, r);
+    lquota_end(iso->d, &q);
+    lchan_put(iso->result, lval_export(r));
+
+    lchan_release(iso->result);
+    deeprose_del(iso->d);
+    eval_thread_done();
+    free(iso);
+    return NULL;
+}
+
+lval* builtin_spawn(lenv* e, lval* a) {
+    if (a->count < 1) {
+        lval* err = lval_error(LERR_ARGS, "Function 'spawn' passed incorrect number of args | got %d, expected at least %d",
+            a->count, 1);
+        lval_del(a);
+        return err;
+    }
+    LASSERT_ARGS_TYPE("spawn", a, 0, LVAL_FUN);
+
+    // everything the isolate gets is made here, where it's safe to read the
+    // caller's values, and only handed over to the new thread once it's done
+    deeprose* from = lenv_interp(e);
+    deeprose* d = deeprose_new();
+    d->out = from->out;
+    d->jit = from->jit;
+    d->stack_limit = from->stack_limit;
+    d->limits = from->limits;
+    for (int i = 0; i < from->macros->count; i++) {
+        lval* k = lval_sym(from->macros->syms[i]);
+        lenv_put(d->macros, k, from->macros->vals[i]);
+        lval_del(k);
+    }
+    for (int i = 0; i < from->env->count; i++) {
+        lval* k = lval_sym(from->env->syms[i]);
+        lval* v = export_copy(from->env->vals[i]);
+        lval_import(d->env, v);
+        lenv_put(d->env, k, v);
+        lval_del(k);
+        lval_del(v);
+    }
+
+    lisolate* iso = malloc(sizeof(lisolate));
+    iso->d = d;
+    iso->f = lval_export(lval_pop(a, 0));
+    iso->args = lval_export(a);
+    lval_import(d->env, iso->f);
+    lval_import(d->env, iso->args);
+    iso->result = lchan_new(1);
+    lval* result = lval_chan(lchan_retain(iso->result));
+
+    pthread_t t;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int failed = pthread_create(&t, &attr, isolate_main, iso);
+    pthread_attr_destroy(&attr);
+    if (failed) {
+        lval_del(iso->f);
+        lval_del(iso->args);
+        lchan_release(iso->result);
+        deeprose_del(d);
+        free(iso);
+        lval_del(result);
+        return lval_err("Function 'spawn' couldn't start a thread");
+    }
+    return result;
+}
+
+lval* builtin_chan(lenv* e, lval* a) {
+    long n = a->cell[0]->num;
+    LASSERT(a, n >= 1 && n <= LCHAN_MAX_CAPACITY,
+        "Function 'chan' passed a capacity of %li, expected 1 to %d", n, LCHAN_MAX_CAPACITY);
+    lval_del(a);
+    return lval_chan(lchan_new(n));
+}
+
+lval* builtin_send(lenv* e, lval* a) {
+    lchan* c = lchan_retain(a->cell[0]->chan);
+    lval* v = lval_pop(a, 1);
+    lval_del(a);
+    lchan_put(c, lval_export(v));
+    lchan_release(c);
+    return lval_sexpr();
+}
+
+lval* builtin_recv(lenv* e, lval* a) {
+    lchan* c = lchan_retain(a->cell[0]->chan);
+    lval_del(a);
+    lval* v = lchan_take(c);
+    lchan_release(c);
+    lval_import(e, v);
+    return v;
+}
+
+lval* builtin_select(lenv* e, lval* a) {
+    LASSERT(a, a->count >= 1, "Function 'select' passed no channels");
+
+    lchan** cs = malloc(sizeof(lchan*) * a->count);
+    for (int i = 0; i < a->count; i++) { cs[i] = a->cell[i]->chan; }
+    int which;
+    lval* v = lchan_select(cs, a->count, &which);
+    free(cs);
+    lval_del(a);
+
+    lval_import(e, v);
+    return lval_add(lval_add(lval_qexpr(), lval_num(which)), v);
+}
@@ -0,0 +1,63 @@
+#ifndef LCHAN_HEADER
+#define LCHAN_HEADER
+#include <pthread.h>
+#include "lval.h"
+
+// isolates and channels. (spawn f args...) runs (f args...) in an isolate: a
+// new interpreter on a thread of its own, which starts out with a copy of
+// every global the caller has, so the prelude and whatever f calls are there.
+// isolates share nothing, and only talk through channels.
+//
+// (chan n) is a channel holding up to n values. (send c x) puts x on the end,
+// waiting while it's full, and (recv c) takes the oldest one off, waiting
+// while it's empty. (select c...) waits on several at once and gives back
+// '(i x), x having come off the i'th of them. spawn gives back a channel that
+// the isolate's result (or error) is sent on once it's done, so
+// (recv (spawn f)) waits for it.
+//
+// nothing reference counted (sequences, call site caches, folded bodies,
+// partial applications, mapped files, bignums) can be touched from two
+// threads, so a value has to leave all of that behind to cross over: see
+// lval_export. channels are the one thing isolates do share, and count their
+// references atomically.
+
+// a select waiting on a channel, so a send to it can wake the select up
+typedef struct lwaiter {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int woken;
+} lwaiter;
+
+typedef struct lwaitlink {
+    lwaiter* w;
+    struct lwaitlink* next;
+} lwaitlink;
+
+struct lchan {
+    int refs;
+    pthread_mutex_t lock;
+    pthread_cond_t readable;
+    pthread_cond_t writable;
+    // a ring of capacity values, the oldest count of them from head on.
+    // every one is from lval_export
+    lval** items;
+    int capacity;
+    int head;
+    int count;
+    lwaitlink* waiters;
+};
+
+lchan* lchan_new(int capacity);
+lchan* lchan_retain(lchan* c);
+void lchan_release(lchan* c);
+
+// v (which this takes) as a value sharing nothing with the interpreter it
+// came from. plain data with nothing shared in it is moved as it is, and
+// anything else copied: functions get bodies of their own without caches,
+// and sequences descriptions of their own, so they stay lazy
+lval* lval_export(lval* v);
+// sets an exported value up to be used in e's interpreter, the way \ would
+// have: formals noted as locals, bodies given call site caches
+void lval_import(lenv* e, lval* v);
+
+#endif
@@ -1,5 +1,7 @@
 /// all the lisp environment functions
+#include <limits.h>
 #include "lenv.h"
+#include "deeprose.h"
 
 // new environment
 lenv* lenv_new(void) {
@@ -8,11 +10,22 @@ lenv* lenv_new(void) {
     e->count = 0;
     e->syms = NULL;
     e->vals = NULL;
+    e->interp = NULL;
+    e->own = 0;
+    e->names = 0;
     return e;
 }
 
+// the global env is the one with no parent that an interpreter owns
+static int lenv_is_global(lenv* e) {
+    return !e->parent && e->interp;
+}
+
 // delete environment
 void lenv_del(lenv* e) {
+    // caches might be pointing into it
+    if (lenv_is_global(e)) { e->interp->version++; }
+
     for (int i = 0; i < e->count; i++) {
         free(e->syms[i]);
         lval_del(e->vals[i]);
@@ -22,45 +35,109 @@ void lenv_del(lenv* e) {
     free(e);
 }
 
+// the value bound to sym (not a copy), or NULL. where gets the env it was found in
+lval* lenv_find(lenv* e, char* sym, lenv** where) {
+    for (; e; e = e->parent) {
+        // checks if any items match sym in the lenv e
+        for (int i = 0; i < e->count; i++) {
+            if (strcmp(e->syms[i], sym) == 0) {
+                if (where) { *where = e; }
+                return e->vals[i];
+            }
+        }
+    }
+    return NULL;
+}
+
 // get a symbol's value from the environment. 
 // returns an LVAL_ERR if it cant find it
 lval* lenv_get(lenv* e, lval* key) {
-    // checks if any items match k in the lenv e 
-    for (int i = 0; i < e->count; i++) {
-        if (strcmp(e->syms[i], key->sym) == 0) {
-            return lval_copy(e->vals[i]);
-        }
+    lval* v = lenv_find(e, key->sym, NULL);
+    return v ? lval_copy(v) : lval_error(LERR_UNBOUND, "Unbound symbol %s", key->sym);
+}
+
+// lenv_get for a symbol with a call site cache. a hit skips walking the
+// whole chain of environments (which with dynamic scope is as deep as the
+// call stack) and every strcmp on the way. a global that shares its name
+// with some local only hits when no env on the way up could bind it
+lval* lenv_get_cached(lenv* e, lval* key) {
+    lcache* c = key->cache;
+    deeprose* d = e->interp;
+    if (d && c->interp == d && c->version == d->version
+        && (!c->local || !((e->names | d->rebound) & c->bit))) {
+        return lval_copy(c->val);
     }
 
-    // if there isn't a symbol we can check the parent otherwise return an error
-    return (e->parent) ? lenv_get(e->parent, key) : lval_err("Unbound symbol %s", key->sym);
+    // nothing on the way up binds the name, so it can only be a global
+    lenv* where;
+    int global = d && !((e->names | d->rebound) & c->bit);
+    lval* v = lenv_find(global ? d->env : e, key->sym, &where);
+    if (!v) { return lval_error(LERR_UNBOUND, "Unbound symbol %s", key->sym); }
+
+    // only globals are worth remembering
+    if (d && where == d->env) {
+        c->interp = d;
+        c->version = d->version;
+        c->val = v;
+        c->local = lenv_find(d->locals, key->sym, NULL) != NULL;
+    }
+    return lval_copy(v);
 }
 
-// binds a symbol to a value
-void lenv_put(lenv* e, lval* key, lval* value) {
+// remember that key can be bound in a local env (a lambda's formal, or a
+// `let` inside a function). the first time a name turns up here, caches
+// that skipped straight to a global of that name can't be trusted any more
+void lenv_note_local(lenv* e, lval* key) {
+    deeprose* d = lenv_interp(e);
+    if (!d || lenv_find(d->locals, key->sym, NULL)) { return; }
+
+    lval* yes = lval_num(1);
+    lenv_put(d->locals, key, yes);
+    lval_del(yes);
+    d->version++;
+}
+
+// binds a symbol to value, which this takes
+void lenv_put_take(lenv* e, lval* key, lval* value) {
+    if (lenv_is_global(e)) { e->interp->version++; }
+
     // check if variable already exists
     for (int i = 0; i < e->count; i++) {
         // if so, delete the old version to not get weird indexing issues
         if (strcmp(e->syms[i], key->sym) == 0) {
             lval_del(e->vals[i]);
-            e->vals[i] = lval_copy(value);
+            e->vals[i] = value;
+            return;
         }
     }
 
     // if not we have to allocate everything and such
+    if (!lenv_is_global(e)) {
+        unsigned long bit = lenv_bit(key->sym);
+        e->own |= bit;
+        e->names |= bit;
+    }
     e->count++;
     e->vals = realloc(e->vals, sizeof(lval*) * e->count);
     e->syms = realloc(e->syms, sizeof(char*) * e->count);
 
-    e->vals[e->count - 1] = lval_copy(value);
+    e->vals[e->count - 1] = value;
     e->syms[e->count - 1] = malloc(strlen(key->sym) + 1);
     strcpy(e->syms[e->count - 1], key->sym);
 }
 
+// binds a symbol to a copy of a value
+void lenv_put(lenv* e, lval* key, lval* value) {
+    lenv_put_take(e, key, lval_copy(value));
+}
+
 lenv* lenv_copy(lenv* e) {
     lenv* new = malloc(sizeof(lenv));
     new->parent = e->parent;
+    new->interp = e->interp;
     new->count = e->count;
+    new->own = e->own;
+    new->names = e->names;
     new->syms = malloc(sizeof(char*) * new->count);
     new->vals = malloc(sizeof(lval*) * new->count);
     for (int i = 0; i < e->count; i++) {
@@ -77,4 +154,46 @@ lenv* lenv_copy(lenv* e) {
 void lenv_def(lenv* e, lval* key, lval* value) {
     while (e->parent) { e = e->parent; }
     lenv_put(e, key, value);
-}
\ No newline at end of file
+}
+
+// puts e under parent, as the env a call runs in
+void lenv_set_parent(lenv* e, lenv* parent) {
+    e->parent = parent;
+    e->interp = parent->interp;
+    e->names = e->own | parent->names;
+}
+
+// a name's bit in lenv's names. different names can share one, which only
+// means a lookup walks the envs when it didn't have to
+unsigned long lenv_bit(char* sym) {
+    unsigned long h = 5381;
+    while (*sym) { h = h * 33 + (unsigned char)*sym++; }
+    return 1UL << (h % (sizeof(unsigned long) * CHAR_BIT));
+}
+
+// the interpreter that owns e, found through its global environment
+deeprose* lenv_interp(lenv* e) {
+    if (e->interp) { return e->interp; }
+    while (e->parent) { e = e->parent; }
+    return e->interp;
+}
+
+lcache* lcache_new(char* sym) {
+    lcache* c = malloc(sizeof(lcache));
+    c->refs = 1;
+    c->interp = NULL;
+    c->version = 0;
+    c->val = NULL;
+    c->local = 0;
+    c->bit = lenv_bit(sym);
+    return c;
+}
+
+lcache* lcache_retain(lcache* c) {
+    c->refs++;
+    return c;
+}
+
+void lcache_release(lcache* c) {
+    if (c && --c->refs == 0) { free(c); }
+}
@@ -2,11 +2,40 @@
 #define LENV_HEADER
 #include "lval.h"
 
+// a call site's memory of which global a symbol resolved to. it's only good
+// while the interpreter's version hasn't moved on: the version goes up when
+// anything in the global env is (re)defined or the env is thrown away, and
+// when a name first becomes something a local env can bind, since with
+// dynamic scope that local could then shadow the global
+struct lcache {
+    int refs;
+    deeprose* interp;
+    unsigned long version;
+    // borrowed from the global env
+    lval* val;
+    // whether the name has been a local too, so the global is only right
+    // when no env on the way up binds it
+    int local;
+    // lenv_bit of the name
+    unsigned long bit;
+};
+
 lenv* lenv_new(void);
 void lenv_del(lenv* e);
 lval* lenv_get(lenv* e, lval* key);
+lval* lenv_find(lenv* e, char* sym, lenv** where);
 void lenv_put(lenv* e, lval* key, lval* value);
+void lenv_put_take(lenv* e, lval* key, lval* value);
 lenv* lenv_copy(lenv* e);
 void lenv_def(lenv* e, lval* key, lval* value);
+void lenv_set_parent(lenv* e, lenv* parent);
+unsigned long lenv_bit(char* sym);
+deeprose* lenv_interp(lenv* e);
+lval* lenv_get_cached(lenv* e, lval* key);
+void lenv_note_local(lenv* e, lval* key);
+
+lcache* lcache_new(char* sym);
+lcache* lcache_retain(lcache* c);
+void lcache_release(lcache* c);
 
 #endif
\ No newline at end of file
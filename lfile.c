@@ -0,0 +1,594 @@
+/// files, see lfile.h
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lfile.h"
+#include "builtin.h"
+#include "lseq.h"
+#include "lbig.h"
+
+// writes go through a buffer this big
+#define LFILE_WRITE_BUFFER (1 << 16)
+
+lmap* lmap_open(char* path) {
+    // checked before opening, since opening a fifo would wait for a writer
+    struct stat st;
+    if (stat(path, &st) < 0) { return NULL; }
+    if (!S_ISREG(st.st_mode)) {
+        errno = S_ISDIR(st.st_mode) ? EISDIR : ENODEV;
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return NULL; }
+
+    // zeroed pages with the file mapped over the start of them. whatever's
+    // past the end of the file reads as 0, even when it ends on a page
+    // boundary
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = st.st_size;
+    size_t mapped = (size / page + 1) * page;
+    char* data = mmap(NULL, mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (size && mmap(data, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        int saved = errno;
+        munmap(data, mapped);
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    // the mapping keeps the file open
+    close(fd);
+
+    lmap* m = malloc(sizeof(lmap));
+    m->refs = 1;
+    m->data = data;
+    m->size = size;
+    m->mapped = mapped;
+    return m;
+}
+
+lmap* lmap_retain(lmap* m) {
+    m->refs++;
+    return m;
+}
+
+void lmap_release(lmap* m) {
+    if (!m || --m->refs) { return; }
+    munmap(m->data, m->mapped);
+    free(m);
+}
+
+lval* lmap_line(lmap* m, size_t* pos) {
+    if (*pos >= m->size) { return NULL; }
+
+    char* start = m->data + *pos;
+    char* end = memchr(start, '\n', m->size - *pos);
+    size_t len = end ? (size_t)(end - start) : m->size - *pos;
+    *pos += len + (end != NULL);
+
+    char* str = malloc(len + 1);
+    memcpy(str, start, len);
+    str[len] = '\0';
+    lval* x = lval_str(str);
+    free(str);
+    return x;
+}
+
+// the whole of f, in a malloc'd buffer with a 0 after it
+static char* read_all(FILE* f, size_t* size) {
+    size_t n = 0;
+    size_t capacity = 4096;
+    char* buf = malloc(capacity);
+    size_t got;
+    while ((got = fread(buf + n, 1, capacity - n - 1, f)) > 0) {
+        n += got;
+        if (capacity - n - 1 == 0) {
+            capacity *= 2;
+            buf = realloc(buf, capacity);
+        }
+    }
+    buf[n] = '\0';
+    *size = n;
+    return buf;
+}
+
+// the contents of path for func to go through: *m is the mapping of it or,
+// when it's not something we can map, NULL with the contents read into *data
+// instead, for the caller to free. NULL if that worked, otherwise the error
+static lval* read_whole(char* func, char* path, lmap** m, char** data, size_t* size) {
+    *m = lmap_open(path);
+    if (*m) {
+        *data = (*m)->data;
+        *size = (*m)->size;
+        return NULL;
+    }
+    FILE* f = errno == ENODEV ? fopen(path, "r") : NULL;
+    if (!f) { return lval_err("Function '%s' couldn't read '%s' | %s", func, path, strerror(errno)); }
+    *data = read_all(f, size);
+    fclose(f);
+    return NULL;
+}
+
+// done with what read_whole gave back
+static void read_done(lmap* m, char* data) {
+    if (m) { lmap_release(m); } else { free(data); }
+}
+
+// (read-file path) is the whole file as a string. a regular file isn't
+// copied, the string is the mapping
+lval* builtin_read_file(lenv* e, lval* a) {
+    lmap* m;
+    char* data;
+    size_t size;
+    lval* x = read_whole("read-file", a->cell[0]->str, &m, &data, &size);
+    if (!x && m) {
+        x = lval_str_map(m);
+    } else if (!x) {
+        x = lval_str(data);
+        free(data);
+    }
+    lval_del(a);
+    return x;
+}
+
+// (lines path) lazily goes through a file a line at a time, without the \n
+lval* builtin_lines(lenv* e, lval* a) {
+    char* path = a->cell[0]->str;
+    lmap* m = lmap_open(path);
+    if (!m && errno != ENODEV) {
+        lval* err = lval_err("Function 'lines' couldn't read '%s' | %s", path, strerror(errno));
+        lval_del(a);
+        return err;
+    }
+    // it's read front to back, so the kernel can read ahead and drop pages
+    // we're done with
+    if (m && m->size) { madvise(m->data, m->size, MADV_SEQUENTIAL); }
+
+    lval* x = lval_seq(lseq_lines(m, path));
+    lval_del(a);
+    return x;
+}
+
+// (write-file path x) and (append-file path x). a string is written as it
+// is; a list or sequence of strings gets a line each, like lines reads them
+static lval* builtin_write(lenv* e, lval* a, char* func, char* mode) {
+    char* path = a->cell[0]->str;
+    FILE* f = fopen(path, mode);
+    if (!f) {
+        lval* err = lval_err("Function '%s' couldn't open '%s' | %s", func, path, strerror(errno));
+        lval_del(a);
+        return err;
+    }
+    setvbuf(f, NULL, _IOFBF, LFILE_WRITE_BUFFER);
+
+    lval* result = NULL;
+    if (a->cell[1]->type == LVAL_STR) {
+        fputs(a->cell[1]->str, f);
+    } else {
+        lval* coll = lval_pop(a, 1);
+        lseq* s = coll->type == LVAL_SEQ ? lseq_retain(coll->seq) : lseq_list(coll);
+        if (coll->type == LVAL_SEQ) { lval_del(coll); }
+
+        lseq_iter* it = lseq_iter_new(s);
+        lval* x;
+        while (!result && (x = lseq_next(e, it))) {
+            if (x->type == LVAL_ERR) {
+                result = x;
+                break;
+            }
+            if (x->type != LVAL_STR) {
+                result = lval_err("Function '%s' passed incorrect type | got %s in the list, expected %s",
+                    func, ltype_name(x->type), ltype_name(LVAL_STR));
+            } else {
+                fputs(x->str, f);
+                fputc('\n', f);
+            }
+            lval_del(x);
+        }
+        lseq_iter_del(it);
+        lseq_release(s);
+    }
+
+    // the buffer only gets written out now, so this is where a full disk shows
+    if (fclose(f) != 0 && !result) {
+        result = lval_err("Function '%s' couldn't write '%s' | %s", func, path, strerror(errno));
+    }
+    lval_del(a);
+    return result ? result : lval_sexpr();
+}
+
+lval* builtin_write_file(lenv* e, lval* a) {
+    return builtin_write(e, a, "write-file", "w");
+}
+
+lval* builtin_append_file(lenv* e, lval* a) {
+    return builtin_write(e, a, "append-file", "a");
+}
+
+// read-csv goes through a file a word (8 bytes) at a time, looking for the
+// bytes that end a field
+#define LCSV_ONES 0x0101010101010101ULL
+#define LCSV_HIGHS 0x8080808080808080ULL
+
+// nonzero if any of w's bytes is 0
+static inline uint64_t word_has_zero(uint64_t w) {
+    return (w - LCSV_ONES) & ~w & LCSV_HIGHS;
+}
+
+// where read-csv is up to in a file
+typedef struct {
+    char* p;
+    char* end;
+    char delim;
+    // a quoted field with "" in it, unescaped
+    char* buf;
+    size_t capacity;
+    // whether the field just read was quoted
+    int quoted;
+} lcsv;
+
+// how a field ends: with a delimiter and another field to come, at the end of
+// the row, or with something that can't be read as csv
+enum { LCSV_NEXT, LCSV_ROW, LCSV_BAD };
+
+// the first delimiter, quote, \n or \r from p on, or the end
+static char* csv_scan(lcsv* c, char* p) {
+    uint64_t delims = LCSV_ONES * (unsigned char)c->delim;
+    while (c->end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        if (word_has_zero(w ^ delims) | word_has_zero(w ^ (LCSV_ONES * '"'))
+            | word_has_zero(w ^ (LCSV_ONES * '\n')) | word_has_zero(w ^ (LCSV_ONES * '\r'))) {
+            break;
+        }
+        p += 8;
+    }
+    while (p < c->end && *p != c->delim && *p != '"' && *p != '\n' && *p != '\r') { p++; }
+    return p;
+}
+
+// adds the n chars at s to the unescaped field in c->buf, *len long so far
+static void csv_keep(lcsv* c, size_t* len, char* s, size_t n) {
+    if (*len + n > c->capacity) {
+        c->capacity = (*len + n) * 2;
+        c->buf = realloc(c->buf, c->capacity);
+    }
+    memcpy(c->buf + *len, s, n);
+    *len += n;
+}
+
+// the next field from c->p, its text in *s and *n (pointing into the file or
+// c->buf), moving c->p past it and whatever ends it. fields can be quoted,
+// with "" for a quote, and then have delimiters and newlines in them
+static int csv_field(lcsv* c, char** s, size_t* n) {
+    char* p = c->p;
+    c->quoted = p < c->end && *p == '"';
+    if (c->quoted) {
+        char* start = ++p;
+        size_t len = 0;
+        int escaped = 0;
+        for (;;) {
+            char* q = memchr(p, '"', c->end - p);
+            if (!q) { return LCSV_BAD; }
+            if (q + 1 == c->end || q[1] != '"') {
+                if (escaped) { csv_keep(c, &len, p, q - p); }
+                *s = escaped ? c->buf : start;
+                *n = escaped ? len : (size_t)(q - start);
+                p = q + 1;
+                break;
+            }
+            csv_keep(c, &len, p, q + 1 - p);
+            escaped = 1;
+            p = q + 2;
+        }
+    } else {
+        // a quote partway through a field is just part of it
+        char* q = csv_scan(c, p);
+        while (q < c->end && *q == '"') { q = csv_scan(c, q + 1); }
+        *s = p;
+        *n = q - p;
+        p = q;
+    }
+
+    if (p == c->end) {
+        c->p = p;
+        return LCSV_ROW;
+    }
+    if (*p == c->delim) {
+        c->p = p + 1;
+        return LCSV_NEXT;
+    }
+    if (*p == '\n' || *p == '\r') {
+        if (*p == '\r' && p + 1 < c->end && p[1] == '\n') { p++; }
+        c->p = p + 1;
+        return LCSV_ROW;
+    }
+    // something after a closing quote
+    return LCSV_BAD;
+}
+
+// skips blank lines, giving back whether there's another row
+static int csv_row(lcsv* c) {
+    while (c->p < c->end && (*c->p == '\n' || *c->p == '\r')) { c->p++; }
+    return c->p < c->end;
+}
+
+// what a field is as a number
+enum { LCSV_STR, LCSV_NUM, LCSV_BIG };
+
+// the value of the 8 digits at s, or -1 if they aren't all digits
+static long csv_digits8(char* s) {
+    uint64_t w;
+    memcpy(&w, s, 8);
+    // every byte 0x30 to 0x39
+    if ((w & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL
+        || ((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL) {
+        return -1;
+    }
+    w -= 0x3030303030303030ULL;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    // the first digit is the lowest byte. pairs, then fours, then all eight
+    w = (w * 10 + (w >> 8)) & 0x00FF00FF00FF00FFULL;
+    w = (w * 100 + (w >> 16)) & 0x0000FFFF0000FFFFULL;
+    w = (w * 10000 + (w >> 32)) & 0xFFFFFFFFULL;
+    return (long)w;
+}
+
+// whether the n chars at s are an integer: LCSV_NUM with it in *x if it has
+// no more than 18 digits, so it can't overflow, LCSV_BIG if it's longer
+static int csv_num(char* s, size_t n, long* x) {
+    size_t i = n && (*s == '-' || *s == '+');
+    if (i == n) { return LCSV_STR; }
+    if (n - i > 18) {
+        for (; i < n; i++) {
+            if (s[i] < '0' || s[i] > '9') { return LCSV_STR; }
+        }
+        return LCSV_BIG;
+    }
+
+    long v = 0;
+    for (; n - i >= 8; i += 8) {
+        long d = csv_digits8(s + i);
+        if (d < 0) { return LCSV_STR; }
+        v = v * 100000000L + d;
+    }
+    for (; i < n; i++) {
+        if (s[i] < '0' || s[i] > '9') { return LCSV_STR; }
+        v = v * 10 + (s[i] - '0');
+    }
+    *x = *s == '-' ? -v : v;
+    return LCSV_NUM;
+}
+
+// the value of a field: a number if typed and it's an integer that wasn't
+// quoted, otherwise a string
+static lval* csv_value(lcsv* c, char* s, size_t n, int typed) {
+    long x;
+    int kind = typed && !c->quoted ? csv_num(s, n, &x) : LCSV_STR;
+    if (kind == LCSV_NUM) { return lval_num(x); }
+    if (kind == LCSV_STR) { return lval_str_n(s, n); }
+
+    char* str = malloc(n + 1);
+    memcpy(str, s, n);
+    str[n] = '\0';
+    lval* v = lbig_read(str);
+    free(str);
+    return v;
+}
+
+// the error for row not being csv
+static lval* csv_bad(int row) {
+    return lval_err("Function 'read-csv' couldn't read row %d | a quote isn't closed, or is followed by more of the field", row);
+}
+
+// skips the rest of the row, for a header
+static int csv_skip_row(lcsv* c) {
+    char* s;
+    size_t n;
+    int r;
+    while ((r = csv_field(c, &s, &n)) == LCSV_NEXT) {}
+    return r;
+}
+
+// every row, each a list of its fields typed one by one
+static lval* csv_rows(lcsv* c, int header) {
+    lval* rows = lval_qexpr();
+    int width = 0;
+    for (int row = 1; csv_row(c); row++) {
+        if (row == 1 && header) {
+            if (csv_skip_row(c) == LCSV_BAD) {
+                lval_del(rows);
+                return csv_bad(row);
+            }
+            continue;
+        }
+        lval* x = lval_qexpr();
+        lval_reserve(x, width);
+        char* s;
+        size_t n;
+        int r;
+        do {
+            r = csv_field(c, &s, &n);
+            if (r == LCSV_BAD) {
+                lval_del(x);
+                lval_del(rows);
+                return csv_bad(row);
+            }
+            x = lval_add(x, csv_value(c, s, n, 1));
+        } while (r == LCSV_NEXT);
+        width = x->count;
+        rows = lval_add(rows, x);
+    }
+    return rows;
+}
+
+// a list for each column, of numbers if everything in it is an integer,
+// otherwise strings. it takes two passes, one to find that out, and then
+// one to make the values
+static lval* csv_columns(lcsv* c, int header) {
+    char* start = c->p;
+    int width = -1;
+    int rows = 0;
+    char* numeric = NULL;
+    lval* err = NULL;
+    for (int row = 1; !err && csv_row(c); row++) {
+        if (row == 1 && header) {
+            if (csv_skip_row(c) == LCSV_BAD) { err = csv_bad(row); }
+            continue;
+        }
+        char* s;
+        size_t n;
+        int r;
+        int i = 0;
+        do {
+            r = csv_field(c, &s, &n);
+            if (r == LCSV_BAD) {
+                err = csv_bad(row);
+                break;
+            }
+            if (width < 0) {
+                numeric = realloc(numeric, i + 1);
+                numeric[i] = 1;
+            }
+            // fields past the first row's width make it an error below
+            long x;
+            if ((i < width || width < 0) && (c->quoted || csv_num(s, n, &x) == LCSV_STR)) { numeric[i] = 0; }
+            i++;
+        } while (r == LCSV_NEXT);
+        if (width < 0) { width = i; }
+        if (!err && i != width) {
+            err = lval_err("Function 'read-csv' couldn't read row %d into columns | it has %d fields, but the first row has %d",
+                row, i, width);
+        }
+        rows++;
+    }
+    if (err) {
+        free(numeric);
+        return err;
+    }
+
+    lval* cols = lval_qexpr();
+    lval_reserve(cols, width > 0 ? width : 0);
+    for (int i = 0; i < width; i++) {
+        lval* col = lval_qexpr();
+        lval_reserve(col, rows);
+        cols->cell[cols->count++] = col;
+    }
+    c->p = start;
+    for (int row = 1; csv_row(c); row++) {
+        if (row == 1 && header) {
+            csv_skip_row(c);
+            continue;
+        }
+        char* s;
+        size_t n;
+        for (int i = 0; i < width; i++) {
+            csv_field(c, &s, &n);
+            lval* col = cols->cell[i];
+            col->cell[col->count++] = csv_value(c, s, n, numeric[i]);
+        }
+    }
+    free(numeric);
+    return cols;
+}
+
+// (read-csv path) reads a csv file into a list of its rows, and
+// (read-csv path '(columns 1 header 1 delimiter ";")) with any of those
+lval* builtin_read_csv(lenv* e, lval* a) {
+    LASSERT(a, a->count == 1 || a->count == 2,
+        "Function 'read-csv' passed incorrect number of args | got %d, expected 1 or 2", a->count);
+    LASSERT_ARGS_TYPE("read-csv", a, 0, LVAL_STR);
+
+    int columns = 0;
+    int header = 0;
+    char delim = ',';
+    if (a->count == 2) {
+        LASSERT_ARGS_TYPE("read-csv", a, 1, LVAL_QEXPR);
+        lval* spec = a->cell[1];
+        LASSERT(a, spec->count % 2 == 0,
+            "Function 'read-csv' passed %d values as options, expected pairs of a name and a value", spec->count);
+        for (int i = 0; i < spec->count; i += 2) {
+            lval* k = spec->cell[i];
+            lval* v = spec->cell[i + 1];
+            LASSERT(a, k->type == LVAL_SYM,
+                "Function 'read-csv' passed incorrect type for an option's name | got %s, expected %s",
+                ltype_name(k->type), ltype_name(LVAL_SYM));
+
+            if (strcmp(k->sym, "columns") == 0 || strcmp(k->sym, "header") == 0) {
+                LASSERT(a, v->type == LVAL_NUM,
+                    "Function 'read-csv' passed a bad %s, expected a Number", k->sym);
+                if (k->sym[0] == 'c') { columns = v->num != 0; } else { header = v->num != 0; }
+            } else if (strcmp(k->sym, "delimiter") == 0) {
+                LASSERT(a, v->type == LVAL_STR && strlen(v->str) == 1 && !strchr("\"\r\n", v->str[0]),
+                    "Function 'read-csv' passed a bad delimiter, expected a String of one character other than a quote or newline");
+                delim = v->str[0];
+            } else {
+                LASSERT(a, 0, "Function 'read-csv' passed an unknown option %s, expected columns, header or delimiter", k->sym);
+            }
+        }
+    }
+
+    lmap* m;
+    char* data;
+    size_t size;
+    lval* err = read_whole("read-csv", a->cell[0]->str, &m, &data, &size);
+    if (err) {
+        lval_del(a);
+        return err;
+    }
+    if (m && size) { madvise(data, size, MADV_SEQUENTIAL); }
+
+    lcsv c = { data, data + size, delim, NULL, 0, 0 };
+    lval* x = columns ? csv_columns(&c, header) : csv_rows(&c, header);
+    free(c.buf);
+    read_done(m, data);
+    lval_del(a);
+    return x;
+}
+
+// (read-i64 path) is a list of the numbers in a file of little-endian 64 bit
+// integers, one after another
+lval* builtin_read_i64(lenv* e, lval* a) {
+    lmap* m;
+    char* data;
+    size_t size;
+    lval* err = read_whole("read-i64", a->cell[0]->str, &m, &data, &size);
+    if (err) {
+        lval_del(a);
+        return err;
+    }
+    if (size % 8 || size / 8 > INT_MAX) {
+        err = lval_err("Function 'read-i64' couldn't read '%s' | it's %zu bytes, %s",
+            a->cell[0]->str, size, size % 8 ? "which isn't a whole number of 8 byte integers" : "too many to fit in a list");
+        read_done(m, data);
+        lval_del(a);
+        return err;
+    }
+    if (m && size) { madvise(data, size, MADV_SEQUENTIAL); }
+
+    lval* x = lval_qexpr();
+    lval_reserve(x, size / 8);
+    unsigned char* p = (unsigned char*)data;
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t u = 0;
+        for (int b = 7; b >= 0; b--) { u = u << 8 | p[i + b]; }
+        x->cell[x->count++] = lval_num((long)(int64_t)u);
+    }
+    read_done(m, data);
+    lval_del(a);
+    return x;
+}
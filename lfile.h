@@ -0,0 +1,47 @@
+#ifndef LFILE_HEADER
+#define LFILE_HEADER
+#include "lval.h"
+
+// reading and writing files. a regular file is mapped into memory rather than
+// read: read-file gives back a string that points straight into the mapping,
+// and lines walks through it one line at a time, so a huge file only ever
+// takes up page cache. anything that can't be mapped (a pipe, /dev/stdin) is
+// read through a buffer instead.
+//
+// bulk data comes in the same way. (read-csv path) gives back a list of rows,
+// each a list of its fields: integers as numbers (bignums past a long), and
+// anything else, along with any quoted field, as a string. quoted fields can
+// have delimiters, newlines and "" (a quote) in them, lines can end in \r\n,
+// and blank lines are skipped. it takes options like with-limits does:
+// '(header 1) skips the first row, '(delimiter ";") splits on something other
+// than a comma, and '(columns 1) gives back a list for each column instead,
+// all numbers if every field in it is an integer and otherwise all strings,
+// every row having to have as many fields as the first. (read-i64 path) gives
+// back the numbers in a file of little-endian 64 bit integers.
+//
+// the fields are found a word at a time (see csv_scan), and an integer's
+// digits turned into a number eight at a time, so reading is mostly the cost
+// of making the values.
+
+// a read-only mapping of a whole file, shared by every string and sequence
+// made from it, and unmapped when the last one goes. there's always a 0 after
+// the contents, so the file can be used as a c string as it is. like any
+// mapping, the file getting truncated underneath it is fatal
+struct lmap {
+    int refs;
+    char* data;
+    size_t size;
+    // how much address space it takes, the 0 included
+    size_t mapped;
+};
+
+// NULL with errno set if path can't be opened or isn't a regular file
+lmap* lmap_open(char* path);
+lmap* lmap_retain(lmap* m);
+void lmap_release(lmap* m);
+
+// the next line of m from *pos (without its \n) as a new string, moving *pos
+// past it. NULL at the end of the file
+lval* lmap_line(lmap* m, size_t* pos);
+
+#endif
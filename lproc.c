@@ -0,0 +1,302 @@
+/// child processes, see lproc.h
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lproc.h"
+#include "builtin.h"
+#include "eval.h"
+#include "deeprose.h"
+
+extern char** environ;
+
+// pipes are read this much at a time
+#define LPROC_READ 4096
+
+// every process this thread has, for waits to poll
+static __thread lproc* live = NULL;
+
+lproc* lproc_retain(lproc* p) {
+    p->refs++;
+    return p;
+}
+
+void lproc_release(lproc* p) {
+    if (--p->refs) { return; }
+
+    if (p->prev) { p->prev->next = p->next; } else { live = p->next; }
+    if (p->next) { p->next->prev = p->prev; }
+    for (int i = 0; i < 2; i++) {
+        if (p->fds[i] >= 0) { close(p->fds[i]); }
+        free(p->out[i].data);
+    }
+    // nobody can wait for it now, and it'd be left a zombie otherwise
+    if (p->status < 0) {
+        kill(p->pid, SIGKILL);
+        while (waitpid(p->pid, NULL, 0) < 0 && errno == EINTR) {}
+    }
+    free(p);
+}
+
+static long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// reads everything waiting on p's i'th pipe, closing it once it's at the end
+static void proc_read(lproc* p, int i) {
+    lpipebuf* b = &p->out[i];
+    for (;;) {
+        // always room for a 0 after it
+        if (b->capacity - b->size < LPROC_READ + 1) {
+            size_t capacity = b->capacity ? b->capacity * 2 : 2 * LPROC_READ;
+            lval_alloc_bytes += capacity - b->capacity;
+            b->data = realloc(b->data, capacity);
+            b->capacity = capacity;
+        }
+        ssize_t n = read(p->fds[i], b->data + b->size, b->capacity - b->size - 1);
+        if (n > 0) {
+            b->size += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            close(p->fds[i]);
+            p->fds[i] = -1;
+            return;
+        }
+    }
+}
+
+// notes p's exit status if it's exited
+static void proc_reap(lproc* p) {
+    int st;
+    if (p->status >= 0 || waitpid(p->pid, &st, WNOHANG) != p->pid) { return; }
+    p->status = WIFSIGNALED(st) ? 128 + WTERMSIG(st) : WEXITSTATUS(st);
+}
+
+// whether p has exited, and with eof, closed both its pipes too
+static int proc_done(lproc* p, int eof) {
+    return p->status >= 0 && (!eof || (p->fds[0] < 0 && p->fds[1] < 0));
+}
+
+// waits until the first of ps is done, reading every process's pipes in the
+// meantime. gives back which one it was, or -1 if deadline (on the monotonic
+// clock, in ns) came first
+static int proc_wait(lproc** ps, int n, int eof, long deadline) {
+    struct pollfd* fds = NULL;
+    int capacity = 0;
+    int which = -1;
+    for (;;) {
+        // whether everything still running has a pipe to say when it's exited
+        int piped = 1;
+        for (int i = 0; i < n && which < 0; i++) {
+            proc_reap(ps[i]);
+            if (proc_done(ps[i], eof)) { which = i; }
+            if (ps[i]->status < 0 && ps[i]->fds[0] < 0 && ps[i]->fds[1] < 0) { piped = 0; }
+        }
+        long now = monotonic_ns();
+        if (which >= 0 || now >= deadline) { break; }
+
+        int count = 0;
+        for (lproc* p = live; p; p = p->next) {
+            for (int i = 0; i < 2; i++) {
+                if (p->fds[i] < 0) { continue; }
+                if (count == capacity) {
+                    capacity = capacity ? capacity * 2 : 16;
+                    fds = realloc(fds, sizeof(struct pollfd) * capacity);
+                }
+                fds[count++] = (struct pollfd){ p->fds[i], POLLIN, 0 };
+            }
+        }
+
+        long ms = piped ? LPROC_POLL_PIPES_MS : LPROC_POLL_MS;
+        if ((deadline - now) / 1000000L < ms) { ms = (deadline - now + 999999L) / 1000000L; }
+        if (poll(fds, count, ms) <= 0) { continue; }
+
+        // same order as they went in
+        int k = 0;
+        for (lproc* p = live; p; p = p->next) {
+            for (int i = 0; i < 2; i++) {
+                if (p->fds[i] < 0) { continue; }
+                if (fds[k++].revents) { proc_read(p, i); }
+            }
+        }
+    }
+    free(fds);
+    return which;
+}
+
+// the deadline for waiting ms, or forever if ms is negative. neither goes
+// past when e's limits run out, and *limited is set if they're what stops it
+static long proc_deadline(lenv* e, long ms, int* limited) {
+    long now = monotonic_ns();
+    long deadline = ms >= 0 && ms < (LONG_MAX - now) / 1000000L ? now + ms * 1000000L : LONG_MAX;
+    long quota = lquota_deadline(e);
+    *limited = quota < deadline;
+    return *limited ? quota : deadline;
+}
+
+// the error for ps not being done by the time asked for
+static lval* proc_timeout(lenv* e, char* name, int limited, long ms) {
+    if (limited) { return lquota_expire(e); }
+    return lval_err("Function '%s' timed out | still running after %li ms", name, ms);
+}
+
+lval* builtin_spawn_process(lenv* e, lval* a) {
+    LASSERT(a, a->count >= 1, "Function 'spawn-process' passed no command");
+
+    char** argv = malloc(sizeof(char*) * (a->count + 1));
+    for (int i = 0; i < a->count; i++) { argv[i] = a->cell[i]->str; }
+    argv[a->count] = NULL;
+
+    // the read ends are kept from every child, this one and any started
+    // later, so they see the end of the file as soon as this one's done
+    int pipes[2][2];
+    for (int i = 0; i < 2; i++) {
+        if (pipe(pipes[i]) < 0) {
+            lval* err = lval_err("Function 'spawn-process' couldn't start '%s' | %s", argv[0], strerror(errno));
+            if (i) { close(pipes[0][0]); close(pipes[0][1]); }
+            free(argv);
+            lval_del(a);
+            return err;
+        }
+        fcntl(pipes[i][0], F_SETFD, FD_CLOEXEC);
+        fcntl(pipes[i][0], F_SETFL, O_NONBLOCK);
+        fcntl(pipes[i][1], F_SETFD, FD_CLOEXEC);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipes[0][1], 1);
+    posix_spawn_file_actions_adddup2(&actions, pipes[1][1], 2);
+    // like run, anything we've printed goes out before the child starts
+    fflush(lenv_interp(e)->out);
+    pid_t pid;
+    int rc = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipes[0][1]);
+    close(pipes[1][1]);
+
+    if (rc) {
+        lval* err = lval_err("Function 'spawn-process' couldn't start '%s' | %s", argv[0], strerror(rc));
+        close(pipes[0][0]);
+        close(pipes[1][0]);
+        free(argv);
+        lval_del(a);
+        return err;
+    }
+    free(argv);
+    lval_del(a);
+
+    lproc* p = calloc(1, sizeof(lproc));
+    p->refs = 1;
+    p->pid = pid;
+    p->fds[0] = pipes[0][0];
+    p->fds[1] = pipes[1][0];
+    p->status = -1;
+    p->next = live;
+    if (live) { live->prev = p; }
+    live = p;
+    return lval_proc(p);
+}
+
+// what process-wait and process-output have in common: checks a is
+// '(p) or '(p ms) and waits for p, giving back NULL once it's done
+static lval* proc_wait_one(lenv* e, lval* a, char* name, int eof) {
+    if (a->count != 1 && a->count != 2) {
+        return lval_error(LERR_ARGS, "Function '%s' passed incorrect number of args | got %d, expected 1 or 2",
+            name, a->count);
+    }
+    if (a->cell[0]->type != LVAL_PROC) {
+        return lval_error(LERR_TYPE, "Function '%s' passed incorrect type | got %s, expected %s",
+            name, ltype_name(a->cell[0]->type), ltype_name(LVAL_PROC));
+    }
+    long ms = -1;
+    if (a->count == 2) {
+        if (a->cell[1]->type != LVAL_NUM) {
+            return lval_error(LERR_TYPE, "Function '%s' passed incorrect type | got %s, expected %s",
+                name, ltype_name(a->cell[1]->type), ltype_name(LVAL_NUM));
+        }
+        ms = a->cell[1]->num;
+        if (ms < 0) { return lval_err("Function '%s' passed a timeout of %li ms", name, ms); }
+    }
+
+    int limited;
+    long deadline = proc_deadline(e, ms, &limited);
+    if (proc_wait(&a->cell[0]->proc, 1, eof, deadline) < 0) {
+        return proc_timeout(e, name, limited, ms);
+    }
+    return NULL;
+}
+
+lval* builtin_process_wait(lenv* e, lval* a) {
+    lval* err = proc_wait_one(e, a, "process-wait", 0);
+    if (err) {
+        lval_del(a);
+        return err;
+    }
+    lval* status = lval_num(a->cell[0]->proc->status);
+    lval_del(a);
+    return status;
+}
+
+lval* builtin_process_output(lenv* e, lval* a) {
+    lval* err = proc_wait_one(e, a, "process-output", 1);
+    if (err) {
+        lval_del(a);
+        return err;
+    }
+    lproc* p = a->cell[0]->proc;
+    lval* v = lval_add(lval_qexpr(), lval_num(p->status));
+    for (int i = 0; i < 2; i++) {
+        if (p->out[i].data) { p->out[i].data[p->out[i].size] = '\0'; }
+        v = lval_add(v, lval_str(p->out[i].data ? p->out[i].data : ""));
+    }
+    lval_del(a);
+    return v;
+}
+
+lval* builtin_process_select(lenv* e, lval* a) {
+    if (a->count != 1 && a->count != 2) {
+        lval* err = lval_error(LERR_ARGS, "Function 'process-select' passed incorrect number of args | got %d, expected 1 or 2",
+            a->count);
+        lval_del(a);
+        return err;
+    }
+    LASSERT_ARGS_TYPE("process-select", a, 0, LVAL_QEXPR);
+    lval* ps = a->cell[0];
+    LASSERT(a, ps->count >= 1, "Function 'process-select' passed no processes");
+    for (int i = 0; i < ps->count; i++) {
+        LASSERT(a, ps->cell[i]->type == LVAL_PROC,
+            "Function 'process-select' passed a %s among the processes", ltype_name(ps->cell[i]->type));
+    }
+    long ms = -1;
+    if (a->count == 2) {
+        LASSERT_ARGS_TYPE("process-select", a, 1, LVAL_NUM);
+        ms = a->cell[1]->num;
+        LASSERT(a, ms >= 0, "Function 'process-select' passed a timeout of %li ms", ms);
+    }
+
+    lproc** procs = malloc(sizeof(lproc*) * ps->count);
+    for (int i = 0; i < ps->count; i++) { procs[i] = ps->cell[i]->proc; }
+    int limited;
+    long deadline = proc_deadline(e, ms, &limited);
+    int which = proc_wait(procs, ps->count, 0, deadline);
+    lval* v = which < 0 ? proc_timeout(e, "process-select", limited, ms)
+        : lval_add(lval_add(lval_qexpr(), lval_num(which)), lval_num(procs[which]->status));
+    free(procs);
+    lval_del(a);
+    return v;
+}
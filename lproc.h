@@ -0,0 +1,56 @@
+#ifndef LPROC_HEADER
+#define LPROC_HEADER
+#include <sys/types.h>
+#include "lval.h"
+
+// child processes. (spawn-process cmd args...) starts cmd (looked up on PATH)
+// with its stdin on /dev/null and its stdout and stderr on pipes, and gives
+// back a process right away. (process-wait p) waits for it to exit and gives
+// back its exit status, 128 plus the signal if one killed it, and
+// (process-output p) waits until it's also closed its output, giving back
+// '(status "stdout" "stderr"). both take a timeout in ms as well, and give
+// back an error if it runs out first. (process-select '(p...)) waits for
+// whichever of several is first to exit, like select does for channels, and
+// gives back '(i status).
+//
+// whenever any of that waits, it polls the pipes of every process the
+// interpreter has going, not just the ones waited on, so nothing stalls on a
+// full pipe while something else is being waited for. children run side by
+// side however they're waited on, so waiting on each of a list in turn takes
+// as long as the slowest of them.
+//
+// a process belongs to the isolate that started it and can't be sent to
+// another one. once nothing refers to a process that's still running, it's
+// killed.
+
+// while there's a process running with no pipes left to tell us it exited,
+// waits check on it this often
+#define LPROC_POLL_MS 1
+// otherwise it's likely to close its pipes when it exits, and this is just in
+// case something it started keeps them open
+#define LPROC_POLL_PIPES_MS 50
+
+// what's come from one of a child's pipes
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} lpipebuf;
+
+struct lproc {
+    int refs;
+    pid_t pid;
+    // read ends of stdout and stderr, -1 once closed
+    int fds[2];
+    lpipebuf out[2];
+    // the exit status, -1 until it's been waited for
+    int status;
+    // processes still to be waited for or read from, on this thread
+    lproc* prev;
+    lproc* next;
+};
+
+lproc* lproc_retain(lproc* p);
+void lproc_release(lproc* p);
+
+#endif
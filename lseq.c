@@ -0,0 +1,297 @@
+/// lazy sequences, see lseq.h
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "lseq.h"
+#include "lenv.h"
+#include "deeprose.h"
+#include "lfile.h"
+
+static lseq* lseq_new(int kind) {
+    lseq* s = malloc(sizeof(lseq));
+    s->kind = kind;
+    s->refs = 1;
+    s->list = NULL;
+    s->fn = NULL;
+    s->inner = NULL;
+    s->map = NULL;
+    s->path = NULL;
+    s->memo = NULL;
+    s->fill = NULL;
+    s->filling = 0;
+    return s;
+}
+
+lseq* lseq_range(long start, long end) {
+    lseq* s = lseq_new(LSEQ_RANGE);
+    s->start = start;
+    s->end = end;
+    return s;
+}
+
+// takes ownership of list
+lseq* lseq_list(lval* list) {
+    lseq* s = lseq_new(LSEQ_LIST);
+    s->list = list;
+    return s;
+}
+
+// takes ownership of m, which is NULL if the file has to be read instead
+lseq* lseq_lines(lmap* m, char* path) {
+    lseq* s = lseq_new(LSEQ_LINES);
+    s->map = m;
+    s->path = strdup(path);
+    return s;
+}
+
+// a map / filter / take / drop stage on top of inner. takes ownership of
+// inner and fn (which is NULL for take and drop)
+lseq* lseq_stage(int kind, lseq* inner, lval* fn, long n) {
+    lseq* s = lseq_new(kind);
+    s->inner = inner;
+    s->fn = fn;
+    s->n = n;
+    return s;
+}
+
+lseq* lseq_retain(lseq* s) {
+    s->refs++;
+    return s;
+}
+
+void lseq_release(lseq* s) {
+    while (s && --s->refs == 0) {
+        lseq* inner = s->inner;
+        if (s->list) { lval_del(s->list); }
+        if (s->fn) { lval_del(s->fn); }
+        if (s->memo) { lval_del(s->memo); }
+        lseq_iter_del(s->fill);
+        lmap_release(s->map);
+        free(s->path);
+        free(s);
+        s = inner;
+    }
+}
+
+// whether running s again is sure to give the same elements, so there's no
+// need to remember them
+static int lseq_repeatable(lseq* s) {
+    for (; s; s = s->inner) {
+        if (s->kind != LSEQ_RANGE && s->kind != LSEQ_LINES
+            && s->kind != LSEQ_TAKE && s->kind != LSEQ_DROP) { return 0; }
+    }
+    return 1;
+}
+
+// a pass over s that runs its pipeline, or reads its memo
+static lseq_iter* lseq_iter_make(lseq* s, int memo) {
+    lseq_iter* it = malloc(sizeof(lseq_iter));
+    it->seq = s;
+    it->memo = memo;
+    it->pos = s->kind == LSEQ_RANGE && !memo ? s->start : 0;
+    it->inner = s->inner && !memo ? lseq_iter_new(s->inner) : NULL;
+    it->co = s->kind == LSEQ_GEN && !memo ? ecoro_new(lval_copy(s->fn)) : NULL;
+    it->file = NULL;
+    it->line = NULL;
+    it->cap = 0;
+    return it;
+}
+
+lseq_iter* lseq_iter_new(lseq* s) {
+    return lseq_iter_make(s, s->memo || (s->refs > 1 && !lseq_repeatable(s)));
+}
+
+void lseq_iter_del(lseq_iter* it) {
+    while (it) {
+        lseq_iter* inner = it->inner;
+        if (it->co) { ecoro_del(it->co); }
+        if (it->file) { fclose(it->file); }
+        free(it->line);
+        free(it);
+        it = inner;
+    }
+}
+
+// calls fn on one argument
+static lval* lseq_apply(lenv* e, lval* fn, lval* x) {
+    return lval_call(e, fn, lval_add(lval_sexpr(), x));
+}
+
+// the next element of a pass reading s's memo, running the pipeline for it
+// if no pass has got that far yet. an error ends the memo like it would a pass
+static lval* lseq_memo_next(lenv* e, lseq_iter* it) {
+    lseq* s = it->seq;
+    if (!s->memo) {
+        s->memo = lval_qexpr();
+        s->fill = lseq_iter_make(s, 0);
+    }
+
+    if (it->pos == s->memo->count) {
+        if (!s->fill) { return NULL; }
+        if (s->filling) { return lval_err("Sequence read while it's producing its own elements"); }
+
+        s->filling = 1;
+        lval* x = lseq_next(e, s->fill);
+        s->filling = 0;
+        if (!x || x->type == LVAL_ERR) {
+            lseq_iter_del(s->fill);
+            s->fill = NULL;
+            if (!x) { return NULL; }
+        }
+        lval_add(s->memo, x);
+    }
+    return lval_copy(s->memo->cell[it->pos++]);
+}
+
+// the next element of the sequence, NULL once it's finished. if anything in
+// the pipeline errors the error is returned instead
+lval* lseq_next(lenv* e, lseq_iter* it) {
+    lseq* s = it->seq;
+    if (it->memo) { return lseq_memo_next(e, it); }
+
+    switch (s->kind) {
+        case LSEQ_RANGE: {
+            if (it->pos > s->end) { return NULL; }
+            // nothing's evaluated for a range or a file's lines, so they
+            // count a step per element themselves, in case of limits
+            lval* err = lquota_check(e);
+            if (err) { return err; }
+            return lval_num(it->pos++);
+        }
+
+        case LSEQ_LIST:
+            if (it->pos >= s->list->count) { return NULL; }
+            // elements get evaluated like `first` does with them
+            return lval_eval(e, lval_copy(s->list->cell[it->pos++]));
+
+        case LSEQ_GEN: {
+            // the run can be carried on by a later pass (see lseq_memo_next),
+            // when e might be gone, so it runs under the globals. the locals
+            // its function uses went along with it (see builtin_generator)
+            deeprose* d = lenv_interp(e);
+            return ecoro_resume(d ? d->env : e, it->co);
+        }
+
+        case LSEQ_LINES: {
+            lval* err = lquota_check(e);
+            if (err) { return err; }
+            if (s->map) {
+                size_t pos = it->pos;
+                lval* x = lmap_line(s->map, &pos);
+                it->pos = pos;
+                return x;
+            }
+
+            // opened on the first line, so that every pass starts from the top
+            if (!it->file) {
+                if (it->pos) { return NULL; }
+                it->pos = 1;
+                it->file = fopen(s->path, "r");
+                if (!it->file) {
+                    return lval_err("Function 'lines' couldn't read '%s' | %s", s->path, strerror(errno));
+                }
+            }
+            ssize_t n = getline(&it->line, &it->cap, it->file);
+            if (n < 0) { return NULL; }
+            if (n && it->line[n - 1] == '\n') { it->line[n - 1] = '\0'; }
+            return lval_str(it->line);
+        }
+
+        case LSEQ_MAP: {
+            lval* x = lseq_next(e, it->inner);
+            if (!x || x->type == LVAL_ERR) { return x; }
+            return lseq_apply(e, s->fn, x);
+        }
+
+        case LSEQ_FILTER:
+            while (1) {
+                lval* x = lseq_next(e, it->inner);
+                if (!x || x->type == LVAL_ERR) { return x; }
+
+                lval* keep = lseq_apply(e, s->fn, lval_copy(x));
+                if (keep->type == LVAL_ERR) { lval_del(x); return keep; }
+
+                int truthy = keep->type == LVAL_NUM && keep->num;
+                lval_del(keep);
+                if (truthy) { return x; }
+                lval_del(x);
+            }
+
+        case LSEQ_TAKE:
+            // stop pulling from upstream as soon as we have enough
+            if (it->pos >= s->n) { return NULL; }
+            it->pos++;
+            return lseq_next(e, it->inner);
+
+        case LSEQ_DROP:
+            while (it->pos < s->n) {
+                lval* x = lseq_next(e, it->inner);
+                if (!x || x->type == LVAL_ERR) { return x; }
+                lval_del(x);
+                it->pos++;
+            }
+            return lseq_next(e, it->inner);
+    }
+
+    return lval_err("whoops - unknown sequence kind %d", s->kind);
+}
+
+// runs the whole pipeline into a q-expression
+lval* lseq_collect(lenv* e, lseq* s) {
+    lval* list = lval_qexpr();
+    lseq_iter* it = lseq_iter_new(s);
+
+    lval* x;
+    while ((x = lseq_next(e, it))) {
+        if (x->type == LVAL_ERR) {
+            lval_del(list);
+            list = x;
+            break;
+        }
+        lval_add(list, x);
+    }
+
+    lseq_iter_del(it);
+    return list;
+}
+
+// replaces every sequence in v, however deeply nested, by the list it
+// produces. used on values that are about to leave the interpreter (be
+// printed, handed back to c) or go to builtins that only know about lists.
+// takes ownership of v. nested lists wait on a worklist rather than the c
+// stack, like they do for lval_copy
+lval* lval_realize(lenv* e, lval* v) {
+    if (v->type == LVAL_SEQ) {
+        lval* list = lseq_collect(e, v->seq);
+        lval_del(v);
+        if (list->type == LVAL_ERR) { return list; }
+        v = list;
+    }
+    if (v->type != LVAL_QEXPR && v->type != LVAL_SEXPR) { return v; }
+
+    lwork w;
+    lwork_init(&w);
+    lwork_push(&w, v);
+    while (w.count) {
+        lval* l = w.items[--w.count];
+        for (int i = 0; i < l->count; i++) {
+            lval* x = l->cell[i];
+            if (x->type == LVAL_SEQ) {
+                // the elements can be sequences too, which the list's turn
+                // on the worklist gets to
+                lval* list = lseq_collect(e, x->seq);
+                if (list->type == LVAL_ERR) {
+                    lwork_free(&w);
+                    lval_del(v);
+                    return list;
+                }
+                lval_del(x);
+                l->cell[i] = x = list;
+            }
+            if (x->type == LVAL_QEXPR) { lwork_push(&w, x); }
+        }
+    }
+    lwork_free(&w);
+    return v;
+}
@@ -0,0 +1,91 @@
+#ifndef LSEQ_HEADER
+#define LSEQ_HEADER
+#include "lval.h"
+#include "eval.h"
+
+// a lazy sequence is a description of where the elements come from: a range
+// or a list, followed by any number of map / filter / take / drop stages.
+// nothing runs until something consumes it, and then every element goes
+// through the whole pipeline before the next one is produced, so there are
+// no intermediate lists.
+//
+// descriptions never change once built, so copies of a sequence just share
+// one with a reference count.
+//
+// the lines of a file are another source, read from its mapping if it's a
+// regular file or through a buffer otherwise (see lfile.h).
+//
+// a generator is a source too: a function run as a coroutine (see eval.h),
+// whose elements are whatever it yields.
+//
+// a sequence read while something else holds on to it too (it's bound to a
+// name, say) remembers the elements it's produced, and later passes read
+// those rather than running the pipeline again. so a sequence gives the
+// same elements every time, and a map's function runs once per element
+// however many times the result is read. ranges, and take and drop of them,
+// are left alone, as are a file's lines: running those again gives the same
+// elements anyway, and remembering them would cost as much as a list.
+enum seqkind { LSEQ_RANGE, LSEQ_LIST, LSEQ_MAP, LSEQ_FILTER, LSEQ_TAKE, LSEQ_DROP, LSEQ_GEN, LSEQ_LINES };
+
+struct lseq {
+    int kind;
+    int refs;
+
+    // range: start to end inclusive
+    long start;
+    long end;
+    // list: the q-expression the elements come from
+    lval* list;
+    // map / filter: the function to apply. generator: the function to run
+    lval* fn;
+    // take / drop: how many
+    long n;
+    // lines: the file's mapping, or NULL to read path through a buffer
+    lmap* map;
+    char* path;
+    // every stage but the sources (range, list, lines and generator) pulls from
+    // another sequence
+    lseq* inner;
+    // the elements produced so far, once it's been read while shared, and
+    // the pass producing them (NULL once that's finished)
+    lval* memo;
+    struct lseq_iter* fill;
+    // set while fill is producing an element, so the pipeline can't read
+    // the sequence it's part of
+    int filling;
+};
+
+// the running state of one pass over a sequence
+typedef struct lseq_iter {
+    lseq* seq;
+    // whether this pass reads the sequence's memo (pos is then the index
+    // into it) rather than running the pipeline itself
+    int memo;
+    // range: the next number. list: the next index. take / drop: how many so
+    // far. lines: the next offset into the mapping, or whether the file's been
+    // opened if there isn't one
+    long pos;
+    struct lseq_iter* inner;
+    // generator: the run of its function, started on the first element
+    ecoro* co;
+    // lines without a mapping: the open file, and the buffer getline reads into
+    FILE* file;
+    char* line;
+    size_t cap;
+} lseq_iter;
+
+lseq* lseq_range(long start, long end);
+lseq* lseq_list(lval* list);
+lseq* lseq_lines(lmap* m, char* path);
+lseq* lseq_stage(int kind, lseq* inner, lval* fn, long n);
+lseq* lseq_retain(lseq* s);
+void lseq_release(lseq* s);
+
+lseq_iter* lseq_iter_new(lseq* s);
+void lseq_iter_del(lseq_iter* it);
+lval* lseq_next(lenv* e, lseq_iter* it);
+
+lval* lseq_collect(lenv* e, lseq* s);
+lval* lval_realize(lenv* e, lval* v);
+
+#endif
@@ -0,0 +1,386 @@
+/// sorting, see lsort.h
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lsort.h"
+#include "builtin.h"
+
+// a value and what it's sorted by. for sort these are the same thing
+typedef struct {
+    lval* key;
+    lval* val;
+} sitem;
+
+// what decides the order
+typedef struct {
+    lenv* e;
+    char* name;
+    // says whether its first argument goes before its second, or NULL to go
+    // by lval_cmp
+    lval* less;
+    // the first error less gave. after that everything counts as equal, so
+    // the sort just runs out without calling it again
+    lval* err;
+} sorter;
+
+static int before(sorter* s, sitem* x, sitem* y) {
+    if (!s->less) { return lval_cmp(x->key, y->key) < 0; }
+    if (s->err) { return 0; }
+
+    lval* r = lval_call(s->e, s->less, lval_add(lval_add(lval_sexpr(), lval_copy(x->key)), lval_copy(y->key)));
+    if (r->type == LVAL_ERR) {
+        s->err = r;
+        return 0;
+    }
+    if (r->type != LVAL_NUM) {
+        s->err = lval_error(LERR_TYPE, "Function '%s' passed a function that returned %s, expected %s",
+            s->name, ltype_name(r->type), ltype_name(LVAL_NUM));
+        lval_del(r);
+        return 0;
+    }
+    int b = r->num != 0;
+    lval_del(r);
+    return b;
+}
+
+static void swap(sitem* v, int i, int j) {
+    sitem t = v[i];
+    v[i] = v[j];
+    v[j] = t;
+}
+
+static void insertion_sort(sorter* s, sitem* v, int n) {
+    for (int i = 1; i < n; i++) {
+        sitem x = v[i];
+        int j = i;
+        while (j > 0 && before(s, &x, &v[j - 1])) {
+            v[j] = v[j - 1];
+            j--;
+        }
+        v[j] = x;
+    }
+}
+
+static void sift_down(sorter* s, sitem* v, int i, int n) {
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= n) { return; }
+        if (c + 1 < n && before(s, &v[c], &v[c + 1])) { c++; }
+        if (!before(s, &v[i], &v[c])) { return; }
+        swap(v, i, c);
+        i = c;
+    }
+}
+
+static void heap_sort(sorter* s, sitem* v, int n) {
+    for (int i = n / 2 - 1; i >= 0; i--) { sift_down(s, v, i, n); }
+    for (int i = n - 1; i > 0; i--) {
+        swap(v, 0, i);
+        sift_down(s, v, 0, i);
+    }
+}
+
+// how many bad pivots introsort puts up with before switching to heapsort
+static int intro_depth(int n) {
+    int d = 0;
+    while (n >>= 1) { d++; }
+    return 2 * d;
+}
+
+// quicksort, recursing into the smaller side only so the c stack stays
+// shallow, and going over to heapsort once depth runs out. the scans are
+// bounded, so a comparison function that isn't consistent can only give a
+// strange order and never run off the end
+static void intro_sort(sorter* s, sitem* v, int n, int depth) {
+    while (n > SORT_SMALL) {
+        if (depth-- == 0) {
+            heap_sort(s, v, n);
+            return;
+        }
+
+        // median of the first, middle and last as the pivot, moved to the front
+        int m = n / 2;
+        if (before(s, &v[m], &v[0])) { swap(v, 0, m); }
+        if (before(s, &v[n - 1], &v[m])) {
+            swap(v, m, n - 1);
+            if (before(s, &v[m], &v[0])) { swap(v, 0, m); }
+        }
+        swap(v, 0, m);
+
+        int i = 0, j = n;
+        for (;;) {
+            do { i++; } while (i < n && before(s, &v[i], &v[0]));
+            do { j--; } while (j > 0 && before(s, &v[0], &v[j]));
+            if (i >= j) { break; }
+            swap(v, i, j);
+        }
+        swap(v, 0, j);
+
+        if (j < n - j - 1) {
+            intro_sort(s, v, j, depth);
+            v += j + 1;
+            n -= j + 1;
+        } else {
+            intro_sort(s, v + j + 1, n - j - 1, depth);
+            n = j;
+        }
+    }
+    insertion_sort(s, v, n);
+}
+
+// the sorted runs a and b into out. ties go to a, which keeps it stable
+static void merge(sorter* s, sitem* a, int n, sitem* b, int m, sitem* out) {
+    int i = 0, j = 0, k = 0;
+    while (i < n && j < m) {
+        out[k++] = before(s, &b[j], &a[i]) ? b[j++] : a[i++];
+    }
+    while (i < n) { out[k++] = a[i++]; }
+    while (j < m) { out[k++] = b[j++]; }
+}
+
+// bottom up: short runs get an insertion sort, then they're merged in pairs
+// back and forth between v and tmp
+static void merge_sort(sorter* s, sitem* v, int n, sitem* tmp) {
+    for (int i = 0; i < n; i += SORT_SMALL) {
+        insertion_sort(s, v + i, n - i < SORT_SMALL ? n - i : SORT_SMALL);
+    }
+
+    sitem* from = v;
+    sitem* to = tmp;
+    for (int w = SORT_SMALL; w < n; w *= 2) {
+        for (int i = 0; i < n; i += 2 * w) {
+            int a = n - i < w ? n - i : w;
+            int b = n - i - a < w ? n - i - a : w;
+            merge(s, from + i, a, from + i + a, b, to + i);
+        }
+        sitem* t = from;
+        from = to;
+        to = t;
+    }
+    if (from != v) { memcpy(v, from, n * sizeof(sitem)); }
+}
+
+// a radix sort of values whose keys are all plain numbers, a byte at a time
+// from the bottom. bytes that are the same in every key (the top ones, for
+// small numbers) don't need a pass
+typedef struct {
+    unsigned long bits;
+    sitem item;
+} sradix;
+
+static void radix_sort(sitem* v, int n) {
+    sradix* r = malloc(sizeof(sradix) * n * 2);
+    sradix* from = r;
+    sradix* to = r + n;
+    // flipping the sign bit makes unsigned order the same as signed
+    for (int i = 0; i < n; i++) {
+        from[i].bits = (unsigned long)v[i].key->num ^ (1UL << (sizeof(long) * 8 - 1));
+        from[i].item = v[i];
+    }
+
+    for (unsigned shift = 0; shift < sizeof(long) * 8; shift += 8) {
+        int counts[256] = { 0 };
+        for (int i = 0; i < n; i++) { counts[(from[i].bits >> shift) & 255]++; }
+        if (counts[(from[0].bits >> shift) & 255] == n) { continue; }
+
+        int at = 0;
+        for (int b = 0; b < 256; b++) {
+            int c = counts[b];
+            counts[b] = at;
+            at += c;
+        }
+        for (int i = 0; i < n; i++) { to[counts[(from[i].bits >> shift) & 255]++] = from[i]; }
+        sradix* t = from;
+        from = to;
+        to = t;
+    }
+
+    for (int i = 0; i < n; i++) { v[i] = from[i].item; }
+    free(r);
+}
+
+// a piece of a parallel sort: either sorting v[0 .. n), or merging it with
+// b[0 .. m) into out
+typedef struct {
+    sorter* s;
+    int stable;
+    sitem* v;
+    int n;
+    sitem* b;
+    int m;
+    // the merge's output, or the scratch space for a merge sort
+    sitem* out;
+} sjob;
+
+static void* sort_job(void* arg) {
+    sjob* j = arg;
+    if (j->b) {
+        merge(j->s, j->v, j->n, j->b, j->m, j->out);
+    } else if (j->stable) {
+        merge_sort(j->s, j->v, j->n, j->out);
+    } else {
+        intro_sort(j->s, j->v, j->n, intro_depth(j->n));
+    }
+    return NULL;
+}
+
+// runs the jobs on a thread each, or right here if a thread can't be had
+static void run_jobs(sjob* jobs, int n) {
+    pthread_t threads[SORT_MAX_THREADS];
+    int started[SORT_MAX_THREADS];
+    for (int i = 0; i < n; i++) {
+        started[i] = pthread_create(&threads[i], NULL, sort_job, &jobs[i]) == 0;
+        if (!started[i]) { sort_job(&jobs[i]); }
+    }
+    for (int i = 0; i < n; i++) {
+        if (started[i]) { pthread_join(threads[i], NULL); }
+    }
+}
+
+// a run each for the threads, then neighbouring runs merged in rounds until
+// there's just the one. only for lval_cmp, which doesn't touch anything
+static void parallel_sort(sorter* s, sitem* v, int n, int stable, int threads) {
+    sitem* tmp = malloc(sizeof(sitem) * n);
+    int starts[SORT_MAX_THREADS + 1];
+    sjob jobs[SORT_MAX_THREADS];
+
+    for (int i = 0; i <= threads; i++) { starts[i] = (long)n * i / threads; }
+    for (int i = 0; i < threads; i++) {
+        jobs[i] = (sjob){ s, stable, v + starts[i], starts[i + 1] - starts[i], NULL, 0, tmp + starts[i] };
+    }
+    run_jobs(jobs, threads);
+
+    sitem* from = v;
+    sitem* to = tmp;
+    int runs = threads;
+    while (runs > 1) {
+        int k = 0;
+        for (int i = 0; i < runs; i += 2) {
+            if (i + 1 == runs) {
+                // the odd one out just moves across
+                memcpy(to + starts[i], from + starts[i], (starts[i + 1] - starts[i]) * sizeof(sitem));
+            } else {
+                jobs[k++] = (sjob){ s, stable,
+                    from + starts[i], starts[i + 1] - starts[i],
+                    from + starts[i + 1], starts[i + 2] - starts[i + 1],
+                    to + starts[i] };
+            }
+        }
+        run_jobs(jobs, k);
+
+        for (int i = 0; 2 * i < runs; i++) { starts[i] = starts[2 * i]; }
+        runs = (runs + 1) / 2;
+        starts[runs] = n;
+        sitem* t = from;
+        from = to;
+        to = t;
+    }
+    if (from != v) { memcpy(v, from, n * sizeof(sitem)); }
+    free(tmp);
+}
+
+static int sort_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) { return 1; }
+    return n > SORT_MAX_THREADS ? SORT_MAX_THREADS : n;
+}
+
+static void sort_items(sorter* s, sitem* v, int n, int stable) {
+    if (n < 2) { return; }
+
+    if (!s->less) {
+        int nums = 1;
+        for (int i = 0; i < n && nums; i++) { nums = v[i].key->type == LVAL_NUM; }
+        if (nums) {
+            radix_sort(v, n);
+            return;
+        }
+
+        int threads = n >= SORT_PARALLEL ? sort_threads() : 1;
+        if (threads > 1) {
+            parallel_sort(s, v, n, stable, threads);
+            return;
+        }
+    }
+
+    if (stable) {
+        sitem* tmp = malloc(sizeof(sitem) * n);
+        merge_sort(s, v, n, tmp);
+        free(tmp);
+    } else {
+        intro_sort(s, v, n, intro_depth(n));
+    }
+}
+
+// sort and stable-sort: (name coll) or (name less coll)
+static lval* sort_list(lenv* e, lval* a, char* name, int stable) {
+    if (a->count != 1 && a->count != 2) {
+        lval* err = lval_error(LERR_ARGS, "Function '%s' passed incorrect number of args | got %d, expected 1 or 2",
+            name, a->count);
+        lval_del(a);
+        return err;
+    }
+    if (a->count == 2) { LASSERT_ARGS_TYPE(name, a, 0, LVAL_FUN); }
+    LASSERT_ARGS_TYPE(name, a, a->count - 1, LVAL_QEXPR);
+
+    lval* coll = lval_pop(a, a->count - 1);
+    sorter s = { e, name, a->count ? a->cell[0] : NULL, NULL };
+
+    int n = coll->count;
+    sitem* v = malloc(sizeof(sitem) * (n ? n : 1));
+    for (int i = 0; i < n; i++) { v[i] = (sitem){ coll->cell[i], coll->cell[i] }; }
+    sort_items(&s, v, n, stable);
+    for (int i = 0; i < n; i++) { coll->cell[i] = v[i].val; }
+    free(v);
+
+    lval_del(a);
+    if (s.err) {
+        lval_del(coll);
+        return s.err;
+    }
+    return coll;
+}
+
+lval* builtin_sort(lenv* e, lval* a) {
+    return sort_list(e, a, "sort", 0);
+}
+
+lval* builtin_stable_sort(lenv* e, lval* a) {
+    return sort_list(e, a, "stable-sort", 1);
+}
+
+lval* builtin_sort_by(lenv* e, lval* a) {
+    lval* key = lval_pop(a, 0);
+    lval* coll = lval_take(a, 0);
+    int n = coll->count;
+    sitem* v = malloc(sizeof(sitem) * (n ? n : 1));
+
+    // every key up front, so the function runs once per value
+    lval* err = NULL;
+    int made = 0;
+    for (; made < n; made++) {
+        lval* k = lval_call(e, key, lval_add(lval_sexpr(), lval_copy(coll->cell[made])));
+        if (k->type == LVAL_ERR) {
+            err = k;
+            break;
+        }
+        v[made] = (sitem){ k, coll->cell[made] };
+    }
+
+    if (!err) {
+        sorter s = { e, "sort-by", NULL, NULL };
+        sort_items(&s, v, n, 1);
+        for (int i = 0; i < n; i++) { coll->cell[i] = v[i].val; }
+    }
+
+    for (int i = 0; i < made; i++) { lval_del(v[i].key); }
+    free(v);
+    lval_del(key);
+    if (err) {
+        lval_del(coll);
+        return err;
+    }
+    return coll;
+}
@@ -0,0 +1,23 @@
+#ifndef LSORT_HEADER
+#define LSORT_HEADER
+#include "lval.h"
+
+// sorting. (sort coll) puts a list in order by lval_cmp, and (sort less coll)
+// by a function saying whether its first argument goes before its second.
+// stable-sort is the same but keeps equal values in the order they came in,
+// and (sort-by key coll) stably sorts by what key gives for each value.
+//
+// how depends on what's being sorted. a list of nothing but plain numbers (or
+// a sort-by whose keys all are) is radix sorted. anything else is introsort,
+// a quicksort that goes over to heapsort if it's picking bad pivots, or merge
+// sort when it has to be stable. with the default order, lists of at least
+// SORT_PARALLEL values are split between threads, one per core up to
+// SORT_MAX_THREADS, and the sorted runs merged back together in parallel too.
+// a function given to sort is only ever called on the calling thread, since
+// the evaluator isn't thread safe.
+#define SORT_PARALLEL (1 << 15)
+#define SORT_MAX_THREADS 16
+// runs this short get an insertion sort
+#define SORT_SMALL 16
+
+#endif
@@ -1,9 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 #include <stdarg.h>
 #include "lval.h"
 #include "builtin.h"
+#include "lseq.h"
+#include "fold.h"
+#include "lfile.h"
+#include "lbig.h"
+#include "lchan.h"
+#include "lproc.h"
 
 // returns LVAL enum's string name
 char* ltype_name(int t) {
@@ -15,96 +22,366 @@ char* ltype_name(int t) {
     case LVAL_STR: return "String";
     case LVAL_SEXPR: return "S-Expression";
     case LVAL_QEXPR: return "Q-Expression";
+    case LVAL_SEQ: return "Sequence";
+    case LVAL_BIG: return "Big Number";
+    case LVAL_CHAN: return "Channel";
+    case LVAL_PROC: return "Process";
     default: return "Unknown";
   }
 }
 
+// every lval allocated on this thread, used by `time` to report allocations
+__thread unsigned long lval_allocations = 0;
+__thread unsigned long lval_alloc_bytes = 0;
+
+// allocate an lval of type t. everything else is left for the caller to fill in
+static lval* lval_alloc(int t) {
+    lval* v = malloc(sizeof(lval));
+    v->type = t;
+    lval_allocations++;
+    lval_alloc_bytes += sizeof(lval);
+    return v;
+}
+
+// a copy of s for a value to keep
+static char* lval_strdup(char* s) {
+    size_t n = strlen(s) + 1;
+    lval_alloc_bytes += n;
+    return memcpy(malloc(n), s, n);
+}
+
 // create a lisp value number
 lval* lval_num(long x) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_NUM;
+    lval* v = lval_alloc(LVAL_NUM);
     v->num = x;
     return v;
 }
 
+static lval* lval_verror(int code, char* fmt, va_list va) {
+    va_list eager;
+    va_copy(eager, va);
+
+    // pick out the arguments. numbers are kept as longs, strings need
+    // copying since they're usually about to be freed
+    char kinds[LERR_MAX_ARGS];
+    long args[LERR_MAX_ARGS];
+    char* strs[LERR_MAX_ARGS];
+    size_t bytes = 0;
+    int argc = 0;
+    int lazy = 1;
+    for (char* p = fmt; *p && lazy; p++) {
+        if (*p != '%') { continue; }
+        if (*++p == '%') { continue; }
+        p += strspn(p, "-+ #0123456789.");
+
+        int is_long = 0;
+        while (*p == 'l' || *p == 'z') { is_long = 1; p++; }
+        if (!strchr("sdiuxc", *p) || argc == LERR_MAX_ARGS) { lazy = 0; break; }
+
+        kinds[argc] = *p;
+        if (*p == 's') {
+            strs[argc] = va_arg(va, char*);
+            args[argc] = bytes;
+            bytes += strlen(strs[argc]) + 1;
+        } else if (is_long) {
+            args[argc] = va_arg(va, long);
+        } else if (*p == 'u' || *p == 'x') {
+            args[argc] = va_arg(va, unsigned);
+        } else {
+            args[argc] = va_arg(va, int);
+        }
+        argc++;
+    }
+    if (!lazy) { bytes = 0; }
+
+    lval* v = malloc(sizeof(lval) + sizeof(lerr) + bytes);
+    v->type = LVAL_ERR;
+    lval_allocations++;
+    lval_alloc_bytes += sizeof(lval) + sizeof(lerr) + bytes;
+
+    lerr* r = (lerr*)(v + 1);
+    v->error = r;
+    v->err = NULL;
+    r->code = code;
+    r->fmt = fmt;
+    r->argc = argc;
+    r->frames = 0;
+    r->shown = 0;
+    r->trace_len = 0;
+    r->size = sizeof(lerr) + bytes;
+
+    if (lazy) {
+        for (int i = 0; i < argc; i++) {
+            r->kinds[i] = kinds[i];
+            r->args[i] = args[i];
+            if (kinds[i] == 's') { strcpy(r->text + args[i], strs[i]); }
+        }
+    } else {
+        // a format we can't hold on to, so do it now like we used to
+        r->fmt = NULL;
+        r->argc = 0;
+        v->err = malloc(512);
+        vsnprintf(v->err, 511, fmt, eager);
+        v->err = realloc(v->err, strlen(v->err) + 1);
+    }
+
+    va_end(eager);
+    return v;
+}
+
 // create a lisp value error
 lval* lval_err(char* fmt, ...) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_ERR;
+    va_list va;
+    va_start(va, fmt);
+    lval* v = lval_verror(LERR_OTHER, fmt, va);
+    va_end(va);
+    return v;
+}
 
+// an error with a code, see enum lisperror
+lval* lval_error(int code, char* fmt, ...) {
     va_list va;
     va_start(va, fmt);
+    lval* v = lval_verror(code, fmt, va);
+    va_end(va);
+    return v;
+}
+
+// writes out an error's message, formatting it from its parts
+static void lerr_fprint_msg(FILE* f, lval* v) {
+    lerr* r = v->error;
+    if (v->err) {
+        fputs(v->err, f);
+        return;
+    }
 
-    // should be enought
-    v->err = malloc(512);
+    int arg = 0;
+    for (char* p = r->fmt; *p; p++) {
+        if (*p != '%') { fputc(*p, f); continue; }
+        if (p[1] == '%') { fputc('%', f); p++; continue; }
+
+        // the conversion with its flags and width, and an l for numbers
+        // since that's how we kept them
+        char spec[32];
+        size_t n = 1 + strspn(p + 1, "-+ #0123456789.");
+        if (n > sizeof(spec) - 3) { n = sizeof(spec) - 3; }
+        memcpy(spec, p, n);
+        p += n;
+        while (*p == 'l' || *p == 'z') { p++; }
+
+        char kind = r->kinds[arg];
+        long x = r->args[arg++];
+        if (kind == 's') {
+            spec[n] = 's'; spec[n + 1] = '\0';
+            fprintf(f, spec, r->text + x);
+        } else if (kind == 'c') {
+            spec[n] = 'c'; spec[n + 1] = '\0';
+            fprintf(f, spec, (int)x);
+        } else {
+            spec[n] = 'l'; spec[n + 1] = kind; spec[n + 2] = '\0';
+            fprintf(f, spec, x);
+        }
+    }
+}
 
-    // put the arguments into the error string with c's format!
-    vsnprintf(v->err, 511, fmt, va);
+// an error's message, formatted the first time it's asked for
+char* lval_err_msg(lval* v) {
+    if (v->err) { return v->err; }
 
-    // reallocate
-    v->err = realloc(v->err, strlen(v->err) + 1);
+    size_t size = 0;
+    FILE* f = open_memstream(&v->err, &size);
+    lerr_fprint_msg(f, v);
+    fclose(f);
+    return v->err;
+}
 
-    va_end(va);
-    return v;
+// notes that the error came back out of a call to the function called name
+void lval_err_trace(lval* v, char* name) {
+    lerr* r = v->error;
+    r->frames++;
+
+    // recursion shows up as one frame called over and over
+    int last = r->trace_len;
+    if (r->shown) {
+        last -= 2;
+        while (last > 0 && r->trace[last - 1]) { last--; }
+        if (strcmp(r->trace + last, name) == 0) {
+            r->repeats[r->shown - 1]++;
+            return;
+        }
+    }
+
+    int n = strlen(name) + 1;
+    if (r->shown == LERR_TRACE_FRAMES || r->trace_len + n > LERR_TRACE_BYTES) { return; }
+    memcpy(r->trace + r->trace_len, name, n);
+    r->trace_len += n;
+    r->repeats[r->shown++] = 1;
+}
+
+static void lerr_fprint(FILE* f, lval* v) {
+    lerr* r = v->error;
+    fputs("\033[31mError: ", f);
+    lerr_fprint_msg(f, v);
+
+    int frames = 0;
+    char* name = r->trace;
+    for (int i = 0; i < r->shown; i++) {
+        if (r->repeats[i] > 1) { fprintf(f, "\n    in %s (%d times)", name, r->repeats[i]); }
+        else { fprintf(f, "\n    in %s", name); }
+        frames += r->repeats[i];
+        name += strlen(name) + 1;
+    }
+    if (r->frames > frames) { fprintf(f, "\n    ... %d more", r->frames - frames); }
+    fputs("\033[0m", f);
 }
 
 // create a lisp value symbol
 lval* lval_sym(char* symbol) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_SYM;
-    v->sym = malloc(sizeof(symbol) + 1);
-    strcpy(v->sym, symbol);
+    lval* v = lval_alloc(LVAL_SYM);
+    v->sym = lval_strdup(symbol);
+    v->cache = NULL;
     return v;
 }
 
 lval* lval_str(char* str) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_STR;
-    v->str = malloc(strlen(str) + 1);
-    strcpy(v->str, str);
+    lval* v = lval_alloc(LVAL_STR);
+    v->str = lval_strdup(str);
+    v->map = NULL;
     return v;
 }
 
+// a string of the n chars at s, which needn't end in a 0
+lval* lval_str_n(char* s, size_t n) {
+    lval* v = lval_alloc(LVAL_STR);
+    v->str = malloc(n + 1);
+    memcpy(v->str, s, n);
+    v->str[n] = '\0';
+    v->map = NULL;
+    lval_alloc_bytes += n + 1;
+    return v;
+}
+
+// a string of a whole mapped file, without copying it. takes m
+lval* lval_str_map(lmap* m) {
+    lval* v = lval_alloc(LVAL_STR);
+    v->str = m->data;
+    v->map = m;
+    return v;
+}
+
+// an empty list's cells are its small ones
+static void lval_cells_init(lval* v) {
+    v->count = 0;
+    v->cell = v->small;
+    v->start = 0;
+    v->capacity = LVAL_SMALL;
+}
+
 // returns a pointer to a new empty s-expression
 lval* lval_sexpr(void) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_SEXPR;
-    v->count = 0;
-    v->cell = NULL;
+    lval* v = lval_alloc(LVAL_SEXPR);
+    lval_cells_init(v);
     return v;
 }
 
 // create a lisp  value function (takes in a function ptr)
 lval* lval_fun(lbuiltin func) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_FUN;
+    lval* v = lval_alloc(LVAL_FUN);
     v->builtin = func;
+    v->sig = NULL;
+    v->fold = NULL;
+    v->part = NULL;
+    v->macro = 0;
     return v;
 }
 
-// recursively free up lisp values
-void lval_del(lval* v) {
+// create a lisp value lazy sequence (takes ownership of s)
+lval* lval_seq(lseq* s) {
+    lval* v = lval_alloc(LVAL_SEQ);
+    v->seq = s;
+    return v;
+}
+
+// create a lisp value bignum (takes ownership of b). anything that fits in a
+// long should be an lval_num instead, see lbig.h
+lval* lval_big(lbig* b) {
+    lval* v = lval_alloc(LVAL_BIG);
+    v->big = b;
+    return v;
+}
+
+// create a lisp value channel (takes ownership of c)
+lval* lval_chan(lchan* c) {
+    lval* v = lval_alloc(LVAL_CHAN);
+    v->chan = c;
+    return v;
+}
+
+// create a lisp value process (takes ownership of p)
+lval* lval_proc(lproc* p) {
+    lval* v = lval_alloc(LVAL_PROC);
+    v->proc = p;
+    return v;
+}
+
+void lwork_init(lwork* w) {
+    w->items = w->small;
+    w->count = 0;
+    w->capacity = LWORK_SMALL;
+}
+
+void lwork_push(lwork* w, lval* v) {
+    if (w->count == w->capacity) {
+        w->capacity *= 2;
+        if (w->items == w->small) {
+            w->items = malloc(sizeof(lval*) * w->capacity);
+            memcpy(w->items, w->small, sizeof(w->small));
+        } else {
+            w->items = realloc(w->items, sizeof(lval*) * w->capacity);
+        }
+    }
+    w->items[w->count++] = v;
+}
+
+void lwork_free(lwork* w) {
+    if (w->items != w->small) { free(w->items); }
+}
+
+// frees v, leaving the values inside it on w to be freed next
+static void lval_del_one(lval* v, lwork* w) {
     switch (v->type) {
         case LVAL_NUM: break;
 
         case LVAL_ERR: free(v->err); break;
-        case LVAL_SYM: free(v->sym); break;
-        case LVAL_STR: free(v->str); break;
+        case LVAL_SYM: free(v->sym); lcache_release(v->cache); break;
+        case LVAL_STR:
+            if (v->map) { lmap_release(v->map); } else { free(v->str); }
+            break;
+        case LVAL_SEQ: lseq_release(v->seq); break;
+        case LVAL_BIG: lbig_release(v->big); break;
+        case LVAL_CHAN: lchan_release(v->chan); break;
+        case LVAL_PROC: lproc_release(v->proc); break;
 
         case LVAL_FUN: 
-            if (!v->builtin) {
+            if (v->part) {
+                if (--v->part->refs == 0) {
+                    lwork_push(w, v->part->fn);
+                    lwork_push(w, v->part->args);
+                    free(v->part);
+                }
+            } else if (!v->builtin) {
                 lenv_del(v->env);
-                lval_del(v->formals);
-                lval_del(v->body);
+                lwork_push(w, v->formals);
+                if (--v->body->refs == 0) { lwork_push(w, v->body); }
+                lfold_release(v->fold);
             }
             break;
-        // if its a qexpr or a sexpr we need to recursively delete its elements
         case LVAL_QEXPR:
         case LVAL_SEXPR:
-            //we need to manually free up all the s expressions children using recursion
             for (int i = 0; i < v->count; i++) {
-                lval_del(v->cell[i]);
+                lwork_push(w, v->cell[i]);
             }
+            if (v->cell - v->start != v->small) { free(v->cell - v->start); }
 
             break;
     }
@@ -112,14 +389,25 @@ void lval_del(lval* v) {
     free(v);
 }
 
+// free up lisp values. nested lists go on a worklist rather than the c stack,
+// so however deep they are it can't overflow
+void lval_del(lval* v) {
+    lwork w;
+    lwork_init(&w);
+    lval_del_one(v, &w);
+    while (w.count) {
+        lval_del_one(w.items[--w.count], &w);
+    }
+    lwork_free(&w);
+}
+
 // reads and converts the number (used in the repl)
 lval* lval_read_num(mpc_ast_t* t) {
     // errno is basically c's error handling that isn't -1 
     // its a macro that expands into a global or something idk
     errno = 0;
     long x = strtol(t->contents, NULL, 10);
-    return errno != ERANGE ?
-        lval_num(x) : lval_err("invalid number");
+    return errno != ERANGE ? lval_num(x) : lbig_read(t->contents);
 }
 
 lval* lval_read_str(mpc_ast_t* t) {
@@ -145,10 +433,9 @@ lval* lval_read(mpc_ast_t* t) {
     if (strstr(t->tag, "string")) { return lval_read_str(t); }
 
     lval* x = NULL;
-    // > is the root according to the parser
-    if (strcmp(t->tag, ">") == 0) { x = lval_sexpr(); }
-    if (strcmp(t->tag, "sexpr"))  { x = lval_sexpr(); }
+    // > is the root according to the parser, it's an s-expression like the rest
     if (strstr(t->tag, "qexpr"))  { x = lval_qexpr(); }
+    else                          { x = lval_sexpr(); }
 
     for (int i = 0; i < t->children_num; i++) {
         if (strcmp(t->children[i]->contents, "(") == 0) { continue; }
@@ -167,154 +454,262 @@ lval* lval_read(mpc_ast_t* t) {
 
 // add a lisp value to another lisp value
 lval* lval_add(lval* v, lval* x) {
-    v->count++;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
-    v->cell[v->count - 1] = x;
+    lval_reserve(v, v->count + 1);
+    v->cell[v->count++] = x;
     return v;
 }
 
-// print out an expression recursively w/ lval_print
-void lval_expr_print(lval* v, char* open, char* close) {
-    printf("%s", open);
-
-    for(int i = 0; i < v->count; i++) {
-        lval_print(v->cell[i]);
+// makes room in v for n values altogether, so it can be added to until it
+// has that many without reallocating
+void lval_reserve(lval* v, int n) {
+    if (v->start + n <= v->capacity) { return; }
 
-        if (i != (v->count - 1)) {
-            putchar(' ');
+    lval** cells = v->cell - v->start;
+    if (n <= v->capacity / 2 || (cells == v->small && n <= LVAL_SMALL)) {
+        // plenty of room once what's been popped off the front is reused
+        memmove(cells, v->cell, sizeof(lval*) * v->count);
+    } else {
+        int capacity = v->capacity * 2 > n ? v->capacity * 2 : n;
+        lval_alloc_bytes += sizeof(lval*) * capacity;
+        if (cells == v->small) {
+            cells = malloc(sizeof(lval*) * capacity);
+            memcpy(cells, v->cell, sizeof(lval*) * v->count);
+        } else {
+            memmove(cells, v->cell, sizeof(lval*) * v->count);
+            cells = realloc(cells, sizeof(lval*) * capacity);
         }
+        v->capacity = capacity;
     }
+    v->cell = cells;
+    v->start = 0;
+}
+
+// what's left to print: values, and the bits of punctuation between them
+typedef struct {
+    lval* v;
+    char* text;
+} lprint;
 
-    printf("%s", close);
+static void lprint_push(lprint** items, int* count, int* capacity, lval* v, char* text) {
+    if (*count == *capacity) {
+        *capacity *= 2;
+        *items = realloc(*items, sizeof(lprint) * *capacity);
+    }
+    (*items)[*count].v = v;
+    (*items)[*count].text = text;
+    (*count)++;
 }
 
-// prints out the lisp value depending on what it is
-void lval_print(lval* v) {
-    switch (v->type) {
-        case LVAL_NUM:   printf("%li", v->num); break;
-        case LVAL_ERR:   printf("\033[31mError: %s\033[0m", v->err); break;
-        case LVAL_SYM:   printf("%s", v->sym); break;
-        case LVAL_STR:   lval_print_str(v); break;
-        case LVAL_SEXPR: lval_expr_print(v, "(", ")"); break;
-        case LVAL_QEXPR: lval_expr_print(v, "'(", ")"); break;
-        case LVAL_FUN:
-            if (v->builtin) {
-                printf("<builtin>");
-            } else {
-                printf("(\\ ");
-                lval_print(v->formals);
-                putchar(' ');
-                lval_print(v->body);
-                putchar(')');
+// prints out the lisp value depending on what it is. lists push their
+// contents to be printed next instead of recursing
+void lval_fprint(FILE* f, lval* v) {
+    int count = 0;
+    int capacity = 16;
+    lprint* items = malloc(sizeof(lprint) * capacity);
+    lprint_push(&items, &count, &capacity, v, NULL);
+
+    while (count) {
+        lprint it = items[--count];
+        if (it.text) {
+            fputs(it.text, f);
+            continue;
+        }
+
+        v = it.v;
+        switch (v->type) {
+            case LVAL_NUM:   fprintf(f, "%li", v->num); break;
+            case LVAL_BIG: {
+                char* s = lbig_str(v->big);
+                fputs(s, f);
+                free(s);
+                break;
             }
-            break;
+            case LVAL_ERR:   lerr_fprint(f, v); break;
+            case LVAL_SYM:   fputs(v->sym, f); break;
+            case LVAL_STR:   lval_print_str(f, v); break;
+            case LVAL_SEXPR:
+            case LVAL_QEXPR:
+                fputs(v->type == LVAL_SEXPR ? "(" : "'(", f);
+                // backwards, since the last one pushed is printed first
+                lprint_push(&items, &count, &capacity, NULL, ")");
+                for (int i = v->count - 1; i >= 0; i--) {
+                    lprint_push(&items, &count, &capacity, v->cell[i], NULL);
+                    if (i) { lprint_push(&items, &count, &capacity, NULL, " "); }
+                }
+                break;
+            // these normally get realized before anyone prints them
+            case LVAL_SEQ:   fputs("<sequence>", f); break;
+            case LVAL_CHAN:  fputs("<channel>", f); break;
+            case LVAL_PROC:  fprintf(f, "<process %ld>", (long)v->proc->pid); break;
+            case LVAL_FUN:
+                if (v->builtin) {
+                    fputs("<builtin>", f);
+                } else if (v->part) {
+                    fputs("(partial ", f);
+                    lprint_push(&items, &count, &capacity, NULL, ")");
+                    for (int i = v->part->args->count - 1; i >= 0; i--) {
+                        lprint_push(&items, &count, &capacity, v->part->args->cell[i], NULL);
+                        lprint_push(&items, &count, &capacity, NULL, " ");
+                    }
+                    lprint_push(&items, &count, &capacity, v->part->fn, NULL);
+                } else {
+                    fputs(v->macro ? "(macro " : "(\\ ", f);
+                    lprint_push(&items, &count, &capacity, NULL, ")");
+                    lprint_push(&items, &count, &capacity, v->body, NULL);
+                    lprint_push(&items, &count, &capacity, NULL, " ");
+                    lprint_push(&items, &count, &capacity, v->formals, NULL);
+                }
+                break;
+        }
     }
+
+    free(items);
 }
 
+void lval_print(lval* v) { lval_fprint(stdout, v); }
+
 // adds a println to lval_print what can I say
 void lval_println(lval* v) { lval_print(v); putchar('\n'); }
 
-void lval_print_str(lval* v) {
+void lval_print_str(FILE* f, lval* v) {
     char* escaped = malloc(strlen(v->str) + 1);
     strcpy(escaped, v->str);
 
     // mpc has an "escaped" function
     escaped = mpcf_escape(escaped);
 
-    //print it between "" charachters 
-    printf("\"%s\"", escaped);
+    //print it between "" charachters
+    fprintf(f, "\"%s\"", escaped);
     free(escaped);
 }
 
-// create a copy of an lval 
-lval* lval_copy(lval* v) {
-    lval* x = malloc(sizeof(lval));
-    x->type = v->type;
+// copies v, except that a list only gets an empty array for its cells. v
+// and the copy are left on w for them to be filled in
+static lval* lval_copy_one(lval* v, lwork* w) {
+    // errors are a single block, see struct lerr
+    if (v->type == LVAL_ERR) {
+        lval* x = malloc(sizeof(lval) + v->error->size);
+        memcpy(x, v, sizeof(lval) + v->error->size);
+        lval_allocations++;
+        lval_alloc_bytes += sizeof(lval) + v->error->size;
+        x->error = (lerr*)(x + 1);
+        x->err = v->err ? strdup(v->err) : NULL;
+        return x;
+    }
+
+    lval* x = lval_alloc(v->type);
 
     switch (v->type) {
         case LVAL_NUM: x->num = v->num; break;
+        // sequences are immutable so copies can share them
+        case LVAL_SEQ: x->seq = lseq_retain(v->seq); break;
+        case LVAL_BIG: x->big = lbig_retain(v->big); break;
+        case LVAL_CHAN: x->chan = lchan_retain(v->chan); break;
+        case LVAL_PROC: x->proc = lproc_retain(v->proc); break;
         case LVAL_FUN:
+            x->part = NULL;
+            x->macro = v->macro;
             if (v->builtin) {
                 x->builtin = v->builtin;
+                x->sig = v->sig;
+                x->fold = NULL;
+            } else if (v->part) {
+                // partial applications never change, so copies share them
+                x->builtin = NULL;
+                x->fold = NULL;
+                x->part = v->part;
+                x->part->refs++;
             } else {
                 x->builtin = NULL;
                 x->env = lenv_copy(v->env);
-                x->formals = lval_copy(v->formals);
-                x->body = lval_copy(v->body);
+                x->formals = lval_copy_one(v->formals, w);
+                x->body = v->body;
+                x->body->refs++;
+                x->fold = v->fold ? lfold_retain(v->fold) : NULL;
             }
             break;
 
-        // copying strings using malloc and strcpy
-        case LVAL_ERR: 
-            x->err = malloc(strlen(v->err) + 1);
-            strcpy(x->err, v->err);
-            break;
         case LVAL_SYM:
-            x->sym = malloc(strlen(v->sym) + 1);
-            strcpy(x->sym, v->sym);
+            x->sym = lval_strdup(v->sym);
+            // copies of a body share its call site caches
+            x->cache = v->cache ? lcache_retain(v->cache) : NULL;
             break;
 
         case LVAL_STR:
-            x->str = malloc(strlen(v->str) + 1);
-            strcpy(x->str, v->str);
+            // strings are never changed, so a mapped file can be shared
+            if (v->map) {
+                x->str = v->str;
+                x->map = lmap_retain(v->map);
+                break;
+            }
+            x->str = lval_strdup(v->str);
+            x->map = NULL;
             break;
 
         case LVAL_QEXPR:
         case LVAL_SEXPR:
+            lval_cells_init(x);
+            lval_reserve(x, v->count);
             x->count = v->count;
-            x->cell = malloc(sizeof(lval*) * x->count);
-            for (int i = 0; i < x->count; i++) {
-                x->cell[i] = lval_copy(v->cell[i]);
+            if (x->count) {
+                lwork_push(w, v);
+                lwork_push(w, x);
             }
         break;
     }
     return x;
 }
 
-// evaluate s-expression 
-lval* lval_eval_sexpr(lenv* e, lval* v) {
-    // recursively evaluate children 
-    for (int i = 0; i < v->count; i++) {
-        v->cell[i] = lval_eval(e, v->cell[i]);
-    }
-
-    // error checking 
-    for (int i = 0; i < v->count; i++) {
-        if (v->cell[i]->type == LVAL_ERR) { return lval_take(v, i); }
-    }
-
-    // check for empty expr 
-    if (v->count == 0) { return v; }
-
-    // check for single expr
-    if (v->count == 1) { return lval_take(v, 0); }
-
-    // check that first element is a symbol 
-    lval* f = lval_pop(v, 0);
-    if (f->type != LVAL_FUN) {
-        lval* err = lval_err(
-            "S-expression starts with incorrect type | got %s, expected %s",
-            ltype_name(f->type), ltype_name(LVAL_FUN)
-        );
-        lval_del(f); lval_del(v);
-        return err;
+// create a copy of an lval. like lval_del it gets through nested lists with
+// a worklist instead of recursing
+lval* lval_copy(lval* v) {
+    lwork w;
+    lwork_init(&w);
+    lval* x = lval_copy_one(v, &w);
+    while (w.count) {
+        lval* to = w.items[--w.count];
+        lval* from = w.items[--w.count];
+        for (int i = 0; i < from->count; i++) {
+            to->cell[i] = lval_copy_one(from->cell[i], &w);
+        }
     }
-
-    // call the function
-    lval* result = lval_call(e, f, v);
-    lval_del(f);
-    return result;
+    lwork_free(&w);
+    return x;
 }
 
-// evaluate symbols and then give them to lval_eval_sexpr
-lval* lval_eval(lenv* e, lval* v) {
-    if (v->type == LVAL_SYM) {
-        lval* x = lenv_get(e, v);
-        lval_del(v);
-        return x;
+// roughly how many bytes v takes up, everything inside it included. what
+// copies share (sequences, partial applications, lambda bodies) isn't its
+// alone, so only counts as the value pointing at it
+size_t lval_size(lval* v) {
+    size_t n = 0;
+    lwork w;
+    lwork_init(&w);
+    lwork_push(&w, v);
+    while (w.count) {
+        v = w.items[--w.count];
+        n += sizeof(lval);
+        switch (v->type) {
+            case LVAL_ERR: n += v->error->size; break;
+            case LVAL_SYM: n += strlen(v->sym) + 1; break;
+            case LVAL_STR: if (!v->map) { n += strlen(v->str) + 1; } break;
+            case LVAL_FUN:
+                if (v->builtin || v->part) { break; }
+                n += sizeof(lenv);
+                for (int i = 0; i < v->env->count; i++) {
+                    n += sizeof(char*) + sizeof(lval*) + strlen(v->env->syms[i]) + 1;
+                    lwork_push(&w, v->env->vals[i]);
+                }
+                lwork_push(&w, v->formals);
+                break;
+            case LVAL_QEXPR:
+            case LVAL_SEXPR:
+                n += sizeof(lval*) * v->count;
+                for (int i = 0; i < v->count; i++) { lwork_push(&w, v->cell[i]); }
+                break;
+        }
     }
-    if (v->type == LVAL_SEXPR) { return lval_eval_sexpr(e, v); }
-    return v;
+    lwork_free(&w);
+    return n;
 }
 
 // takes out the i'th element from an array, moving everything 
@@ -322,13 +717,17 @@ lval* lval_eval(lenv* e, lval* v) {
 lval* lval_pop(lval* v, int i) {
     lval* x = v->cell[i];
 
-    // shift everything to envelope x
-    memmove(&v->cell[i], &v->cell[i + 1], 
-        sizeof(lval*) * (v->count - i - 1));
+    if (i == 0) {
+        // the first one's cheap, the array just starts one further along
+        v->cell++;
+        v->start++;
+    } else {
+        // shift everything to envelope x
+        memmove(&v->cell[i], &v->cell[i + 1], 
+            sizeof(lval*) * (v->count - i - 1));
+    }
 
     v->count--;
-
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
     return x;
 }
 
@@ -341,105 +740,23 @@ lval* lval_take(lval* v, int i) {
 
 // joins two lvals. frees y
 lval* lval_join(lval* x, lval* y) {
-  while (y->count) {
-    x = lval_add(x, lval_pop(y, 0));
-  }
+  lval_reserve(x, x->count + y->count);
+  memcpy(&x->cell[x->count], y->cell, sizeof(lval*) * y->count);
+  x->count += y->count;
+  y->count = 0;
   lval_del(y);
   return x;
 }
 
 // create new q-expr (like s-expr but not evaluated)
 lval* lval_qexpr(void) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_QEXPR;
-    v->count = 0;
-    v->cell = NULL;
+    lval* v = lval_alloc(LVAL_QEXPR);
+    lval_cells_init(v);
     return v;
 }
 
-lval* lval_call(lenv* e, lval* f, lval* a) {
-    // if builtin we can just call it
-    if (f->builtin) { return f->builtin(e, a); }
-
-    int given = a->count;
-    int total = f->formals->count;
-
-    while (a->count) {
-        // if we ran out of formals to bind
-        if (f->formals->count == 0) {
-            lval_del(a);
-            return lval_err("Function passed too many arguments | got %d, expected %d",
-                given, total);
-        }
-        
-        // pop out the next symbol and argument
-        lval* sym = lval_pop(f->formals, 0);
-
-        // incase the next arg is the & operator (rest)
-        if (strcmp(sym->sym, "&") == 0) {
-            // make sure & is followed by another symbol
-            if (f->formals->count != 1) {
-                lval_del(a);
-                return lval_err("Function format invalid | Symbol '&' not followed by a single symbol");
-            }
-
-            // next formal should be bound to remaining arguments
-            lval* nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym); lval_del(nsym);
-            break;
-        }
-
-        lval* val = lval_pop(a, 0);
-        // bind a copy into function's environment 
-        lenv_put(f->env, sym, val);
-
-        // delete symbol and value
-        lval_del(sym); lval_del(val);
-
-        
-    }
-
-    lval_del(a);
-
-    // if & remains in formal list bind to empty list
-    if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") == 0) {
-        
-        // check that & isnt passed invalid-ly
-        if (f->formals->count != 2) {
-            return lval_err("Function form invalid | Symbol & not followed by single symbol");
-        }
-
-        // pop and delete &
-        lval_del(lval_pop(f->formals, 0));
-
-        // pop the next symbol, creating an empty list to bind it to
-        lval* sym = lval_pop(f->formals, 0);
-        lval* val = lval_qexpr();
-
-        lenv_put(f->env, sym, val);
-        lval_del(sym); lval_del(val);
-    }
-
-    // if all the formals have been evaluated
-    if (f->formals->count == 0) {
-        // setup environment
-        f->env->parent = e;
-
-        // eval and return
-        return builtin_eval(f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
-    } else {
-        // otherwise return partially evaluated function
-        // partial evaluation only works with non - builtin non-variadic functions
-        return lval_copy(f);
-    }
-}
-
-
-
 lval* lval_lambda(lval* formals, lval* body) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_FUN;
+    lval* v = lval_alloc(LVAL_FUN);
 
     // not builtin - well set it to null
     v->builtin = NULL;
@@ -449,7 +766,58 @@ lval* lval_lambda(lval* formals, lval* body) {
 
     v->formals = formals;
     v->body = body;
+    body->refs = 1;
+    v->fold = NULL;
+    v->part = NULL;
+    v->macro = 0;
 
     return v; 
 }
 
+// f with the arguments args given to it in advance (see struct lpart). takes
+// both
+lval* lval_partial(lval* f, lval* args) {
+    if (!args->count) {
+        lval_del(args);
+        return f;
+    }
+
+    // partially applying a partial application just adds to its arguments
+    if (f->part) {
+        lval* fn = lval_copy(f->part->fn);
+        args = lval_join(lval_copy(f->part->args), args);
+        lval_del(f);
+        f = fn;
+    }
+
+    lpart* p = malloc(sizeof(lpart));
+    p->refs = 1;
+    p->fn = f;
+    p->args = args;
+
+    lval* v = lval_alloc(LVAL_FUN);
+    v->builtin = NULL;
+    v->fold = NULL;
+    v->part = p;
+    v->macro = 0;
+    return v;
+}
+
+// gives every symbol in a lambda body its own call site cache. copies of
+// the body (made by folding it, say) share the caches, so a global like
+// `map` or `+` is only looked up once per call site rather than every time
+void lval_add_caches(lval* body) {
+    lwork w;
+    lwork_init(&w);
+    lwork_push(&w, body);
+    while (w.count) {
+        lval* v = w.items[--w.count];
+        if (v->type == LVAL_SYM && !v->cache) {
+            v->cache = lcache_new(v->sym);
+        }
+        if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) {
+            for (int i = 0; i < v->count; i++) { lwork_push(&w, v->cell[i]); }
+        }
+    }
+    lwork_free(&w);
+}
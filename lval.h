@@ -5,33 +5,156 @@
 
 struct lval;
 struct lenv;
+struct lseq;
+struct deeprose;
+struct lcache;
+struct lfold;
+struct lerr;
+struct lmap;
+struct lpart;
+struct lsig;
+struct lbig;
+struct lchan;
+struct lproc;
+struct lquota;
 typedef struct lval lval;
 typedef struct lenv lenv;
+typedef struct lseq lseq;
+typedef struct deeprose deeprose;
+typedef struct lcache lcache;
+typedef struct lfold lfold;
+typedef struct lerr lerr;
+typedef struct lmap lmap;
+typedef struct lpart lpart;
+typedef struct lsig lsig;
+typedef struct lbig lbig;
+typedef struct lchan lchan;
+typedef struct lproc lproc;
+typedef struct lquota lquota;
 
-enum lisptype { LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_STR, LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN }; // type enum
-enum lisperror { LERR_DIV_ZERO, LERR_BAD_OP, LERR_BAD_NUM }; // error type enum
+enum lisptype { LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_STR, LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN, LVAL_SEQ, LVAL_BIG, LVAL_CHAN, LVAL_PROC }; // type enum
+enum lisperror { LERR_DIV_ZERO, LERR_BAD_OP, LERR_BAD_NUM, LERR_UNBOUND, LERR_ARGS, LERR_TYPE, LERR_USER, LERR_OTHER }; // error type enum
+
+#define LERR_MAX_ARGS 4
+#define LERR_TRACE_FRAMES 8
+#define LERR_TRACE_BYTES 128
+
+// what an error is made of. most errors get thrown away without anyone
+// looking at them, so the message isn't formatted until something prints it:
+// we keep the format (always a string literal) and its arguments, with copies
+// of any strings on the end of the struct. the whole error is one allocation
+struct lerr {
+    int code;
+    char* fmt;
+    int argc;
+    char kinds[LERR_MAX_ARGS];
+    // numbers, or for a string its offset into text
+    long args[LERR_MAX_ARGS];
+
+    // the lambdas the error came back out of, innermost first: names one
+    // after another in trace, each called repeats[i] times in a row. only as
+    // many as fit are kept, frames counts every call
+    int frames;
+    int shown;
+    int trace_len;
+    int repeats[LERR_TRACE_FRAMES];
+    char trace[LERR_TRACE_BYTES];
+
+    // the size of this struct, text included
+    size_t size;
+    char text[];
+};
+
+// a partial application: fn with the arguments in args given to it in
+// advance. calling it calls fn with those, then the ones it's called with.
+// it never changes once made, so copies share it
+struct lpart {
+    int refs;
+    // never a partial application itself
+    lval* fn;
+    lval* args;
+};
 
 typedef lval*(*lbuiltin)(lenv*, lval*);
 
-// lisp value struct 
+// lists this short keep their values in the lval itself
+#define LVAL_SMALL 4
+
+// lisp value struct. what's stored depends on the type, so the rest of it is
+// a union: a number doesn't pay for a list's cells or a function's pointers
 struct lval {
     int type;
 
-    long num;
-    // attached strings
-    char* err;
-    char* sym;
-    char* str;    
-    
-    // function 
-    lbuiltin builtin;
-    lenv* env;
-    lval* formals;
-    lval* body;
-    
-    // other lisp values in the list
-    int count;
-    struct lval** cell;
+    union {
+        long num;
+        // a number too big for num, see lbig.h
+        lbig* big;
+
+        // attached strings. err is the formatted message, NULL until something
+        // asks for it (see lval_err_msg)
+        struct {
+            char* err;
+            lerr* error;
+        };
+
+        struct {
+            char* sym;
+            // symbols in a lambda body: what the symbol last resolved to,
+            // shared by every copy of the body (see lenv_get_cached)
+            lcache* cache;
+        };
+
+        struct {
+            char* str;
+            // set if str points into a mapped file rather than being ours to
+            // free, shared by copies (see lfile.h)
+            lmap* map;
+        };
+
+        // function
+        struct {
+            lbuiltin builtin;
+            // what the builtin's arguments have to be (see builtin.h). NULL
+            // for one that checks its own, like those added with
+            // deeprose_register
+            const lsig* sig;
+            lenv* env;
+            lval* formals;
+            // shared by every copy of the function, since the evaluator never
+            // changes code (see refs)
+            lval* body;
+            // set if body has been folded, see fold.h
+            lfold* fold;
+            // set if this is a partial application (builtin is NULL, and
+            // there's no env, formals or body)
+            lpart* part;
+            // set if this is a macro (see macro.h), a lambda in every other way
+            int macro;
+        };
+
+        // other lisp values in the list. cell points at the first of them,
+        // which isn't always the start of the array: taking one off the front
+        // just moves cell along, start being how far. capacity is how many
+        // the whole array holds, which is small until there are more than
+        // LVAL_SMALL
+        struct {
+            int count;
+            int start;
+            int capacity;
+            // only used on a function's body, and counts the functions that
+            // have it
+            int refs;
+            struct lval** cell;
+            struct lval* small[LVAL_SMALL];
+        };
+
+        // lazy sequence, shared between copies (see lseq.h)
+        lseq* seq;
+        // channel between isolates, shared between copies (see lchan.h)
+        lchan* chan;
+        // child process, shared between copies (see lproc.h)
+        lproc* proc;
+    };
 };
 
 struct lenv {
@@ -39,32 +162,75 @@ struct lenv {
     int count;
     char** syms;
     lval** vals;
+    // the interpreter this environment belongs to. set on the global env, and
+    // on a function's env whenever it's called
+    deeprose* interp;
+    // the lenv_bit of every name bound here, and of every name bound here or
+    // in a local env above (worked out when the parent is set). a name whose
+    // bit isn't in names can only be a global
+    unsigned long own;
+    unsigned long names;
 };
 
 char* ltype_name(int t);
 lval* lval_num(long x);
 lval* lval_err(char* fmt, ...);
+lval* lval_error(int code, char* fmt, ...);
+char* lval_err_msg(lval* v);
+void lval_err_trace(lval* v, char* name);
 lval* lval_sym(char* symbol);
 lval* lval_sexpr(void);
 lval* lval_str(char* str);
+lval* lval_str_n(char* s, size_t n);
+lval* lval_str_map(lmap* m);
 lval* lval_fun(lbuiltin func);
+lval* lval_seq(lseq* s);
+lval* lval_big(lbig* b);
+lval* lval_chan(lchan* c);
+lval* lval_proc(lproc* p);
 void lval_del(lval* v);
 lval* lval_copy(lval* v);
 lval* lval_read_num(mpc_ast_t* t);
 lval* lval_add(lval* v, lval* x);
+void lval_reserve(lval* v, int n);
 lval* lval_read(mpc_ast_t* t);
 lval* lval_read_str(mpc_ast_t* t);
+void lval_fprint(FILE* f, lval* v);
 void lval_print(lval* v);
 void lval_println(lval* v);
-void lval_expr_print(lval* v, char* open, char* close);
-void lval_print_str(lval* v);
+void lval_print_str(FILE* f, lval* v);
 lval* lval_eval_sexpr(lenv* e, lval* v);
+lval* lval_eval_qexpr(lenv* e, lval* q);
 lval* lval_take(lval* v, int i);
 lval* lval_pop(lval* v, int i);
 lval* lval_eval(lenv* e, lval* v);
 lval* lval_qexpr(void);
+// lval_eval, lval_eval_sexpr, lval_eval_qexpr and lval_call live in eval.c
 lval* lval_call(lenv* e, lval* f, lval* a);
+lval* lval_call_take(lenv* e, lval* f, lval* a);
+
+// a stack of values still to get through, so that deeply nested ones can be
+// walked (copied, freed, compared) without recursing on the c stack. the
+// first LWORK_SMALL items don't need a malloc
+#define LWORK_SMALL 32
+typedef struct {
+    lval** items;
+    int count;
+    int capacity;
+    lval* small[LWORK_SMALL];
+} lwork;
+
+void lwork_init(lwork* w);
+void lwork_push(lwork* w, lval* v);
+void lwork_free(lwork* w);
+
+extern __thread unsigned long lval_allocations;
+// roughly how many bytes those came to, strings and list arrays included
+extern __thread unsigned long lval_alloc_bytes;
 
+size_t lval_size(lval* v);
 lval* lval_join(lval* x, lval* y);
 lval* lval_lambda(lval* formals, lval* body);
+lval* lval_partial(lval* f, lval* args);
+void lval_add_caches(lval* body);
 #endif
\ No newline at end of file
@@ -0,0 +1,171 @@
+/// macros, see macro.h
+#include <stdlib.h>
+#include <string.h>
+#include "macro.h"
+#include "builtin.h"
+#include "deeprose.h"
+#include "lseq.h"
+
+// whether a call with n arguments suits m's formals
+static int macro_fits(lval* m, int n) {
+    for (int i = 0; i < m->formals->count; i++) {
+        if (strcmp(m->formals->cell[i]->sym, "&") == 0) { return n >= i; }
+    }
+    return n == m->formals->count;
+}
+
+// the macro x is a call to, if it's one to expand (not a copy), or NULL
+static lval* macro_for(deeprose* d, lval* x) {
+    if (x->type != LVAL_SEXPR && x->type != LVAL_QEXPR) { return NULL; }
+    if (!x->count || x->cell[0]->type != LVAL_SYM) { return NULL; }
+    if (!lenv_find(d->macros, x->cell[0]->sym, NULL)) { return NULL; }
+
+    // it might have been defined as something else since
+    lval* m = lenv_find(d->env, x->cell[0]->sym, NULL);
+    if (!m || m->type != LVAL_FUN || !m->macro || !macro_fits(m, x->count - 1)) { return NULL; }
+    return m;
+}
+
+// the expansion of the call x to m. with take set, x's arguments are moved
+// into the call rather than copied, leaving x with just its head
+static lval* expand_call(lenv* e, lval* m, lval* x, int take) {
+    char* name = x->cell[0]->type == LVAL_SYM ? x->cell[0]->sym : "macro";
+    if (!macro_fits(m, x->count - 1)) {
+        return lval_error(LERR_ARGS, "Macro '%s' passed incorrect number of args | got %d, expected %d",
+            name, x->count - 1, m->formals->count);
+    }
+
+    // the macro's body is run as a plain lambda
+    lval* f = lval_copy(m);
+    f->macro = 0;
+    lval* args = lval_sexpr();
+    lval_reserve(args, x->count - 1);
+    for (int i = 1; i < x->count; i++) {
+        args->cell[args->count++] = take ? x->cell[i] : lval_copy(x->cell[i]);
+    }
+    if (take) { x->count = 1; }
+    lval* r = lval_realize(e, lval_call_take(e, f, args));
+
+    if (r->type == LVAL_ERR) {
+        lval_err_trace(r, name);
+        return r;
+    }
+    // code in a q-expression stays a q-expression, so an if's branch is still
+    // one. anything but a list is what the call evaluates to, and in a
+    // q-expression that's '(r)
+    if (r->type == LVAL_QEXPR || r->type == LVAL_SEXPR) {
+        r->type = x->type;
+    } else if (x->type == LVAL_QEXPR) {
+        r = lval_add(lval_qexpr(), r);
+    }
+    return r;
+}
+
+lval* lval_expand_call(lenv* e, lval* m, lval* x) {
+    return expand_call(e, m, x, 0);
+}
+
+// expands x (which this takes) for as long as it's a macro call
+static lval* expand_here(lenv* e, deeprose* d, lval* x) {
+    lval* m;
+    for (int n = 0; (m = macro_for(d, x)); n++) {
+        if (n == MACRO_MAX_EXPANSIONS) {
+            lval* err = lval_err("Macro '%s' kept expanding into macro calls, more than %d times",
+                x->cell[0]->sym, MACRO_MAX_EXPANSIONS);
+            lval_del(x);
+            return err;
+        }
+        lval* r = expand_call(e, m, x, 1);
+        lval_del(x);
+        x = r;
+        if (x->type == LVAL_ERR) { break; }
+    }
+    return x;
+}
+
+// whether the i'th value of the call v is a q-expression that gets run as
+// code: a lambda's body, if's branches, and what do, eval, time, bench,
+// with-limits and defmacro run. any other q-expression is data, and left as
+// it is even if it looks like a macro call
+static int code_arg(lval* v, int i) {
+    if (v->cell[0]->type != LVAL_SYM) { return 0; }
+    char* head = v->cell[0]->sym;
+    if (strcmp(head, "\\") == 0) { return i == 2; }
+    if (strcmp(head, "if") == 0) { return i == 2 || i == 3; }
+    if (strcmp(head, "do") == 0) { return 1; }
+    if (strcmp(head, "eval") == 0 || strcmp(head, "time") == 0 || strcmp(head, "bench") == 0) { return i == 1; }
+    if (strcmp(head, "with-limits") == 0) { return i == 2; }
+    return strcmp(head, "defmacro") == 0 && i == 3;
+}
+
+lval* lval_expand(lenv* e, lval* x) {
+    deeprose* d = lenv_interp(e);
+    // anything but a call is evaluated to itself
+    if (!d || !d->macros->count || x->type != LVAL_SEXPR) { return x; }
+
+    x = expand_here(e, d, x);
+    if (x->type != LVAL_SEXPR && x->type != LVAL_QEXPR) { return x; }
+
+    // through every call in it, and the code inside those, on a worklist so
+    // nesting can't overflow the c stack
+    lwork w;
+    lwork_init(&w);
+    lwork_push(&w, x);
+    lval* err = NULL;
+    while (w.count && !err) {
+        lval* v = w.items[--w.count];
+        for (int i = 0; i < v->count; i++) {
+            lval* c = v->cell[i];
+            if (c->type != LVAL_SEXPR && !(c->type == LVAL_QEXPR && i && code_arg(v, i))) { continue; }
+            c = v->cell[i] = expand_here(e, d, c);
+            if (c->type == LVAL_ERR) {
+                err = lval_copy(c);
+                break;
+            }
+            if ((c->type == LVAL_SEXPR || c->type == LVAL_QEXPR) && c->count) { lwork_push(&w, c); }
+        }
+    }
+    lwork_free(&w);
+
+    if (err) {
+        lval_del(x);
+        return err;
+    }
+    return x;
+}
+
+lval* builtin_defmacro(lenv* e, lval* a) {
+    lval* name = a->cell[0];
+    LASSERT(a, name->count == 1 && name->cell[0]->type == LVAL_SYM,
+        "Function 'defmacro' passed an incorrect name | expected a list of one symbol");
+    for (int i = 0; i < a->cell[1]->count; i++) {
+        LASSERT(a, a->cell[1]->cell[i]->type == LVAL_SYM,
+            "Cannot define non-symbol | Got %s, expected %s",
+            ltype_name(a->cell[1]->cell[i]->type), ltype_name(LVAL_SYM));
+    }
+
+    // the same lambda \ would make, just marked as a macro
+    lval* formals = lval_pop(a, 1);
+    lval* body = lval_pop(a, 1);
+    lval* f = builtin_lambda(e, lval_add(lval_add(lval_sexpr(), formals), body));
+    if (f->type == LVAL_ERR) {
+        lval_del(a);
+        return f;
+    }
+    f->macro = 1;
+
+    deeprose* d = lenv_interp(e);
+    lval* yes = lval_num(1);
+    lenv_put(d->macros, name->cell[0], yes);
+    lenv_def(e, name->cell[0], f);
+    lval_del(yes);
+    lval_del(f);
+    lval_del(a);
+    return lval_sexpr();
+}
+
+lval* builtin_sexpr(lenv* e, lval* a) {
+    lval* x = lval_take(a, 0);
+    x->type = LVAL_SEXPR;
+    return x;
+}
@@ -0,0 +1,35 @@
+#ifndef MACRO_HEADER
+#define MACRO_HEADER
+#include "lval.h"
+
+// macros. (defmacro '(name) '(formals) '(body)) defines a macro, which is
+// called like a lambda but with the code it was written with instead of the
+// values: (name a b) binds the formals to the forms a and b, unevaluated, and
+// runs the body. what that gives back is the code the call stands for, its
+// expansion: a q-expression becomes the s-expression to run in its place.
+// (head '(a b)) gives '(a) without evaluating a, and (sexpr '(f x)) makes
+// the call (f x) as a value, for taking code apart and putting calls inside
+// an expansion.
+//
+// expanding happens ahead of time, once: a form is expanded when it's read,
+// before it's evaluated, the expansion taking the call's place in the code.
+// macro calls in code made up while running (like with join and eval) are
+// expanded every time they're run instead.
+//
+// only code is expanded: calls, and the q-expressions that get run as code
+// (a lambda's body, if's branches, and what do, eval, time, bench,
+// with-limits and defmacro run, going by the name they're called by). any
+// other q-expression is data, so '(defn a b c) stays a list of four symbols.
+// code passed in a q-expression to anything else is expanded when it's run.
+//
+// an expansion can call macros, itself included, and is expanded in turn, up
+// to MACRO_MAX_EXPANSIONS times in the same place.
+#define MACRO_MAX_EXPANSIONS 1000
+
+// x (which this takes) with every macro call in it expanded, or the error
+// an expansion gave
+lval* lval_expand(lenv* e, lval* x);
+// the expansion of the call x (not taken) to the macro m
+lval* lval_expand_call(lenv* e, lval* m, lval* x);
+
+#endif
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <editline/readline.h>
+#include <string.h>
+#include <unistd.h>
+#include "mpc.h"
+#include "lval.h"
+#include "builtin.h"
+#include "parsing.h"
+#include "deeprose.h"
+#include "server.h"
+#include "macro.h"
+#include "compile.h"
+#include "lseq.h"
+
+// batch mode writes go through this instead of hitting the terminal line by line
+#define BATCH_OUTPUT_BUFFER (1 << 16)
+
+static void usage(char* prog) {
+    printf("usage: %s [--no-jit] [--stack-limit bytes] [--max-steps n] [--max-alloc bytes] [--timeout ms]\n", prog);
+    printf("       %*s [file...] [-e expr] [--script file] [-]\n", (int)strlen(prog), "");
+    printf("       %s --serve socket-path [--workers n]\n", prog);
+    printf("       %s --compile file -o out.c\n", prog);
+    puts("  file           load file, then start the repl (unless running in batch mode)");
+    puts("  -e expr        evaluate expr and print the result, then exit");
+    puts("  --script file  run file and exit, with status 1 if anything errored");
+    puts("  -              run the program on stdin and exit");
+    puts("  --serve path   answer evaluation requests on a unix socket (see server.c)");
+    puts("  --workers n    how many interpreters --serve keeps warm, one per core by default");
+    puts("  --no-jit       never compile hot lambdas to machine code");
+    puts("  --stack-limit bytes  how much memory evaluation frames can take, 64MB by default");
+    puts("  --max-steps n        stop each program, repl line or request with an error after n evaluation steps,");
+    puts("  --max-alloc bytes    once it's allocated this many bytes,");
+    puts("  --timeout ms         or once it's run for this long");
+    puts("  --compile file translate the prelude and file into a standalone c program");
+}
+
+// reads everything on stdin into a string
+static char* read_stdin(void) {
+    size_t size = 0;
+    size_t capacity = 4096;
+    char* buf = malloc(capacity);
+
+    size_t n;
+    while ((n = fread(buf + size, 1, capacity - size - 1, stdin)) > 0) {
+        size += n;
+        if (capacity - size - 1 == 0) {
+            capacity *= 2;
+            buf = realloc(buf, capacity);
+        }
+    }
+
+    buf[size] = '\0';
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    // server mode takes over entirely
+    char* socket_path = NULL;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    char* compile_script = NULL;
+    char* compile_out = NULL;
+    for (int i = 1; i < argc; i++) {
+        // same as DEEPROSE_NO_JIT, which every interpreter we make checks
+        if (strcmp(argv[i], "--no-jit") == 0) { setenv("DEEPROSE_NO_JIT", "1", 1); }
+        else if (strcmp(argv[i], "--stack-limit") == 0 && i + 1 < argc) {
+            setenv("DEEPROSE_STACK_LIMIT", argv[++i], 1);
+        }
+        else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) { setenv("DEEPROSE_MAX_STEPS", argv[++i], 1); }
+        else if (strcmp(argv[i], "--max-alloc") == 0 && i + 1 < argc) { setenv("DEEPROSE_MAX_ALLOC", argv[++i], 1); }
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) { setenv("DEEPROSE_TIMEOUT_MS", argv[++i], 1); }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) { socket_path = argv[++i]; }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) { workers = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc) { compile_script = argv[++i]; }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) { compile_out = argv[++i]; }
+    }
+    // so does compiling
+    if (compile_script) {
+        if (!compile_out) {
+            puts("--compile expects an output file (-o out.c)");
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return compile_program(compile_script, compile_out) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (socket_path) {
+        if (workers < 1) { workers = 1; }
+        return serve(socket_path, workers) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // in batch mode we run what we're given and exit rather than starting the repl
+    int batch = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--script") == 0 || strcmp(argv[i], "-") == 0) {
+            batch = 1;
+        }
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    // a program piped in on stdin runs in batch mode too
+    int from_stdin = !batch && !isatty(STDIN_FILENO);
+    if (from_stdin) { batch = 1; }
+
+    // fully buffer stdout, it gets flushed on exit and before reading input
+    if (batch) { setvbuf(stdout, NULL, _IOFBF, BATCH_OUTPUT_BUFFER); }
+
+    deeprose* d = deeprose_new();
+    lenv* e = d->env;
+
+    // load the prelude
+    {
+        lval* x = load_prelude(e);
+        if (x->type == LVAL_ERR) {
+            puts(lval_err_msg(x));
+            exit(EXIT_FAILURE);
+        }
+        lval_del(x);
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-jit") == 0) { continue; }
+        if (strcmp(argv[i], "--stack-limit") == 0 || strcmp(argv[i], "--max-steps") == 0
+            || strcmp(argv[i], "--max-alloc") == 0 || strcmp(argv[i], "--timeout") == 0) {
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--script") == 0) {
+            if (i + 1 >= argc) {
+                printf("%s expects an argument\n", argv[i]);
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+
+            if (strcmp(argv[i], "-e") == 0) {
+                failed += run_program(e, "<-e>", argv[i + 1], 1);
+            } else {
+                failed += run_program(e, argv[i + 1], NULL, 0);
+            }
+            i++;
+        } else if (strcmp(argv[i], "-") == 0) {
+            char* input = read_stdin();
+            failed += run_program(e, "<stdin>", input, 0);
+            free(input);
+        } else if (batch) {
+            // files before or between batch arguments are just loaded
+            failed += run_program(e, argv[i], NULL, 0);
+        } else {
+            // create a lval with the argument as the str
+            lval* arg = lval_add(lval_sexpr(), lval_str(argv[i]));
+            lval* x = builtin_load(e, arg);
+            // print out error if there is any
+            if (x->type == LVAL_ERR) { lval_println(x); }
+            lval_del(x);
+        }
+    }
+
+    if (from_stdin) {
+        char* input = read_stdin();
+        failed += run_program(e, "<stdin>", input, 0);
+        free(input);
+    }
+
+    if (batch) {
+        deeprose_del(d);
+        // exit flushes the output buffer for us
+        exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    puts("Deeprose version 0.1.0\n");
+    puts("press C-c to exit\n");
+
+    while (1) {
+        // purple ish blue colour
+        char* input = readline("\033[34mdeeprose =>\033[0m ");
+        // C-d
+        if (!input) { putchar('\n'); break; }
+        add_history(input);
+
+        // the whole line is evaluated as one s-expression
+        lval* expr = read_program(d, "<stdin>", input);
+        lquota q;
+        lquota_begin(d, &q, d->limits);
+        lval* val = expr->type == LVAL_ERR ? expr : lval_realize(e, lval_eval(e, lval_expand(e, expr)));
+        lquota_end(d, &q);
+        lval_println(val);
+        lval_del(val);
+
+        free(input);
+    }
+
+    deeprose_del(d);
+    return 0;
+}
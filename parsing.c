@@ -1,54 +1,97 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <editline/readline.h>
 #include <string.h>
 #include "mpc.h"
 #include "lval.h"
 #include "builtin.h"
-
-mpc_parser_t* Deeprose;
-
-// need to have this here because it depends on mpc parser token
-lval* builtin_load(lenv* e, lval* a) {
-    LASSERT_ARGS_NUM("load", a, 1);
-    LASSERT_ARGS_TYPE("load", a, 0, LVAL_STR);
-
-    // parse file given by string name 
+#include "parsing.h"
+#include "deeprose.h"
+#include "lseq.h"
+#include "macro.h"
+
+// parse a whole program, from the file called name if input is NULL or
+// from input otherwise. returns an sexpr of the expressions, or an error
+lval* read_program(deeprose* d, char* name, char* input) {
+    mpc_parser_t* program = d->grammar[DEEPROSE_GRAMMAR_RULES - 1];
     mpc_result_t result;
-    if (mpc_parse_contents(a->cell[0]->str, Deeprose, &result)) {
-        // read contents
-        lval* expr = lval_read(result.output);
-        mpc_ast_delete(result.output);
-
-        while (expr->count) {
-            lval* x = lval_eval(e, lval_pop(expr, 0));
-            // if error print it
-            if (x->type == LVAL_ERR) { lval_print(x); }
-            lval_del(x);
-        }
-
-        lval_del(expr);
-        lval_del(a);
+    int ok = input
+        ? mpc_parse(name, input, program, &result)
+        : mpc_parse_contents(name, program, &result);
 
-        return lval_sexpr();
-    } else {
-        // get parse error as string 
+    if (!ok) {
+        // get parse error as string
         char* err_msg = mpc_err_string(result.error);
         mpc_err_delete(result.error);
 
         // create error message to return
-        lval* err = lval_err("Could not load library %s", err_msg);
+        lval* err = lval_err("%s", err_msg);
         free(err_msg);
-        lval_del(a);
+        return err;
+    }
+
+    lval* expr = lval_read(result.output);
+    mpc_ast_delete(result.output);
+    return expr;
+}
 
+// need to have this here because it depends on mpc parser token
+lval* builtin_load(lenv* e, lval* a) {
+    deeprose* d = lenv_interp(e);
+
+    // parse file given by string name
+    lval* expr = read_program(d, a->cell[0]->str, NULL);
+    lval_del(a);
+    if (expr->type == LVAL_ERR) {
+        lval* err = lval_err("Could not load library %s", lval_err_msg(expr));
+        lval_del(expr);
         return err;
+    }
 
+    while (expr->count) {
+        // sequences at the top level get run, for their side effects
+        lval* x = lval_realize(e, lval_eval(e, lval_expand(e, lval_pop(expr, 0))));
+        // if error print it
+        if (x->type == LVAL_ERR) { lval_fprint(d->out, x); }
+        lval_del(x);
     }
+
+    lval_del(expr);
+    return lval_sexpr();
 }
 
+// like load, but for running a whole program non-interactively. every error
+// gets printed, and so does every other result if print_results is set.
+// returns how many expressions failed (a parse error counts as one)
+int run_program(lenv* e, char* name, char* input, int print_results) {
+    deeprose* d = lenv_interp(e);
+    lval* expr = read_program(d, name, input);
+    if (expr->type == LVAL_ERR) {
+        lval_fprint(d->out, expr);
+        fputc('\n', d->out);
+        lval_del(expr);
+        return 1;
+    }
+
+    lquota q;
+    lquota_begin(d, &q, d->limits);
+    int failed = 0;
+    while (expr->count) {
+        lval* x = lval_realize(e, lval_eval(e, lval_expand(e, lval_pop(expr, 0))));
+        if (x->type == LVAL_ERR) { failed++; }
+        if (x->type == LVAL_ERR || print_results) {
+            lval_fprint(d->out, x);
+            fputc('\n', d->out);
+        }
+        lval_del(x);
+    }
+    lquota_end(d, &q);
 
-int main(int argc, char **argv) {
-    // mpc parser config stuff 
+    lval_del(expr);
+    return failed;
+}
+
+// mpc parser config stuff. every interpreter builds its own grammar
+void parser_init(deeprose* d) {
     mpc_parser_t* Number   = mpc_new("number");
     mpc_parser_t* Symbol   = mpc_new("symbol");
     mpc_parser_t* Sexpr    = mpc_new("sexpr");
@@ -57,9 +100,9 @@ int main(int argc, char **argv) {
     mpc_parser_t* String   = mpc_new("string");
     mpc_parser_t* Comment  = mpc_new("comment");
     mpc_parser_t* Expr     = mpc_new("expr");
-    Deeprose    = mpc_new("deeprose");
- 
-    mpca_lang(MPCA_LANG_DEFAULT, 
+    mpc_parser_t* Deeprose = mpc_new("deeprose");
+
+    mpca_lang(MPCA_LANG_DEFAULT,
     "                                       \
     number  : /-?[0-9]+/ ;                    \
     symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&?\\^\\\%]+/ ; \
@@ -71,64 +114,32 @@ int main(int argc, char **argv) {
     deeprose   : /^/ <expr>* /$/ ;               \
     ",
         Number, Symbol, Sexpr, Qexpr, String, Comment, Expr, Deeprose);
-    
-    lenv* e = lenv_new();
-    lenv_add_builtins(e);
-
-    // creating a path str for the prelude 
-    {
-        // 1024 should be enough
-        char path[1024];
-        
-        if (!getenv("DRLIBPATH")) {
-            puts("undefined env variable $DRLIBPATH");
-            exit(EXIT_FAILURE);
-        }
 
-        strncpy(path, getenv("DRLIBPATH"), 1024);
-        strncat(path, "/stdlib.deeprose", 1024 - strlen(path));
-
-        // load file in path
-        builtin_load(e, 
-            lval_add(lval_sexpr(), lval_str(path)));
-    }
+    mpc_parser_t* grammar[DEEPROSE_GRAMMAR_RULES] = {
+        Number, Symbol, Sexpr, Qexpr, String, Comment, Expr, Deeprose
+    };
+    memcpy(d->grammar, grammar, sizeof(grammar));
+}
 
-    
+// free up parser heap memory stuff
+void parser_cleanup(deeprose* d) {
+    mpc_cleanup(DEEPROSE_GRAMMAR_RULES,
+        d->grammar[0], d->grammar[1], d->grammar[2], d->grammar[3],
+        d->grammar[4], d->grammar[5], d->grammar[6], d->grammar[7]);
+}
 
-    if (argc >= 2) {
-        for (int i = 1; i < argc; i++) {
-            // create a lval with the argument as the str 
-            lval* arg = lval_add(lval_sexpr(), lval_str(argv[i]));
-            lval* x = builtin_load(e, arg);
-            // print out error if there is any
-            if (x->type == LVAL_ERR) { lval_println(x); }
-            lval_del(x);
-        }
-    } 
-    
-    puts("Deeprose version 0.1.0\n");
-    puts("press C-c to exit\n");
-
-    while (1) {
-        // purple ish blue colour
-        char* input = readline("\033[34mdeeprose =>\033[0m ");
-        add_history(input);  
-
-        mpc_result_t r;
-        if (mpc_parse("<stdin>", input, Deeprose, &r)) {
-            lval* val = lval_eval(e, lval_read(r.output));
-            lval_println(val);
-            mpc_ast_delete(r.output);
-        } else {
-            mpc_err_print(r.error);
-            mpc_err_print(r.error);
-        }
+// loads $DRLIBPATH/stdlib.deeprose into e
+lval* load_prelude(lenv* e) {
+    // 1024 should be enough
+    char path[1024];
 
-        free(input);
+    if (!getenv("DRLIBPATH")) {
+        return lval_err("undefined env variable $DRLIBPATH");
     }
 
-    // free up parser heap memory stuff
-    mpc_cleanup(5, Number, Symbol, Sexpr, Qexpr, String, Comment, Expr, Deeprose);
-    lenv_del(e);
-    return 0;
-}
\ No newline at end of file
+    strncpy(path, getenv("DRLIBPATH"), 1024);
+    strncat(path, "/stdlib.deeprose", 1024 - strlen(path));
+
+    // load file in path
+    return builtin_load(e, lval_add(lval_sexpr(), lval_str(path)));
+}
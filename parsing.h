@@ -0,0 +1,13 @@
+#ifndef PARSING_HEADER
+#define PARSING_HEADER
+#include "mpc.h"
+#include "lval.h"
+#include "lenv.h"
+
+void parser_init(deeprose* d);
+void parser_cleanup(deeprose* d);
+lval* read_program(deeprose* d, char* name, char* input);
+lval* load_prelude(lenv* e);
+int run_program(lenv* e, char* name, char* input, int print_results);
+
+#endif
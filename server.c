@@ -0,0 +1,254 @@
+/// `deeprose --serve`: a pool of interpreters with the prelude already loaded,
+/// answering evaluation requests over a unix domain socket.
+///
+/// the protocol is length prefixed, all lengths are 4 byte big endian:
+///   request:  length, then that many bytes of deeprose source
+///   response: status byte (0 ok, 1 error), length, the printed value of the
+///             last expression (or the error), length, anything it printed
+/// a connection can send as many requests as it likes. every request starts
+/// from the clean prelude state, nothing it defines is seen by the next one.
+/// a worker serves one connection at a time, start to finish, so a client
+/// that keeps its connection open (or is slow to send) holds a worker the
+/// whole time, and as many of them as there are workers starve everyone else
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "deeprose.h"
+#include "builtin.h"
+#include "parsing.h"
+#include "server.h"
+
+// anything bigger than this is refused rather than malloc'd
+#define SERVE_MAX_REQUEST (16 * 1024 * 1024)
+
+typedef struct {
+    int listener;
+    deeprose* d;
+    // the global env straight after the prelude, copied back after each
+    // request, along with the interpreter's other state that code can add to:
+    // the names that have been locals (and let-bound) and the names of macros
+    lenv* clean;
+    lenv* clean_locals;
+    unsigned long clean_rebound;
+    lenv* clean_macros;
+} worker;
+
+// exit and input-num would take down or hang the whole server
+static lval* builtin_serve_exit(lenv* e, lval* a) {
+    lval_del(a);
+    return lval_err("Function 'exit' is not available in server mode");
+}
+
+static lval* builtin_serve_input_num(lenv* e, lval* a) {
+    lval_del(a);
+    return lval_err("Function 'input-num' is not available in server mode");
+}
+
+// an isolate can outlive the request that spawned it, and would go on
+// printing to that request's output after it's been sent and closed
+static lval* builtin_serve_spawn(lenv* e, lval* a) {
+    lval_del(a);
+    return lval_err("Function 'spawn' is not available in server mode");
+}
+
+// requests are code from whoever can reach the socket, so they don't get a
+// shell or the server's files either. run's command would also print
+// straight to the server's stdout rather than the request's output
+#define SERVE_DISABLED(fn, name) \
+    static lval* fn(lenv* e, lval* a) { \
+        lval_del(a); \
+        return lval_err("Function '" name "' is not available in server mode"); \
+    }
+
+SERVE_DISABLED(builtin_serve_run, "run")
+SERVE_DISABLED(builtin_serve_spawn_process, "spawn-process")
+SERVE_DISABLED(builtin_serve_read_file, "read-file")
+SERVE_DISABLED(builtin_serve_lines, "lines")
+SERVE_DISABLED(builtin_serve_write_file, "write-file")
+SERVE_DISABLED(builtin_serve_append_file, "append-file")
+SERVE_DISABLED(builtin_serve_load, "load")
+
+// read or write exactly n bytes. returns 0 on eof or error
+static int read_full(int fd, void* buf, size_t n) {
+    char* p = buf;
+    while (n) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) { continue; }
+        if (r <= 0) { return 0; }
+        p += r; n -= r;
+    }
+    return 1;
+}
+
+static int write_full(int fd, void* buf, size_t n) {
+    char* p = buf;
+    while (n) {
+        ssize_t r = write(fd, p, n);
+        if (r < 0 && errno == EINTR) { continue; }
+        if (r <= 0) { return 0; }
+        p += r; n -= r;
+    }
+    return 1;
+}
+
+static int read_length(int fd, uint32_t* n) {
+    unsigned char b[4];
+    if (!read_full(fd, b, 4)) { return 0; }
+    *n = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    return 1;
+}
+
+static int write_chunk(int fd, char* data, size_t n) {
+    unsigned char b[4] = { n >> 24, n >> 16, n >> 8, n };
+    return write_full(fd, b, 4) && write_full(fd, data, n);
+}
+
+// evaluates one request and sends the response. returns 0 if the client went away
+static int handle_request(worker* w, int fd, char* source) {
+    deeprose* d = w->d;
+
+    char* output = NULL;
+    size_t output_size = 0;
+    d->out = open_memstream(&output, &output_size);
+
+    lval* result = deeprose_eval_string(d, source);
+    fclose(d->out);
+    d->out = stdout;
+
+    unsigned char status = result->type == LVAL_ERR;
+    char* printed = status ? lval_err_msg(result) : deeprose_to_string(result);
+
+    int ok = write_full(fd, &status, 1)
+        && write_chunk(fd, printed, strlen(printed))
+        && write_chunk(fd, output, output_size);
+
+    if (!status) { free(printed); }
+    free(output);
+    lval_del(result);
+
+    // back to the clean prelude state for the next request
+    lenv_del(d->env);
+    d->env = lenv_copy(w->clean);
+    lenv_del(d->locals);
+    d->locals = lenv_copy(w->clean_locals);
+    d->rebound = w->clean_rebound;
+    lenv_del(d->macros);
+    d->macros = lenv_copy(w->clean_macros);
+    return ok;
+}
+
+static void serve_connection(worker* w, int fd) {
+    uint32_t n;
+    while (read_length(fd, &n)) {
+        if (n > SERVE_MAX_REQUEST) {
+            unsigned char status = 1;
+            char* msg = "request too large";
+            write_full(fd, &status, 1);
+            write_chunk(fd, msg, strlen(msg));
+            write_chunk(fd, "", 0);
+            break;
+        }
+
+        char* source = malloc(n + 1);
+        if (!read_full(fd, source, n)) { free(source); break; }
+        source[n] = '\0';
+
+        int ok = handle_request(w, fd, source);
+        free(source);
+        if (!ok) { break; }
+    }
+    close(fd);
+}
+
+static void* worker_main(void* arg) {
+    worker* w = arg;
+    while (1) {
+        int fd = accept(w->listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            perror("accept");
+            return NULL;
+        }
+        serve_connection(w, fd);
+    }
+}
+
+// an interpreter with the prelude loaded and the unsafe builtins replaced
+static int worker_init(worker* w, int listener) {
+    w->listener = listener;
+    w->d = deeprose_new();
+
+    lval* x = load_prelude(w->d->env);
+    if (x->type == LVAL_ERR) {
+        lval_println(x);
+        lval_del(x);
+        return 0;
+    }
+    lval_del(x);
+
+    deeprose_register(w->d, "exit", builtin_serve_exit);
+    deeprose_register(w->d, "input-num", builtin_serve_input_num);
+    deeprose_register(w->d, "spawn", builtin_serve_spawn);
+    deeprose_register(w->d, "run", builtin_serve_run);
+    deeprose_register(w->d, "spawn-process", builtin_serve_spawn_process);
+    deeprose_register(w->d, "read-file", builtin_serve_read_file);
+    deeprose_register(w->d, "lines", builtin_serve_lines);
+    deeprose_register(w->d, "write-file", builtin_serve_write_file);
+    deeprose_register(w->d, "append-file", builtin_serve_append_file);
+    deeprose_register(w->d, "load", builtin_serve_load);
+
+    w->clean = lenv_copy(w->d->env);
+    w->clean_locals = lenv_copy(w->d->locals);
+    w->clean_rebound = w->d->rebound;
+    w->clean_macros = lenv_copy(w->d->macros);
+    return 1;
+}
+
+int serve(char* socket_path, int workers) {
+    // a client hanging up mid response shouldn't kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("socket path too long: %s\n", socket_path);
+        return 0;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) { perror("socket"); return 0; }
+
+    // clear out a stale socket from a previous run
+    unlink(socket_path);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); return 0; }
+    if (listen(listener, 128) < 0) { perror("listen"); return 0; }
+
+    worker* pool = malloc(sizeof(worker) * workers);
+    for (int i = 0; i < workers; i++) {
+        if (!worker_init(&pool[i], listener)) { return 0; }
+    }
+
+    printf("serving on %s with %d interpreters\n", socket_path, workers);
+    fflush(stdout);
+
+    // every worker accepts on the same socket, the kernel hands out connections
+    pthread_t* threads = malloc(sizeof(pthread_t) * workers);
+    for (int i = 0; i < workers; i++) {
+        pthread_create(&threads[i], NULL, worker_main, &pool[i]);
+    }
+    for (int i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    return 1;
+}
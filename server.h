@@ -0,0 +1,8 @@
+#ifndef SERVER_HEADER
+#define SERVER_HEADER
+
+// serve evaluation requests on a unix socket with a pool of workers
+// interpreters. only returns (with 0) if the server couldn't start
+int serve(char* socket_path, int workers);
+
+#endif